@@ -27,8 +27,15 @@
  * @short_description: Basic JSON-RPC methods for Melo Browser
  *
  * Helper which implements all basic JSON-RPC methods for #MeloBrowser.
+ *
+ * The "browser.get_tags" calls are deferred to a small thread pool, since the
+ * browser may have to read a file or to fetch the tags from the network: the
+ * JSON-RPC thread is released while the tags are retrieved.
  */
 
+/* Number of threads retrieving tags for deferred calls */
+#define MELO_BROWSER_JSONRPC_THREADS 4
+
 typedef enum {
   MELO_BROWSER_JSONRPC_LIST_FIELDS_NONE = 0,
   MELO_BROWSER_JSONRPC_LIST_FIELDS_ID = 1,
@@ -54,14 +61,23 @@ typedef enum {
   MELO_BROWSER_JSONRPC_TAGS_FULL,
 } MeloBrowserJSONRPCTags;
 
+typedef struct {
+  MeloJSONRPCCompletion *completion;
+  MeloBrowser *bro;
+  gchar *path;
+  MeloTagsFields fields;
+} MeloBrowserJSONRPCGetTagsJob;
+
+/* Thread pool for deferred calls */
+G_LOCK_DEFINE_STATIC (melo_browser_jsonrpc_mutex);
+static GThreadPool *melo_browser_jsonrpc_pool = NULL;
+
 static MeloBrowser *
-melo_browser_jsonrpc_get_browser (JsonObject *obj, JsonNode **error)
+melo_browser_jsonrpc_get_browser_by_id (const gchar *id, JsonNode **error)
 {
   MeloBrowser *bro;
-  const gchar *id;
 
   /* Get browser by id */
-  id = json_object_get_string_member (obj, "id");
   bro = melo_browser_get_browser_by_id (id);
   if (bro)
     return bro;
@@ -72,6 +88,13 @@ melo_browser_jsonrpc_get_browser (JsonObject *obj, JsonNode **error)
   return NULL;
 }
 
+static MeloBrowser *
+melo_browser_jsonrpc_get_browser (JsonObject *obj, JsonNode **error)
+{
+  return melo_browser_jsonrpc_get_browser_by_id (
+                              json_object_get_string_member (obj, "id"), error);
+}
+
 /**
  * melo_browser_jsonrpc_get_info_fields:
  * @obj: the #JsonObject to parse
@@ -187,22 +210,16 @@ melo_browser_jsonrpc_info_to_object (const gchar *id,
   return obj;
 }
 
-MeloBrowserJSONRPCListFields
-melo_browser_jsonrpc_get_list_fields (JsonObject *obj)
+static MeloBrowserJSONRPCListFields
+melo_browser_jsonrpc_get_list_fields_from_array (JsonArray *array)
 {
   MeloBrowserJSONRPCListFields fields = MELO_BROWSER_JSONRPC_LIST_FIELDS_NONE;
   const gchar *field;
-  JsonArray *array;
   guint count, i;
 
-  /* Check if fields is available */
-  if (!json_object_has_member (obj, "fields"))
-    return MELO_BROWSER_JSONRPC_LIST_FIELDS_DEFAULT;
-
-  /* Get fields array */
-  array = json_object_get_array_member (obj, "fields");
+  /* No fields array: use default fields */
   if (!array)
-    return fields;
+    return MELO_BROWSER_JSONRPC_LIST_FIELDS_DEFAULT;
 
   /* Parse array */
   count = json_array_get_length (array);
@@ -317,18 +334,98 @@ melo_browser_jsonrpc_list_to_object (const MeloBrowserList *list,
   return object;
 }
 
+static void
+melo_browser_jsonrpc_list_to_writer (const MeloBrowserList *list,
+                                     MeloBrowserJSONRPCListFields fields,
+                                     MeloTagsFields tags_fields,
+                                     MeloJSONRPCWriter *w)
+{
+  const GList *l;
+
+  /* Add list properties */
+  melo_jsonrpc_writer_begin_object (w);
+  melo_jsonrpc_writer_set_member_name (w, "path");
+  melo_jsonrpc_writer_add_string_value (w, list->path);
+  melo_jsonrpc_writer_set_member_name (w, "count");
+  melo_jsonrpc_writer_add_int_value (w, list->count);
+  melo_jsonrpc_writer_set_member_name (w, "prev_token");
+  melo_jsonrpc_writer_add_string_value (w, list->prev_token);
+  melo_jsonrpc_writer_set_member_name (w, "next_token");
+  melo_jsonrpc_writer_add_string_value (w, list->next_token);
+
+  /* Parse list and write items */
+  melo_jsonrpc_writer_set_member_name (w, "items");
+  melo_jsonrpc_writer_begin_array (w);
+  for (l = list->items; l != NULL; l = l->next) {
+    MeloBrowserItem *item = (MeloBrowserItem *) l->data;
+
+    melo_jsonrpc_writer_begin_object (w);
+    if (fields & MELO_BROWSER_JSONRPC_LIST_FIELDS_ID) {
+      melo_jsonrpc_writer_set_member_name (w, "id");
+      melo_jsonrpc_writer_add_string_value (w, item->id);
+    }
+    if (fields & MELO_BROWSER_JSONRPC_LIST_FIELDS_NAME) {
+      melo_jsonrpc_writer_set_member_name (w, "name");
+      melo_jsonrpc_writer_add_string_value (w, item->name);
+    }
+    if (fields & MELO_BROWSER_JSONRPC_LIST_FIELDS_TAGS) {
+      melo_jsonrpc_writer_set_member_name (w, "tags");
+      if (item->tags)
+        melo_tags_to_jsonrpc_writer (item->tags, w, tags_fields);
+      else
+        melo_jsonrpc_writer_add_null_value (w);
+    }
+    if (fields & MELO_BROWSER_JSONRPC_LIST_FIELDS_TYPE) {
+      melo_jsonrpc_writer_set_member_name (w, "type");
+      melo_jsonrpc_writer_add_string_value (w,
+                                 melo_browser_item_type_to_string (item->type));
+      if (item->type == MELO_BROWSER_ITEM_TYPE_CUSTOM) {
+        melo_jsonrpc_writer_set_member_name (w, "type_custom");
+        melo_jsonrpc_writer_add_string_value (w, item->type_custom);
+      }
+    }
+    if (fields & MELO_BROWSER_JSONRPC_LIST_FIELDS_ACTIONS) {
+      gint i;
+
+      /* Write action list */
+      melo_jsonrpc_writer_set_member_name (w, "actions");
+      melo_jsonrpc_writer_begin_array (w);
+      for (i = 0; i < MELO_BROWSER_ITEM_ACTION_COUNT; i++)
+        if (item->actions & (1 << i))
+          melo_jsonrpc_writer_add_string_value (w,
+                                        melo_browser_item_action_to_string (i));
+      melo_jsonrpc_writer_end_array (w);
+
+      /* Write custom action list */
+      if (item->actions_custom) {
+        const MeloBrowserItemActionCustom *a;
+
+        melo_jsonrpc_writer_set_member_name (w, "actions_custom");
+        melo_jsonrpc_writer_begin_array (w);
+        for (a = item->actions_custom; a->id; a++) {
+          melo_jsonrpc_writer_begin_object (w);
+          melo_jsonrpc_writer_set_member_name (w, "id");
+          melo_jsonrpc_writer_add_string_value (w, a->id);
+          melo_jsonrpc_writer_set_member_name (w, "name");
+          melo_jsonrpc_writer_add_string_value (w, a->name);
+          melo_jsonrpc_writer_end_object (w);
+        }
+        melo_jsonrpc_writer_end_array (w);
+      }
+    }
+    melo_jsonrpc_writer_end_object (w);
+  }
+  melo_jsonrpc_writer_end_array (w);
+  melo_jsonrpc_writer_end_object (w);
+}
+
 static void
 melo_browser_jsonrpc_get_tags_mode (JsonObject *obj, MeloBrowserTagsMode *mode,
                                     MeloTagsFields *fields)
 {
   const gchar *mod;
 
-  /* Check if tags node is available */
-  if (!json_object_has_member (obj, "tags"))
-    return;
-
-  /* Get object node */
-  obj = json_object_get_object_member (obj, "tags");
+  /* No tags object */
   if (!obj)
     return;
 
@@ -395,77 +492,74 @@ melo_browser_jsonrpc_get_info (const gchar *method,
   json_node_take_object (*result, obj);
 }
 
+/* Parameters of get_list and search, in the order of the schema: "path" is
+ * replaced by "input" for search.
+ */
+typedef struct {
+  MeloJSONRPCValue id;
+  MeloJSONRPCValue path;
+  MeloJSONRPCValue offset;
+  MeloJSONRPCValue count;
+  MeloJSONRPCValue token;
+  MeloJSONRPCValue fields;
+  MeloJSONRPCValue sort;
+  MeloJSONRPCValue tags;
+} MeloBrowserJSONRPCGetListParams;
+
 static void
 melo_browser_jsonrpc_get_list (const gchar *method,
                                JsonArray *s_params, JsonNode *params,
                                JsonNode **result, JsonNode **error,
                                gpointer user_data)
 {
+  MeloBrowserJSONRPCGetListParams p = { { 0 } };
   MeloBrowserJSONRPCListFields fields;
   MeloBrowserTagsMode tags_mode = MELO_BROWSER_TAGS_MODE_NONE;
   MeloTagsFields tags_fields = MELO_TAGS_FIELDS_NONE;
   MeloSort sort = MELO_SORT_NONE;
+  MeloJSONRPCWriter *w;
   MeloBrowserList *list;
   MeloBrowser *bro;
   JsonObject *obj;
-  const gchar *path = NULL, *input = NULL;
-  const gchar *token = NULL;
-  gint offset, count;
+  gboolean search;
 
   /* Get parameters */
-  obj = melo_jsonrpc_get_object (s_params, params, error);
-  if (!obj)
+  if (!melo_jsonrpc_get_params (s_params, params, &p, error))
     return;
+  search = !g_strcmp0 (method, "browser.search");
 
   /* Get browser from ID */
-  bro = melo_browser_jsonrpc_get_browser (obj, error);
-  if (!bro) {
-    json_object_unref (obj);
+  bro = melo_browser_jsonrpc_get_browser_by_id (p.id.s, error);
+  if (!bro)
     return;
-  }
-
-  /* Get path */
-  if (!g_strcmp0 (method, "browser.search"))
-    input = json_object_get_string_member (obj, "input");
-  else
-    path = json_object_get_string_member (obj, "path");
 
   /* Get fields */
-  fields = melo_browser_jsonrpc_get_list_fields (obj);
-
-  /* Get list position */
-  offset = json_object_get_int_member (obj, "offset");
-  count = json_object_get_int_member (obj, "count");
+  fields = melo_browser_jsonrpc_get_list_fields_from_array (p.fields.a);
 
   /* Get sort */
-  if (json_object_has_member (obj, "sort"))
-    sort = melo_sort_from_string (json_object_get_string_member (obj, "sort"));
-
-  /* Get navigation token */
-  if (json_object_has_member (obj, "token"))
-    token = json_object_get_string_member (obj, "token");
+  if (p.sort.s)
+    sort = melo_sort_from_string (p.sort.s);
 
   /* Get tags if needed */
   if (fields & MELO_BROWSER_JSONRPC_LIST_FIELDS_TAGS)
-    melo_browser_jsonrpc_get_tags_mode (obj, &tags_mode, &tags_fields);
+    melo_browser_jsonrpc_get_tags_mode (p.tags.o, &tags_mode, &tags_fields);
 
   /* Get browser list */
-  if (!g_strcmp0 (method, "browser.search")) {
+  if (search) {
     MeloBrowserSearchParams params = {
-      .offset = offset, .count = count, .sort = sort,
-      .token = token, .tags_mode = tags_mode, .tags_fields = tags_fields,
+      .offset = p.offset.i, .count = p.count.i, .sort = sort,
+      .token = p.token.s, .tags_mode = tags_mode, .tags_fields = tags_fields,
     };
 
-    list = melo_browser_search (bro, input, &params);
+    list = melo_browser_search (bro, p.path.s, &params);
   } else {
     MeloBrowserGetListParams params = {
-      .offset = offset, .count = count, .sort = sort,
-      .token = token, .tags_mode = tags_mode, .tags_fields = tags_fields,
+      .offset = p.offset.i, .count = p.count.i, .sort = sort,
+      .token = p.token.s, .tags_mode = tags_mode, .tags_fields = tags_fields,
     };
 
-    list = melo_browser_get_list (bro, path, &params);
+    list = melo_browser_get_list (bro, p.path.s, &params);
   }
-  json_object_unref (obj);
   g_object_unref (bro);
 
   /* No list provided */
@@ -475,6 +569,14 @@ melo_browser_jsonrpc_get_list (const gchar *method,
     return;
   }
 
+  /* Write response with item list directly when possible */
+  w = melo_jsonrpc_get_result_writer ();
+  if (w) {
+    melo_browser_jsonrpc_list_to_writer (list, fields, tags_fields, w);
+    melo_browser_list_free (list);
+    return;
+  }
+
   /* Create response with item list */
   obj = melo_browser_jsonrpc_list_to_object (list, fields, tags_fields);
 
@@ -527,6 +629,64 @@ melo_browser_jsonrpc_search_hint (const gchar *method,
   json_node_take_object (*result, obj);
 }
 
+static JsonNode *
+melo_browser_jsonrpc_get_tags_result (MeloBrowser *bro, const gchar *path,
+                                      MeloTagsFields fields)
+{
+  JsonNode *result;
+  JsonObject *obj;
+  MeloTags *tags;
+
+  /* Get tags from path */
+  tags = melo_browser_get_tags (bro, path, fields);
+
+  /* Parse list and create array */
+  obj = melo_tags_to_json_object (tags, fields);
+  if (tags)
+    melo_tags_unref (tags);
+
+  /* Return object */
+  result = json_node_new (JSON_NODE_OBJECT);
+  json_node_take_object (result, obj);
+  return result;
+}
+
+static void
+melo_browser_jsonrpc_get_tags_func (gpointer data, gpointer user_data)
+{
+  MeloBrowserJSONRPCGetTagsJob *job = data;
+  JsonNode *result;
+
+  /* Get tags and complete call */
+  result = melo_browser_jsonrpc_get_tags_result (job->bro, job->path,
+                                                 job->fields);
+  melo_jsonrpc_complete (job->completion, result, NULL);
+
+  /* Free job */
+  g_object_unref (job->bro);
+  g_free (job->path);
+  g_slice_free (MeloBrowserJSONRPCGetTagsJob, job);
+}
+
+static GThreadPool *
+melo_browser_jsonrpc_get_pool (void)
+{
+  GThreadPool *pool;
+
+  /* Create thread pool on first deferred call */
+  G_LOCK (melo_browser_jsonrpc_mutex);
+  if (!melo_browser_jsonrpc_pool)
+    melo_browser_jsonrpc_pool = g_thread_pool_new (
+                                              melo_browser_jsonrpc_get_tags_func,
+                                              NULL,
+                                              MELO_BROWSER_JSONRPC_THREADS,
+                                              FALSE, NULL);
+  pool = melo_browser_jsonrpc_pool;
+  G_UNLOCK (melo_browser_jsonrpc_mutex);
+
+  return pool;
+}
+
 static void
 melo_browser_jsonrpc_get_tags (const gchar *method,
                                JsonArray *s_params, JsonNode *params,
@@ -534,7 +694,9 @@ melo_browser_jsonrpc_get_tags (const gchar *method,
                                gpointer user_data)
 {
   MeloTagsFields fields = MELO_TAGS_FIELDS_FULL;
-  MeloTags *tags = NULL;
+  MeloBrowserJSONRPCGetTagsJob *job;
+  MeloJSONRPCCompletion *completion;
+  GThreadPool *pool;
   MeloBrowser *bro;
   JsonArray *array;
   JsonObject *obj;
@@ -563,19 +725,26 @@ melo_browser_jsonrpc_get_tags (const gchar *method,
       fields = melo_tags_get_fields_from_json_array (array);
   }
 
-  /* Get tags from path */
-  tags = melo_browser_get_tags (bro, path, fields);
-  json_object_unref (obj);
-  g_object_unref (bro);
+  /* Get tags synchronously when the call cannot be deferred */
+  completion = melo_jsonrpc_defer ();
+  if (!completion) {
+    *result = melo_browser_jsonrpc_get_tags_result (bro, path, fields);
+    json_object_unref (obj);
+    g_object_unref (bro);
+    return;
+  }
 
-  /* Parse list and create array */
-  obj = melo_tags_to_json_object (tags, fields);
-  if (tags)
-    melo_tags_unref (tags);
+  /* Get tags from a worker thread */
+  job = g_slice_new (MeloBrowserJSONRPCGetTagsJob);
+  job->completion = completion;
+  job->bro = bro;
+  job->path = g_strdup (path);
+  job->fields = fields;
+  json_object_unref (obj);
 
-  /* Return object */
-  *result = json_node_new (JSON_NODE_OBJECT);
-  json_node_take_object (*result, obj);
+  pool = melo_browser_jsonrpc_get_pool ();
+  if (!pool || !g_thread_pool_push (pool, job, NULL))
+    melo_browser_jsonrpc_get_tags_func (job, NULL);
 }
 
 static void
@@ -674,6 +843,7 @@ static MeloJSONRPCMethod melo_browser_jsonrpc_methods[] = {
     .result = "{\"type\":\"object\"}",
     .callback = melo_browser_jsonrpc_get_list,
     .user_data = NULL,
+    .flags = MELO_JSONRPC_FLAG_READ_ONLY | MELO_JSONRPC_FLAG_CONCURRENT,
   },
   {
     .method = "search",
@@ -699,6 +869,7 @@ static MeloJSONRPCMethod melo_browser_jsonrpc_methods[] = {
     .result = "{\"type\":\"object\"}",
     .callback = melo_browser_jsonrpc_get_list,
     .user_data = NULL,
+    .flags = MELO_JSONRPC_FLAG_READ_ONLY | MELO_JSONRPC_FLAG_CONCURRENT,
   },
   {
     .method = "search_hint",
@@ -709,6 +880,7 @@ static MeloJSONRPCMethod melo_browser_jsonrpc_methods[] = {
     .result = "{\"type\":\"object\"}",
     .callback = melo_browser_jsonrpc_search_hint,
     .user_data = NULL,
+    .flags = MELO_JSONRPC_FLAG_READ_ONLY | MELO_JSONRPC_FLAG_CONCURRENT,
   },
   {
     .method = "get_tags",
@@ -723,6 +895,7 @@ static MeloJSONRPCMethod melo_browser_jsonrpc_methods[] = {
     .result = "{\"type\":\"object\"}",
     .callback = melo_browser_jsonrpc_get_tags,
     .user_data = NULL,
+    .flags = MELO_JSONRPC_FLAG_READ_ONLY | MELO_JSONRPC_FLAG_CONCURRENT,
   },
   {
     .method = "action",
@@ -767,4 +940,12 @@ melo_browser_jsonrpc_unregister_methods (void)
 {
   melo_jsonrpc_unregister_methods ("browser", melo_browser_jsonrpc_methods,
                                    G_N_ELEMENTS (melo_browser_jsonrpc_methods));
+
+  /* All deferred calls are completed: release thread pool */
+  G_LOCK (melo_browser_jsonrpc_mutex);
+  if (melo_browser_jsonrpc_pool) {
+    g_thread_pool_free (melo_browser_jsonrpc_pool, FALSE, TRUE);
+    melo_browser_jsonrpc_pool = NULL;
+  }
+  G_UNLOCK (melo_browser_jsonrpc_mutex);
 }
@@ -44,17 +44,94 @@
  * In the callback, the event type must be used to determine which sub-type to
  * use and then which parser to use to convert the opaque data pointer to a
  * comprehensible information.
- * The callback is not threaded and long operation or blocking calls should not
- * be done in a callback implementation.
+ * With melo_event_register(), the callback is called synchronously from the
+ * thread which emitted the event: long operation or blocking calls should not
+ * be done in a callback implementation. A client which can be slow should be
+ * registered with melo_event_register_async(): the events are then copied in a
+ * bounded queue dedicated to the client and delivered from another
+ * #GMainContext, so the emitter is never blocked by the client.
  */
 
 /* Event client list */
 G_LOCK_DEFINE_STATIC (melo_event_mutex);
 static GList *melo_event_clients = NULL;
 
+/* Event dispatcher context */
+static GMainContext *melo_event_context;
+
+/* Default coalescing window (in ms) */
+#define MELO_EVENT_COALESCE_WINDOW_DEFAULT 100
+
+/* Coalesced player events */
+enum {
+  MELO_EVENT_COALESCE_BUFFERING = 0,
+  MELO_EVENT_COALESCE_SEEK,
+  MELO_EVENT_COALESCE_VOLUME,
+
+  MELO_EVENT_COALESCE_COUNT,
+};
+
+typedef struct _MeloEvent MeloEvent;
+
+typedef struct {
+  gchar *id;
+  gint64 last[MELO_EVENT_COALESCE_COUNT];
+  MeloEvent *pending[MELO_EVENT_COALESCE_COUNT];
+  GSource *timer;
+} MeloEventCoalesce;
+
+/* Coalescing of high-frequency player events (protected by melo_event_mutex) */
+static guint melo_event_coalesce_window = MELO_EVENT_COALESCE_WINDOW_DEFAULT;
+static GHashTable *melo_event_coalesces;
+
+/* Event history, disabled by default (protected by melo_event_mutex) */
+static guint64 melo_event_seq;
+static MeloEvent **melo_event_history;
+static guint melo_event_history_size;
+static guint64 melo_event_history_oldest = 1;
+
+struct _MeloEvent {
+  gint ref_count;
+  guint64 seq;
+  MeloEventType type;
+  guint event;
+  gchar *id;
+  gpointer data;
+  GDestroyNotify free_data_func;
+
+  /* Serialized event */
+  GMutex mutex;
+  MeloEventSerializeFunc serialize_func;
+  GBytes *bytes;
+};
+
+/* Event being handled by a callback in current thread */
+static GPrivate melo_event_current_key;
+
 struct _MeloEventClient {
   MeloEventCallback callback;
   gpointer user_data;
+
+  /* Subscription filters (protected by melo_event_mutex) */
+  guint32 events[MELO_EVENT_TYPE_COUNT];
+  GPatternSpec *id_pattern;
+
+  /* Asynchronous delivery (queue is NULL for synchronous clients) */
+  gint ref_count;
+  GRecMutex mutex;
+  gboolean active;
+  GMainContext *context;
+  MeloEventOverflow overflow;
+  gint scheduled;
+  guint dropped;
+
+  /* Event queue: events are pushed under melo_event_mutex and popped by the
+   * dispatcher without lock
+   */
+  MeloEvent **queue;
+  guint size;
+  guint head;
+  guint tail;
 };
 
 typedef struct {
@@ -67,6 +144,489 @@ typedef struct {
   gboolean has_next;
 } MeloEventPlayerPlaylist;
 
+typedef struct {
+  MeloPlayerInfo info;
+  gchar *name;
+  gchar *playlist_id;
+} MeloEventPlayerInfo;
+
+typedef struct {
+  guint version;
+  gchar *media_id;
+  gchar *after;
+  guint count;
+  gint index;
+  MeloPlaylistItem *item;
+  gchar **media_ids;
+} MeloEventPlaylistData;
+
+static MeloEvent *
+melo_event_ref (MeloEvent *evt)
+{
+  g_atomic_int_inc (&evt->ref_count);
+  return evt;
+}
+
+static void
+melo_event_unref (MeloEvent *evt)
+{
+  if (!g_atomic_int_dec_and_test (&evt->ref_count))
+    return;
+
+  /* Free serialized event */
+  if (evt->bytes)
+    g_bytes_unref (evt->bytes);
+  g_mutex_clear (&evt->mutex);
+
+  /* Free event data */
+  if (evt->free_data_func)
+    evt->free_data_func (evt->data);
+  g_free (evt->id);
+  g_slice_free (MeloEvent, evt);
+}
+
+static void
+melo_event_call (MeloEventClient *client, MeloEvent *evt)
+{
+  gpointer prev;
+
+  /* Set current event for melo_event_get_serialized() */
+  prev = g_private_get (&melo_event_current_key);
+  g_private_set (&melo_event_current_key, evt);
+
+  /* Call event callback */
+  client->callback (client, evt->type, evt->event, evt->id, evt->data,
+                    client->user_data);
+
+  /* Restore previous event (for event emitted from a callback) */
+  g_private_set (&melo_event_current_key, prev);
+}
+
+static gpointer
+melo_event_thread_func (gpointer user_data)
+{
+  GMainContext *context = user_data;
+  GMainLoop *loop;
+
+  /* Run event dispatcher */
+  g_main_context_push_thread_default (context);
+  loop = g_main_loop_new (context, FALSE);
+  g_main_loop_run (loop);
+  g_main_loop_unref (loop);
+  g_main_context_pop_thread_default (context);
+
+  return NULL;
+}
+
+static MeloEvent *melo_event_client_pop (MeloEventClient *client);
+
+static GMainContext *
+melo_event_get_context (void)
+{
+  static gsize init = 0;
+
+  /* Create dispatcher thread on first use */
+  if (g_once_init_enter (&init)) {
+    melo_event_context = g_main_context_new ();
+    g_thread_unref (g_thread_new ("melo_event", melo_event_thread_func,
+                                  melo_event_context));
+    g_once_init_leave (&init, 1);
+  }
+
+  return melo_event_context;
+}
+
+static MeloEventClient *
+melo_event_client_ref (MeloEventClient *client)
+{
+  g_atomic_int_inc (&client->ref_count);
+  return client;
+}
+
+static void
+melo_event_client_unref (gpointer user_data)
+{
+  MeloEventClient *client = user_data;
+  guint i;
+
+  if (!g_atomic_int_dec_and_test (&client->ref_count))
+    return;
+
+  /* Release remaining events */
+  for (i = client->tail; i != client->head; i++)
+    melo_event_unref (client->queue[i % client->size]);
+  g_free (client->queue);
+
+  /* Free client */
+  g_main_context_unref (client->context);
+  g_rec_mutex_clear (&client->mutex);
+  g_slice_free (MeloEventClient, client);
+}
+
+static MeloEvent *
+melo_event_client_pop (MeloEventClient *client)
+{
+  MeloEvent *evt;
+  guint tail;
+
+  /* The tail is also moved by the producer when the oldest event is dropped,
+   * so the event is owned only if the tail has not changed
+   */
+  do {
+    tail = g_atomic_int_get (&client->tail);
+    if (tail == (guint) g_atomic_int_get (&client->head))
+      return NULL;
+    evt = client->queue[tail % client->size];
+  } while (!g_atomic_int_compare_and_exchange (&client->tail, tail, tail + 1));
+
+  return evt;
+}
+
+static gboolean
+melo_event_client_dispatch (gpointer user_data)
+{
+  MeloEventClient *client = user_data;
+  MeloEvent *evt;
+
+  /* Events pushed from now will schedule a new dispatch */
+  g_atomic_int_set (&client->scheduled, FALSE);
+
+  /* Deliver all pending events */
+  while ((evt = melo_event_client_pop (client)) != NULL) {
+    g_rec_mutex_lock (&client->mutex);
+    if (client->active)
+      melo_event_call (client, evt);
+    g_rec_mutex_unlock (&client->mutex);
+    melo_event_unref (evt);
+  }
+
+  return G_SOURCE_REMOVE;
+}
+
+/* Must be called with melo_event_mutex locked */
+static void
+melo_event_client_push (MeloEventClient *client, MeloEvent *evt)
+{
+  guint head = client->head;
+  GSource *source;
+  MeloEvent *old;
+  guint tail;
+
+  /* Queue is full */
+  while (head - (tail = g_atomic_int_get (&client->tail)) >= client->size) {
+    /* Drop new event */
+    if (client->overflow == MELO_EVENT_OVERFLOW_DROP_NEWEST) {
+      g_atomic_int_inc (&client->dropped);
+      return;
+    }
+
+    /* Drop oldest event, unless the dispatcher has just popped it */
+    old = client->queue[tail % client->size];
+    if (g_atomic_int_compare_and_exchange (&client->tail, tail, tail + 1)) {
+      g_atomic_int_inc (&client->dropped);
+      melo_event_unref (old);
+    }
+  }
+
+  /* Push event */
+  client->queue[head % client->size] = melo_event_ref (evt);
+  g_atomic_int_set (&client->head, head + 1);
+
+  /* Schedule delivery */
+  if (g_atomic_int_compare_and_exchange (&client->scheduled, FALSE, TRUE)) {
+    source = g_idle_source_new ();
+    g_source_set_callback (source, melo_event_client_dispatch,
+                           melo_event_client_ref (client),
+                           melo_event_client_unref);
+    g_source_attach (source, client->context);
+    g_source_unref (source);
+  }
+}
+
+static void
+melo_event_client_init_filters (MeloEventClient *client, const guint32 *events,
+                                const gchar *id_pattern)
+{
+  guint i;
+
+  /* Subscribe to all events by default */
+  for (i = 0; i < MELO_EVENT_TYPE_COUNT; i++)
+    client->events[i] = events ? events[i] : MELO_EVENT_MASK_ALL;
+
+  /* Compile object ID pattern */
+  if (id_pattern)
+    client->id_pattern = g_pattern_spec_new (id_pattern);
+}
+
+/* Must be called with melo_event_mutex locked */
+static gboolean
+melo_event_client_match (MeloEventClient *client, MeloEventType type,
+                         guint event, const gchar *id)
+{
+  /* Check event type and code */
+  if (type >= MELO_EVENT_TYPE_COUNT ||
+      (event < 32 && !(client->events[type] & MELO_EVENT_MASK (event))))
+    return FALSE;
+
+  /* Check object ID */
+  if (client->id_pattern &&
+      (!id || !g_pattern_match_string (client->id_pattern, id)))
+    return FALSE;
+
+  return TRUE;
+}
+
+/* Must be called with melo_event_mutex locked */
+static gboolean
+melo_event_has_client (MeloEventType type, guint event, const gchar *id)
+{
+  GList *l;
+
+  for (l = melo_event_clients; l != NULL; l = l->next)
+    if (melo_event_client_match (l->data, type, event, id))
+      return TRUE;
+
+  return FALSE;
+}
+
+/* Check if an event would be saved or delivered, before building its data */
+static gboolean
+melo_event_is_wanted (MeloEventType type, guint event, const gchar *id)
+{
+  gboolean ret;
+
+  /* The check is done again in melo_event_new() */
+  G_LOCK (melo_event_mutex);
+  ret = melo_event_history_size || melo_event_has_client (type, event, id);
+  G_UNLOCK (melo_event_mutex);
+
+  return ret;
+}
+
+/* Must be called with melo_event_mutex locked */
+static void
+melo_event_send (MeloEvent *evt)
+{
+  GList *l;
+
+  /* Set sequence number: it is set when the event is sent, so the sequence
+   * numbers follow the delivery order, even for coalesced events
+   */
+  evt->seq = ++melo_event_seq;
+
+  /* Add event to history */
+  if (melo_event_history_size) {
+    MeloEvent **slot;
+
+    slot = &melo_event_history[evt->seq % melo_event_history_size];
+    if (*slot)
+      melo_event_unref (*slot);
+    *slot = melo_event_ref (evt);
+  }
+
+  /* Update oldest event retained in history */
+  if (evt->seq - melo_event_history_oldest >= melo_event_history_size)
+    melo_event_history_oldest = evt->seq - melo_event_history_size + 1;
+
+  /* Send event to all registered clients */
+  for (l = melo_event_clients; l != NULL; l = l->next) {
+    MeloEventClient *client = (MeloEventClient *) l->data;
+
+    /* Skip client not subscribed to this event */
+    if (!melo_event_client_match (client, evt->type, evt->event, evt->id))
+      continue;
+
+    /* Call event callback or queue event */
+    if (!client->queue)
+      melo_event_call (client, evt);
+    else
+      melo_event_client_push (client, evt);
+  }
+}
+
+static gint
+melo_event_coalesce_get_index (MeloEventType type, guint event)
+{
+  /* Only some player events are coalesced: STATE, ERROR, NEW, DELETE, ... are
+   * always forwarded
+   */
+  if (type != MELO_EVENT_TYPE_PLAYER)
+    return -1;
+
+  switch (event) {
+    case MELO_EVENT_PLAYER_BUFFERING:
+      return MELO_EVENT_COALESCE_BUFFERING;
+    case MELO_EVENT_PLAYER_SEEK:
+      return MELO_EVENT_COALESCE_SEEK;
+    case MELO_EVENT_PLAYER_VOLUME:
+      return MELO_EVENT_COALESCE_VOLUME;
+    default:
+      return -1;
+  }
+}
+
+static void
+melo_event_coalesce_free (gpointer data)
+{
+  MeloEventCoalesce *c = data;
+  guint i;
+
+  /* Stop timer */
+  if (c->timer) {
+    g_source_destroy (c->timer);
+    g_source_unref (c->timer);
+  }
+
+  /* Release pending events */
+  for (i = 0; i < MELO_EVENT_COALESCE_COUNT; i++)
+    if (c->pending[i])
+      melo_event_unref (c->pending[i]);
+
+  g_free (c->id);
+  g_slice_free (MeloEventCoalesce, c);
+}
+
+/* Must be called with melo_event_mutex locked */
+static void
+melo_event_coalesce_flush (MeloEventCoalesce *c)
+{
+  gint64 now = g_get_monotonic_time ();
+  guint i;
+
+  /* Send pending events */
+  for (i = 0; i < MELO_EVENT_COALESCE_COUNT; i++) {
+    MeloEvent *evt = c->pending[i];
+
+    if (!evt)
+      continue;
+
+    c->pending[i] = NULL;
+    c->last[i] = now;
+    melo_event_send (evt);
+    melo_event_unref (evt);
+  }
+}
+
+static gboolean
+melo_event_coalesce_timer (gpointer user_data)
+{
+  MeloEventCoalesce *c;
+
+  G_LOCK (melo_event_mutex);
+
+  /* Send pending events of the object, if still tracked */
+  c = g_hash_table_lookup (melo_event_coalesces, user_data);
+  if (c && c->timer == g_main_current_source ()) {
+    g_source_unref (c->timer);
+    c->timer = NULL;
+    melo_event_coalesce_flush (c);
+  }
+
+  G_UNLOCK (melo_event_mutex);
+
+  return G_SOURCE_REMOVE;
+}
+
+/* Must be called with melo_event_mutex locked: returns %TRUE if the event has
+ * been consumed by the coalescing
+ */
+static gboolean
+melo_event_coalesce (MeloEvent *evt)
+{
+  MeloEventCoalesce *c;
+  gint64 now;
+  gint idx;
+
+  /* Coalescing disabled */
+  if (!melo_event_coalesce_window || !evt->id)
+    return FALSE;
+
+  /* Create table */
+  if (!melo_event_coalesces)
+    melo_event_coalesces = g_hash_table_new_full (g_str_hash, g_str_equal,
+                                                  NULL,
+                                                  melo_event_coalesce_free);
+
+  /* Get object context */
+  c = g_hash_table_lookup (melo_event_coalesces, evt->id);
+  idx = melo_event_coalesce_get_index (evt->type, evt->event);
+
+  /* Not a coalesced event: send pending events before to keep order */
+  if (idx < 0) {
+    if (c) {
+      melo_event_coalesce_flush (c);
+      if (evt->type == MELO_EVENT_TYPE_PLAYER &&
+          evt->event == MELO_EVENT_PLAYER_DELETE)
+        g_hash_table_remove (melo_event_coalesces, c->id);
+    }
+    return FALSE;
+  }
+
+  /* Create object context */
+  if (!c) {
+    c = g_slice_new0 (MeloEventCoalesce);
+    c->id = g_strdup (evt->id);
+    g_hash_table_insert (melo_event_coalesces, c->id, c);
+  }
+
+  /* No event sent during last window: send it now */
+  now = g_get_monotonic_time ();
+  if (!c->pending[idx] &&
+      now - c->last[idx] >= (gint64) melo_event_coalesce_window * 1000) {
+    c->last[idx] = now;
+    return FALSE;
+  }
+
+  /* Keep only newest event */
+  if (c->pending[idx])
+    melo_event_unref (c->pending[idx]);
+  c->pending[idx] = melo_event_ref (evt);
+
+  /* Send pending events at end of window */
+  if (!c->timer) {
+    c->timer = g_timeout_source_new (melo_event_coalesce_window);
+    g_source_set_callback (c->timer, melo_event_coalesce_timer,
+                           g_strdup (c->id), g_free);
+    g_source_attach (c->timer, melo_event_get_context ());
+  }
+
+  return TRUE;
+}
+
+/**
+ * melo_event_set_coalesce_window:
+ * @window: the coalescing window (in ms), 0 to disable
+ *
+ * Set the window used to coalesce high-frequency player events
+ * (#MELO_EVENT_PLAYER_BUFFERING, #MELO_EVENT_PLAYER_SEEK and
+ * #MELO_EVENT_PLAYER_VOLUME): for each player and event type, at most one
+ * event is forwarded per @window and the newest value is sent at the end of
+ * the window. Other events are never coalesced, and pending events of a player
+ * are always sent before its next non-coalesced event.
+ * Note: the events sent at the end of a window are forwarded from the Melo
+ * event dispatcher thread.
+ *
+ * The default window is 100 ms.
+ */
+void
+melo_event_set_coalesce_window (guint window)
+{
+  G_LOCK (melo_event_mutex);
+  melo_event_coalesce_window = window;
+
+  /* Send all pending events */
+  if (!window && melo_event_coalesces) {
+    GHashTableIter iter;
+    gpointer c;
+
+    g_hash_table_iter_init (&iter, melo_event_coalesces);
+    while (g_hash_table_iter_next (&iter, NULL, &c))
+      melo_event_coalesce_flush (c);
+    g_hash_table_remove_all (melo_event_coalesces);
+  }
+  G_UNLOCK (melo_event_mutex);
+}
+
 /**
  * melo_event_register:
  * @callback: a function to call for new events
@@ -90,6 +650,71 @@ melo_event_register (MeloEventCallback callback, gpointer user_data)
   /* Fill client context */
   client->callback = callback;
   client->user_data = user_data;
+  melo_event_client_init_filters (client, NULL, NULL);
+
+  /* Add client to list */
+  G_LOCK (melo_event_mutex);
+  melo_event_clients = g_list_prepend (melo_event_clients, client);
+  G_UNLOCK (melo_event_mutex);
+
+  return client;
+}
+
+/**
+ * melo_event_register_async:
+ * @callback: a function to call for new events
+ * @user_data: a pointer to associate with @callback
+ * @context: (nullable): the #GMainContext in which @callback is called, or
+ *    %NULL to use the Melo event dispatcher thread
+ * @queue_size: the maximum number of pending events for the client
+ * @overflow: the #MeloEventOverflow policy to apply when queue is full
+ * @events: (nullable): an array of %MELO_EVENT_TYPE_COUNT masks, one for each
+ *    #MeloEventType (see melo_event_client_set_filter()), or %NULL to receive
+ *    all events
+ * @id_pattern: (nullable): a glob-style pattern to match against the object ID
+ *    (see melo_event_client_set_id_filter()), or %NULL
+ *
+ * Create and register a new event client to receive and parse events coming
+ * from Melo objects. Unlike melo_event_register(), the events are queued and
+ * @callback is called later from @context, so the thread which emits an event
+ * is never blocked by a slow client. When more than @queue_size events are
+ * pending, @overflow is applied.
+ *
+ * The subscription filters @events and @id_pattern are set before the client
+ * is added to the client list, so it never receives an event it has not
+ * subscribed to.
+ *
+ * Returns: (transfer full): a new #MeloEventClient instance or %NULL if failed.
+ */
+MeloEventClient *
+melo_event_register_async (MeloEventCallback callback, gpointer user_data,
+                           GMainContext *context, guint queue_size,
+                           MeloEventOverflow overflow, const guint32 *events,
+                           const gchar *id_pattern)
+{
+  MeloEventClient *client;
+
+  /* Queue size is required */
+  if (!queue_size)
+    return NULL;
+
+  /* Create new client context */
+  client = g_slice_new0 (MeloEventClient);
+  if (!client)
+    return NULL;
+
+  /* Fill client context */
+  client->callback = callback;
+  client->user_data = user_data;
+  melo_event_client_init_filters (client, events, id_pattern);
+  client->ref_count = 1;
+  g_rec_mutex_init (&client->mutex);
+  client->active = TRUE;
+  client->context = g_main_context_ref (context ? context :
+                                        melo_event_get_context ());
+  client->overflow = overflow;
+  client->queue = g_new (MeloEvent *, queue_size);
+  client->size = queue_size;
 
   /* Add client to list */
   G_LOCK (melo_event_mutex);
@@ -103,7 +728,9 @@ melo_event_register (MeloEventCallback callback, gpointer user_data)
  * melo_event_unregister:
  * @client: an event client
  *
- * Unregister and destroy an event client.
+ * Unregister and destroy an event client. For an asynchronous client, the
+ * callback is never called after this function returns, and the pending
+ * events are dropped.
  */
 void
 melo_event_unregister (MeloEventClient *client)
@@ -113,8 +740,227 @@ melo_event_unregister (MeloEventClient *client)
   melo_event_clients = g_list_remove (melo_event_clients, client);
   G_UNLOCK (melo_event_mutex);
 
-  /* Free client */
-  g_slice_free (MeloEventClient, client);
+  /* Free filters */
+  if (client->id_pattern)
+    g_pattern_spec_free (client->id_pattern);
+
+  /* Free synchronous client */
+  if (!client->queue) {
+    g_slice_free (MeloEventClient, client);
+    return;
+  }
+
+  /* Wait end of current delivery and disable client */
+  g_rec_mutex_lock (&client->mutex);
+  client->active = FALSE;
+  g_rec_mutex_unlock (&client->mutex);
+
+  /* Release client: a pending dispatch holds its own reference */
+  melo_event_client_unref (client);
+}
+
+/**
+ * melo_event_client_set_filter:
+ * @client: an event client
+ * @type: the event type to filter
+ * @events: a mask of the event codes to receive for @type, built with
+ *    MELO_EVENT_MASK(), %MELO_EVENT_MASK_ALL or %MELO_EVENT_MASK_NONE
+ *
+ * Select the events of type @type to forward to @client. By default, a client
+ * receives all events of all types. The filters are checked when an event is
+ * emitted, before any copy or serialization of the event.
+ */
+void
+melo_event_client_set_filter (MeloEventClient *client, MeloEventType type,
+                              guint32 events)
+{
+  if (type >= MELO_EVENT_TYPE_COUNT)
+    return;
+
+  G_LOCK (melo_event_mutex);
+  client->events[type] = events;
+  G_UNLOCK (melo_event_mutex);
+}
+
+/**
+ * melo_event_client_set_id_filter:
+ * @client: an event client
+ * @pattern: (nullable): a glob-style pattern (see #GPatternSpec) to match
+ *    against the object ID, or %NULL to receive events of all objects
+ *
+ * Forward to @client only the events emitted by objects with an ID matching
+ * @pattern. Events with no object ID are not forwarded when a pattern is set.
+ */
+void
+melo_event_client_set_id_filter (MeloEventClient *client,
+                                 const gchar *pattern)
+{
+  GPatternSpec *old, *spec = NULL;
+
+  /* Compile pattern */
+  if (pattern)
+    spec = g_pattern_spec_new (pattern);
+
+  /* Replace pattern */
+  G_LOCK (melo_event_mutex);
+  old = client->id_pattern;
+  client->id_pattern = spec;
+  G_UNLOCK (melo_event_mutex);
+
+  if (old)
+    g_pattern_spec_free (old);
+}
+
+/**
+ * melo_event_client_get_dropped:
+ * @client: an event client
+ *
+ * Get the number of events dropped for an asynchronous client because its
+ * queue was full.
+ *
+ * Returns: the number of dropped events.
+ */
+guint
+melo_event_client_get_dropped (MeloEventClient *client)
+{
+  return g_atomic_int_get (&client->dropped);
+}
+
+/**
+ * melo_event_client_replay:
+ * @client: an event client
+ * @since: the sequence number of the last event received by the client
+ *
+ * Forward to @client the events emitted after the event with sequence number
+ * @since, which are still in the event history. It can be used by a client
+ * which reconnects to get only the events it has missed. The subscription
+ * filters of @client are applied on the events.
+ *
+ * For an asynchronous client, this function must be called from its
+ * #GMainContext, before any event has been delivered: the pending events of
+ * @client are dropped and replaced by the events of the history, in order.
+ *
+ * Returns: %TRUE if all events after @since were available, %FALSE if some
+ * events are missing from the history: the client should then fetch the full
+ * state again.
+ */
+gboolean
+melo_event_client_replay (MeloEventClient *client, guint64 since)
+{
+  MeloEvent *evt;
+  guint64 seq;
+
+  G_LOCK (melo_event_mutex);
+
+  /* Some events are missing */
+  if (since > melo_event_seq || since + 1 < melo_event_history_oldest)
+    goto missing;
+
+  /* Check all missed events are still in history */
+  for (seq = since + 1; seq <= melo_event_seq; seq++) {
+    evt = melo_event_history[seq % melo_event_history_size];
+    if (!evt || evt->seq != seq)
+      goto missing;
+  }
+
+  /* Drop pending events: they are also in the history */
+  if (client->queue)
+    while ((evt = melo_event_client_pop (client)) != NULL)
+      melo_event_unref (evt);
+
+  /* Forward missed events */
+  for (seq = since + 1; seq <= melo_event_seq; seq++) {
+    evt = melo_event_history[seq % melo_event_history_size];
+
+    /* Skip event not subscribed */
+    if (!melo_event_client_match (client, evt->type, evt->event, evt->id))
+      continue;
+
+    /* Call event callback or queue event */
+    if (!client->queue)
+      melo_event_call (client, evt);
+    else
+      melo_event_client_push (client, evt);
+  }
+
+  G_UNLOCK (melo_event_mutex);
+
+  return TRUE;
+
+missing:
+  G_UNLOCK (melo_event_mutex);
+  return FALSE;
+}
+
+/**
+ * melo_event_get_last_seq:
+ *
+ * Get the sequence number of the last event sent.
+ *
+ * Returns: the sequence number of the last event, or 0 if no event has been
+ * sent yet.
+ */
+guint64
+melo_event_get_last_seq (void)
+{
+  guint64 seq;
+
+  G_LOCK (melo_event_mutex);
+  seq = melo_event_seq;
+  G_UNLOCK (melo_event_mutex);
+
+  return seq;
+}
+
+/**
+ * melo_event_set_history_size:
+ * @size: the number of events to keep in history, 0 to disable history
+ *
+ * Set the number of last events kept for melo_event_client_replay(). Each
+ * event in history holds a reference on its data.
+ *
+ * While history is enabled, every event is built and saved, even when no
+ * client has subscribed to it, so it can be replayed later. When history is
+ * disabled, the event helpers check the subscriptions first and skip the
+ * creation of the event data when no client wants it.
+ *
+ * The history is disabled by default, so that the event data is only built
+ * for subscribed events: it should be enabled by the event consumers which
+ * support replay.
+ */
+void
+melo_event_set_history_size (guint size)
+{
+  MeloEvent **history;
+  guint64 count, seq;
+  guint i;
+
+  G_LOCK (melo_event_mutex);
+
+  /* Move last events to new history */
+  history = size ? g_new0 (MeloEvent *, size) : NULL;
+  count = MIN (MIN (size, melo_event_history_size), melo_event_seq);
+  for (seq = melo_event_seq; seq > melo_event_seq - count; seq--) {
+    MeloEvent **slot = &melo_event_history[seq % melo_event_history_size];
+
+    history[seq % size] = *slot;
+    *slot = NULL;
+  }
+
+  /* Release old history */
+  if (melo_event_history) {
+    for (i = 0; i < melo_event_history_size; i++)
+      if (melo_event_history[i])
+        melo_event_unref (melo_event_history[i]);
+    g_free (melo_event_history);
+  }
+
+  /* Set new history: only the moved events are available */
+  melo_event_history = history;
+  melo_event_history_size = size;
+  melo_event_history_oldest = melo_event_seq - count + 1;
+
+  G_UNLOCK (melo_event_mutex);
 }
 
 static const gchar *melo_event_type_string[] = {
@@ -153,35 +999,135 @@ melo_event_type_to_string (MeloEventType type)
  * should be used only for custom or global events with
  * #MELO_EVENT_TYPE_GENERAL. For other event types, please consider using
  * function already defined.
+ *
+ * Since the event can be delivered asynchronously, @data is owned by the event
+ * and released with @free_data_func when the last client has handled it. If
+ * @free_data_func is %NULL, @data must be a plain value or a static pointer.
  */
 void
 melo_event_new (MeloEventType type, guint event, const gchar *id, gpointer data,
                 GDestroyNotify free_data_func)
 {
-  GList *l;
+  MeloEvent *evt;
 
   /* Lock client list */
   G_LOCK (melo_event_mutex);
 
-  /* Send event to all registered clients */
-  for (l = melo_event_clients; l != NULL; l = l->next) {
-    MeloEventClient *client = (MeloEventClient *) l->data;
-
-    /* Call event callback */
-    client->callback(client, type, event, id, data, client->user_data);
+  /* No clients subscribed to this event and no history: skip all payload
+   * work
+   */
+  if (!melo_event_history_size && !melo_event_has_client (type, event, id)) {
+    G_UNLOCK (melo_event_mutex);
+    if (free_data_func)
+      free_data_func (data);
+    return;
   }
 
+  /* Create event, shared by all clients */
+  evt = g_slice_new0 (MeloEvent);
+  evt->ref_count = 1;
+  evt->type = type;
+  evt->event = event;
+  evt->id = g_strdup (id);
+  evt->data = data;
+  evt->free_data_func = free_data_func;
+  g_mutex_init (&evt->mutex);
+
+  /* Send event to all registered clients, unless it is coalesced */
+  if (!melo_event_coalesce (evt))
+    melo_event_send (evt);
+
   /* Unlock client list */
   G_UNLOCK (melo_event_mutex);
 
-  /* Free event data */
-  if (free_data_func)
-    free_data_func (data);
+  /* Release event */
+  melo_event_unref (evt);
+}
+
+/**
+ * melo_event_get_seq:
+ *
+ * Get the sequence number of the event currently handled. This function must
+ * be called from a #MeloEventCallback.
+ *
+ * Returns: the sequence number of the current event, or 0 if not called from
+ * a #MeloEventCallback.
+ */
+guint64
+melo_event_get_seq (void)
+{
+  MeloEvent *evt = g_private_get (&melo_event_current_key);
+
+  return evt ? evt->seq : 0;
+}
+
+/**
+ * melo_event_get_serialized:
+ * @func: the function to use to serialize the event
+ *
+ * Get the serialized form of the event currently handled, generated with
+ * @func. This function must be called from a #MeloEventCallback. The event
+ * is serialized at most once with a given @func, whatever the number of
+ * clients which receive the event, so a client which forwards events should
+ * use this function instead of serializing each event itself.
+ *
+ * Returns: (transfer full): a #GBytes containing the serialized event, or
+ * %NULL if failed. Use g_bytes_unref() after usage.
+ */
+GBytes *
+melo_event_get_serialized (MeloEventSerializeFunc func)
+{
+  MeloEvent *evt;
+  GBytes *bytes;
+
+  /* Get current event */
+  evt = g_private_get (&melo_event_current_key);
+  if (!evt)
+    return NULL;
+
+  /* Serialize event only once */
+  g_mutex_lock (&evt->mutex);
+  if (!evt->bytes) {
+    evt->bytes = func (evt->type, evt->event, evt->id, evt->data);
+    evt->serialize_func = func;
+  } else if (evt->serialize_func != func) {
+    /* Another serializer is already cached */
+    g_mutex_unlock (&evt->mutex);
+    return func (evt->type, evt->event, evt->id, evt->data);
+  }
+  bytes = evt->bytes ? g_bytes_ref (evt->bytes) : NULL;
+  g_mutex_unlock (&evt->mutex);
+
+  return bytes;
+}
+
+static void
+melo_event_player_buffering_free (gpointer data)
+{
+  g_slice_free (MeloEventPlayerBuffering, data);
+}
+
+static void
+melo_event_player_playlist_free (gpointer data)
+{
+  g_slice_free (MeloEventPlayerPlaylist, data);
+}
+
+static void
+melo_event_player_info_free (gpointer data)
+{
+  MeloEventPlayerInfo *evt = data;
+
+  g_free (evt->name);
+  g_free (evt->playlist_id);
+  g_slice_free (MeloEventPlayerInfo, evt);
 }
 
 #define melo_event_player(event, id, data, free) \
   melo_event_new (MELO_EVENT_TYPE_PLAYER, MELO_EVENT_PLAYER_##event, id, data, \
                   free)
+#define melo_event_player_is_wanted(event, id) \
+  melo_event_is_wanted (MELO_EVENT_TYPE_PLAYER, MELO_EVENT_PLAYER_##event, id)
 
 /**
  * melo_event_player_new:
@@ -193,7 +1139,19 @@ melo_event_new (MeloEventType type, guint event, const gchar *id, gpointer data,
 void
 melo_event_player_new (const gchar *id, const MeloPlayerInfo *info)
 {
-  melo_event_player (NEW, id, (gpointer) info, NULL);
+  MeloEventPlayerInfo *evt;
+
+  /* No client for this event */
+  if (!melo_event_player_is_wanted (NEW, id))
+    return;
+
+  /* Copy player info */
+  evt = g_slice_new (MeloEventPlayerInfo);
+  evt->info = *info;
+  evt->info.name = evt->name = g_strdup (info->name);
+  evt->info.playlist_id = evt->playlist_id = g_strdup (info->playlist_id);
+
+  melo_event_player (NEW, id, evt, melo_event_player_info_free);
 }
 
 /**
@@ -218,6 +1176,12 @@ melo_event_player_delete (const gchar *id)
 void
 melo_event_player_status (const gchar *id, MeloPlayerStatus *status)
 {
+  /* No client for this event */
+  if (!melo_event_player_is_wanted (STATUS, id)) {
+    melo_player_status_unref (status);
+    return;
+  }
+
   melo_event_player (STATUS, id, status,
                      (GDestroyNotify) melo_player_status_unref);
 }
@@ -232,7 +1196,7 @@ melo_event_player_status (const gchar *id, MeloPlayerStatus *status)
 void
 melo_event_player_state (const gchar *id, MeloPlayerState state)
 {
-  melo_event_player (STATE, id, &state, NULL);
+  melo_event_player (STATE, id, GINT_TO_POINTER (state), NULL);
 }
 
 /**
@@ -247,8 +1211,16 @@ void
 melo_event_player_buffering (const gchar *id, MeloPlayerState state,
                              guint percent)
 {
-  MeloEventPlayerBuffering evt = { .state = state, .percent = percent };
-  melo_event_player (BUFFERING, id, &evt, NULL);
+  MeloEventPlayerBuffering *evt;
+
+  /* No client for this event */
+  if (!melo_event_player_is_wanted (BUFFERING, id))
+    return;
+
+  evt = g_slice_new (MeloEventPlayerBuffering);
+  evt->state = state;
+  evt->percent = percent;
+  melo_event_player (BUFFERING, id, evt, melo_event_player_buffering_free);
 }
 
 /**
@@ -289,8 +1261,16 @@ void
 melo_event_player_playlist (const gchar *id, gboolean has_prev,
                             gboolean has_next)
 {
-  MeloEventPlayerPlaylist evt = { .has_prev = has_prev, .has_next = has_next };
-  melo_event_player (PLAYLIST, id, &evt, NULL);
+  MeloEventPlayerPlaylist *evt;
+
+  /* No client for this event */
+  if (!melo_event_player_is_wanted (PLAYLIST, id))
+    return;
+
+  evt = g_slice_new (MeloEventPlayerPlaylist);
+  evt->has_prev = has_prev;
+  evt->has_next = has_next;
+  melo_event_player (PLAYLIST, id, evt, melo_event_player_playlist_free);
 }
 
 /**
@@ -303,7 +1283,15 @@ melo_event_player_playlist (const gchar *id, gboolean has_prev,
 void
 melo_event_player_volume (const gchar *id, gdouble volume)
 {
-  melo_event_player (VOLUME, id, &volume, NULL);
+  gdouble *value;
+
+  /* No client for this event */
+  if (!melo_event_player_is_wanted (VOLUME, id))
+    return;
+
+  value = g_new (gdouble, 1);
+  *value = volume;
+  melo_event_player (VOLUME, id, value, g_free);
 }
 
 /**
@@ -316,7 +1304,7 @@ melo_event_player_volume (const gchar *id, gdouble volume)
 void
 melo_event_player_mute (const gchar *id, gboolean mute)
 {
-  melo_event_player (MUTE, id, &mute, NULL);
+  melo_event_player (MUTE, id, GINT_TO_POINTER (mute), NULL);
 }
 
 /**
@@ -329,7 +1317,11 @@ melo_event_player_mute (const gchar *id, gboolean mute)
 void
 melo_event_player_name (const gchar *id, const gchar *name)
 {
-  melo_event_player (NAME, id, (gpointer) name, NULL);
+  /* No client for this event */
+  if (!melo_event_player_is_wanted (NAME, id))
+    return;
+
+  melo_event_player (NAME, id, g_strdup (name), g_free);
 }
 
 /**
@@ -342,7 +1334,11 @@ melo_event_player_name (const gchar *id, const gchar *name)
 void
 melo_event_player_error (const gchar *id, const gchar *error)
 {
-  melo_event_player (ERROR, id, (gpointer) error, NULL);
+  /* No client for this event */
+  if (!melo_event_player_is_wanted (ERROR, id))
+    return;
+
+  melo_event_player (ERROR, id, g_strdup (error), g_free);
 }
 
 /**
@@ -355,7 +1351,8 @@ melo_event_player_error (const gchar *id, const gchar *error)
 void
 melo_event_player_tags (const gchar *id, MeloTags *tags)
 {
-  melo_event_player (TAGS, id, tags, NULL);
+  melo_event_player (TAGS, id, tags ? melo_tags_ref (tags) : NULL,
+                     tags ? (GDestroyNotify) melo_tags_unref : NULL);
 }
 
 /**
@@ -370,7 +1367,7 @@ melo_event_player_tags (const gchar *id, MeloTags *tags)
 const MeloPlayerInfo *
 melo_event_player_new_parse (gpointer data)
 {
-  return (const MeloPlayerInfo *) data;
+  return &((MeloEventPlayerInfo *) data)->info;
 }
 
 /**
@@ -398,7 +1395,7 @@ melo_event_player_status_parse (gpointer data)
 MeloPlayerState
 melo_event_player_state_parse (gpointer data)
 {
-  return *((MeloPlayerState *) data);
+  return GPOINTER_TO_INT (data);
 }
 
 /**
@@ -495,7 +1492,7 @@ melo_event_player_volume_parse (gpointer data)
 gboolean
 melo_event_player_mute_parse (gpointer data)
 {
-  return *((gboolean *) data);
+  return GPOINTER_TO_INT (data);
 }
 
 /**
@@ -571,3 +1568,304 @@ melo_event_player_to_string (MeloEventPlayer event)
     return melo_event_player_string[event];
   return NULL;
 }
+
+static MeloEventPlaylistData *
+melo_event_playlist_data_new (guint version, const gchar *media_id,
+                              const gchar *after)
+{
+  MeloEventPlaylistData *evt = g_slice_new0 (MeloEventPlaylistData);
+
+  evt->version = version;
+  evt->media_id = g_strdup (media_id);
+  evt->after = g_strdup (after);
+
+  return evt;
+}
+
+static void
+melo_event_playlist_data_free (gpointer data)
+{
+  MeloEventPlaylistData *evt = data;
+
+  if (evt->item)
+    melo_playlist_item_unref (evt->item);
+  g_strfreev (evt->media_ids);
+  g_free (evt->media_id);
+  g_free (evt->after);
+  g_slice_free (MeloEventPlaylistData, evt);
+}
+
+#define melo_event_playlist(event, id, data) \
+  melo_event_new (MELO_EVENT_TYPE_PLAYLIST, MELO_EVENT_PLAYLIST_##event, id, \
+                  data, melo_event_playlist_data_free)
+#define melo_event_playlist_is_wanted(event, id) \
+  melo_event_is_wanted (MELO_EVENT_TYPE_PLAYLIST, MELO_EVENT_PLAYLIST_##event, \
+                        id)
+
+/**
+ * melo_event_playlist_add:
+ * @id: the #MeloPlaylist ID
+ * @version: the new version of the playlist
+ * @index: the position of the new media in the playlist
+ * @item: the #MeloPlaylistItem of the new media
+ *
+ * A new media has been inserted at position @index in the playlist.
+ */
+void
+melo_event_playlist_add (const gchar *id, guint version, gint index,
+                         MeloPlaylistItem *item)
+{
+  MeloEventPlaylistData *evt;
+
+  /* No client for this event */
+  if (!melo_event_playlist_is_wanted (ADD, id))
+    return;
+
+  evt = melo_event_playlist_data_new (version, NULL, NULL);
+  evt->index = index;
+  evt->item = melo_playlist_item_ref (item);
+  melo_event_playlist (ADD, id, evt);
+}
+
+/**
+ * melo_event_playlist_remove:
+ * @id: the #MeloPlaylist ID
+ * @version: the new version of the playlist
+ * @media_id: the ID of the removed media
+ *
+ * A media has been removed from the playlist.
+ */
+void
+melo_event_playlist_remove (const gchar *id, guint version,
+                            const gchar *media_id)
+{
+  /* No client for this event */
+  if (!melo_event_playlist_is_wanted (REMOVE, id))
+    return;
+
+  melo_event_playlist (REMOVE, id,
+                       melo_event_playlist_data_new (version, media_id, NULL));
+}
+
+/**
+ * melo_event_playlist_move:
+ * @id: the #MeloPlaylist ID
+ * @version: the new version of the playlist
+ * @media_id: the ID of the first moved media
+ * @count: the number of moved medias
+ * @after: the ID of the media after which the medias have been moved, or
+ *    %NULL if they have been moved to the head of the playlist
+ *
+ * A range of @count medias starting from @media_id has been moved after
+ * @after in the playlist.
+ */
+void
+melo_event_playlist_move (const gchar *id, guint version,
+                          const gchar *media_id, guint count,
+                          const gchar *after)
+{
+  MeloEventPlaylistData *evt;
+
+  /* No client for this event */
+  if (!melo_event_playlist_is_wanted (MOVE, id))
+    return;
+
+  evt = melo_event_playlist_data_new (version, media_id, after);
+  evt->count = count;
+  melo_event_playlist (MOVE, id, evt);
+}
+
+/**
+ * melo_event_playlist_current:
+ * @id: the #MeloPlaylist ID
+ * @version: the new version of the playlist
+ * @media_id: the ID of the new current media, or %NULL
+ *
+ * The current media of the playlist has changed.
+ */
+void
+melo_event_playlist_current (const gchar *id, guint version,
+                             const gchar *media_id)
+{
+  /* No client for this event */
+  if (!melo_event_playlist_is_wanted (CURRENT, id))
+    return;
+
+  melo_event_playlist (CURRENT, id,
+                       melo_event_playlist_data_new (version, media_id, NULL));
+}
+
+/**
+ * melo_event_playlist_sort:
+ * @id: the #MeloPlaylist ID
+ * @version: the new version of the playlist
+ * @after: the ID of the media before the sorted range, or %NULL if the range
+ *    starts at head of the playlist
+ * @media_ids: (transfer full): a %NULL-terminated array with the IDs of the
+ *    sorted medias, in their new order
+ *
+ * A range of medias has been sorted or shuffled in the playlist. Only the IDs
+ * of the medias are sent, since the items themselves have not changed.
+ */
+void
+melo_event_playlist_sort (const gchar *id, guint version, const gchar *after,
+                          gchar **media_ids)
+{
+  MeloEventPlaylistData *evt;
+
+  /* No client for this event */
+  if (!melo_event_playlist_is_wanted (SORT, id)) {
+    g_strfreev (media_ids);
+    return;
+  }
+
+  evt = melo_event_playlist_data_new (version, NULL, after);
+  evt->media_ids = media_ids;
+  melo_event_playlist (SORT, id, evt);
+}
+
+/**
+ * melo_event_playlist_empty:
+ * @id: the #MeloPlaylist ID
+ * @version: the new version of the playlist
+ *
+ * All medias have been removed from the playlist.
+ */
+void
+melo_event_playlist_empty (const gchar *id, guint version)
+{
+  /* No client for this event */
+  if (!melo_event_playlist_is_wanted (EMPTY, id))
+    return;
+
+  melo_event_playlist (EMPTY, id,
+                       melo_event_playlist_data_new (version, NULL, NULL));
+}
+
+/**
+ * melo_event_playlist_get_version:
+ * @data: the event data to parse
+ *
+ * Get the playlist version from the data of any #MeloEventPlaylist event.
+ *
+ * Returns: the version of the playlist after the change.
+ */
+guint
+melo_event_playlist_get_version (gpointer data)
+{
+  return ((MeloEventPlaylistData *) data)->version;
+}
+
+/**
+ * melo_event_playlist_add_parse:
+ * @data: the event data to parse
+ * @index: a pointer to hold the position of the new media, or %NULL
+ *
+ * Parse the event data for a #MELO_EVENT_PLAYLIST_ADD.
+ *
+ * Returns: (transfer none): the #MeloPlaylistItem of the new media.
+ */
+MeloPlaylistItem *
+melo_event_playlist_add_parse (gpointer data, gint *index)
+{
+  MeloEventPlaylistData *evt = (MeloEventPlaylistData *) data;
+  if (index)
+    *index = evt->index;
+  return evt->item;
+}
+
+/**
+ * melo_event_playlist_remove_parse:
+ * @data: the event data to parse
+ *
+ * Parse the event data for a #MELO_EVENT_PLAYLIST_REMOVE.
+ *
+ * Returns: the ID of the removed media.
+ */
+const gchar *
+melo_event_playlist_remove_parse (gpointer data)
+{
+  return ((MeloEventPlaylistData *) data)->media_id;
+}
+
+/**
+ * melo_event_playlist_move_parse:
+ * @data: the event data to parse
+ * @count: a pointer to hold the number of moved medias, or %NULL
+ * @after: a pointer to hold the ID of the media after which the medias have
+ *    been moved, or %NULL
+ *
+ * Parse the event data for a #MELO_EVENT_PLAYLIST_MOVE.
+ *
+ * Returns: the ID of the first moved media.
+ */
+const gchar *
+melo_event_playlist_move_parse (gpointer data, guint *count,
+                                const gchar **after)
+{
+  MeloEventPlaylistData *evt = (MeloEventPlaylistData *) data;
+  if (count)
+    *count = evt->count;
+  if (after)
+    *after = evt->after;
+  return evt->media_id;
+}
+
+/**
+ * melo_event_playlist_current_parse:
+ * @data: the event data to parse
+ *
+ * Parse the event data for a #MELO_EVENT_PLAYLIST_CURRENT.
+ *
+ * Returns: the ID of the new current media, or %NULL.
+ */
+const gchar *
+melo_event_playlist_current_parse (gpointer data)
+{
+  return ((MeloEventPlaylistData *) data)->media_id;
+}
+
+/**
+ * melo_event_playlist_sort_parse:
+ * @data: the event data to parse
+ * @after: a pointer to hold the ID of the media before the sorted range, or
+ *    %NULL
+ *
+ * Parse the event data for a #MELO_EVENT_PLAYLIST_SORT.
+ *
+ * Returns: (transfer none): a %NULL-terminated array with the IDs of the
+ * sorted medias, in their new order.
+ */
+const gchar * const *
+melo_event_playlist_sort_parse (gpointer data, const gchar **after)
+{
+  MeloEventPlaylistData *evt = (MeloEventPlaylistData *) data;
+  if (after)
+    *after = evt->after;
+  return (const gchar * const *) evt->media_ids;
+}
+
+static const gchar *melo_event_playlist_string[] = {
+  [MELO_EVENT_PLAYLIST_ADD] = "add",
+  [MELO_EVENT_PLAYLIST_REMOVE] = "remove",
+  [MELO_EVENT_PLAYLIST_MOVE] = "move",
+  [MELO_EVENT_PLAYLIST_CURRENT] = "current",
+  [MELO_EVENT_PLAYLIST_SORT] = "sort",
+  [MELO_EVENT_PLAYLIST_EMPTY] = "empty",
+};
+
+/**
+ * melo_event_playlist_to_string:
+ * @event: a playlist sub-type event
+ *
+ * Convert a #MeloEventPlaylist to a string.
+ *
+ * Returns: a string with the translated #MeloEventPlaylist, %NULL otherwise.
+ */
+const gchar *
+melo_event_playlist_to_string (MeloEventPlaylist event)
+{
+  if (event < MELO_EVENT_PLAYLIST_COUNT)
+    return melo_event_playlist_string[event];
+  return NULL;
+}
@@ -30,7 +30,9 @@
 typedef enum _MeloEventType MeloEventType;
 typedef struct _MeloEventClient MeloEventClient;
 
+typedef enum _MeloEventOverflow MeloEventOverflow;
 typedef enum _MeloEventPlayer MeloEventPlayer;
+typedef enum _MeloEventPlaylist MeloEventPlaylist;
 
 /**
  * MeloEventType:
@@ -54,6 +56,44 @@ enum _MeloEventType {
   MELO_EVENT_TYPE_COUNT
 };
 
+/**
+ * MELO_EVENT_MASK:
+ * @event: an event sub-type (as #MeloEventPlayer)
+ *
+ * Get the mask of an event sub-type, to use with
+ * melo_event_client_set_filter().
+ */
+#define MELO_EVENT_MASK(event) (1U << (event))
+
+/**
+ * MELO_EVENT_MASK_ALL:
+ *
+ * Mask of all event sub-types, to use with melo_event_client_set_filter().
+ */
+#define MELO_EVENT_MASK_ALL G_MAXUINT32
+
+/**
+ * MELO_EVENT_MASK_NONE:
+ *
+ * Mask of no event sub-types, to use with melo_event_client_set_filter().
+ */
+#define MELO_EVENT_MASK_NONE 0
+
+/**
+ * MeloEventOverflow:
+ * @MELO_EVENT_OVERFLOW_DROP_NEWEST: the new event is dropped when the queue of
+ *    the client is full
+ * @MELO_EVENT_OVERFLOW_DROP_OLDEST: the oldest pending event is dropped to
+ *    make room for the new event
+ *
+ * The #MeloEventOverflow sets the policy applied when the queue of a client
+ * registered with melo_event_register_async() is full.
+ */
+enum _MeloEventOverflow {
+  MELO_EVENT_OVERFLOW_DROP_NEWEST = 0,
+  MELO_EVENT_OVERFLOW_DROP_OLDEST,
+};
+
 /**
  * MeloEventPlayer:
  * @MELO_EVENT_PLAYER_NEW: a new player has been created
@@ -92,6 +132,33 @@ enum _MeloEventPlayer {
   MELO_EVENT_PLAYER_COUNT,
 };
 
+/**
+ * MeloEventPlaylist:
+ * @MELO_EVENT_PLAYLIST_ADD: a media has been inserted in the playlist
+ * @MELO_EVENT_PLAYLIST_REMOVE: a media has been removed from the playlist
+ * @MELO_EVENT_PLAYLIST_MOVE: a range of medias has been moved in the playlist
+ * @MELO_EVENT_PLAYLIST_CURRENT: the current media of the playlist has changed
+ * @MELO_EVENT_PLAYLIST_SORT: a range of medias has been sorted or shuffled
+ * @MELO_EVENT_PLAYLIST_EMPTY: the playlist has been emptied
+ *
+ * The #MeloEventPlaylist describes the sub-type for an event coming from a
+ * #MeloPlaylist instance. Each event describes only the change done on the
+ * playlist and carries the new version of the playlist: if a client receives
+ * a version which doesn't follow the last one it knows, some changes have been
+ * missed and the full list should be fetched again.
+ */
+enum _MeloEventPlaylist {
+  MELO_EVENT_PLAYLIST_ADD = 0,
+  MELO_EVENT_PLAYLIST_REMOVE,
+  MELO_EVENT_PLAYLIST_MOVE,
+  MELO_EVENT_PLAYLIST_CURRENT,
+  MELO_EVENT_PLAYLIST_SORT,
+  MELO_EVENT_PLAYLIST_EMPTY,
+
+  /*< private >*/
+  MELO_EVENT_PLAYLIST_COUNT,
+};
+
 /**
  * MeloEventCallback:
  * @client: the current client instance
@@ -106,10 +173,11 @@ enum _MeloEventPlayer {
  * correct sub-type held in @event should be selected: for a
  * #MELO_EVENT_TYPE_PLAYER, you should use #MeloEventPlayer.
  *
- * This callback during client creation with melo_event_register().
+ * This callback during client creation with melo_event_register() or
+ * melo_event_register_async().
  *
- * Note: this callback is not threaded and long operation or blocking calls
- * should be avoided!
+ * Note: with melo_event_register(), this callback is not threaded and long
+ * operation or blocking calls should be avoided!
  *
  * Returns: %TRUE if the event has been handled successfully, %FALSE otherwise.
  */
@@ -118,15 +186,56 @@ typedef gboolean (*MeloEventCallback) (MeloEventClient *client,
                                        const gchar *id, gpointer data,
                                        gpointer user_data);
 
+/**
+ * MeloEventSerializeFunc:
+ * @type: the event type
+ * @event: the sub-type of the event
+ * @id: the Melo object ID
+ * @data: the event data
+ *
+ * This function is used by melo_event_get_serialized() to serialize an event.
+ *
+ * Returns: (transfer full): a #GBytes containing the serialized event, or
+ * %NULL if failed.
+ */
+typedef GBytes *(*MeloEventSerializeFunc) (MeloEventType type, guint event,
+                                           const gchar *id, gpointer data);
+
 /* Event client registration */
 MeloEventClient *melo_event_register (MeloEventCallback callback,
                                       gpointer user_data);
+MeloEventClient *melo_event_register_async (MeloEventCallback callback,
+                                            gpointer user_data,
+                                            GMainContext *context,
+                                            guint queue_size,
+                                            MeloEventOverflow overflow,
+                                            const guint32 *events,
+                                            const gchar *id_pattern);
 void melo_event_unregister (MeloEventClient *client);
+guint melo_event_client_get_dropped (MeloEventClient *client);
+
+/* Event client subscription filters */
+void melo_event_client_set_filter (MeloEventClient *client, MeloEventType type,
+                                   guint32 events);
+void melo_event_client_set_id_filter (MeloEventClient *client,
+                                      const gchar *pattern);
+
+/* Event history */
+gboolean melo_event_client_replay (MeloEventClient *client, guint64 since);
+guint64 melo_event_get_last_seq (void);
+void melo_event_set_history_size (guint size);
+
+/* Event coalescing */
+void melo_event_set_coalesce_window (guint window);
 
 /* Event generation */
 void melo_event_new (MeloEventType type, guint event, const gchar *id,
                      gpointer data, GDestroyNotify free_data_func);
 
+/* Current event (from a callback) */
+guint64 melo_event_get_seq (void);
+GBytes *melo_event_get_serialized (MeloEventSerializeFunc func);
+
 /* Event helper */
 const gchar *melo_event_type_to_string (MeloEventType type);
 
@@ -164,4 +273,29 @@ MeloTags *melo_event_player_tags_parse (gpointer data);
 
 const gchar *melo_event_player_to_string (MeloEventPlayer event);
 
+/* Playlist event helpers */
+void melo_event_playlist_add (const gchar *id, guint version, gint index,
+                              MeloPlaylistItem *item);
+void melo_event_playlist_remove (const gchar *id, guint version,
+                                 const gchar *media_id);
+void melo_event_playlist_move (const gchar *id, guint version,
+                               const gchar *media_id, guint count,
+                               const gchar *after);
+void melo_event_playlist_current (const gchar *id, guint version,
+                                  const gchar *media_id);
+void melo_event_playlist_sort (const gchar *id, guint version,
+                               const gchar *after, gchar **media_ids);
+void melo_event_playlist_empty (const gchar *id, guint version);
+
+guint melo_event_playlist_get_version (gpointer data);
+MeloPlaylistItem *melo_event_playlist_add_parse (gpointer data, gint *index);
+const gchar *melo_event_playlist_remove_parse (gpointer data);
+const gchar *melo_event_playlist_move_parse (gpointer data, guint *count,
+                                             const gchar **after);
+const gchar *melo_event_playlist_current_parse (gpointer data);
+const gchar * const *melo_event_playlist_sort_parse (gpointer data,
+                                                     const gchar **after);
+
+const gchar *melo_event_playlist_to_string (MeloEventPlaylist event);
+
 #endif /* __MELO_EVENT_H__ */
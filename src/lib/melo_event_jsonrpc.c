@@ -20,6 +20,7 @@
  */
 
 #include "melo_player_jsonrpc.h"
+#include "melo_playlist_jsonrpc.h"
 
 #include "melo_event_jsonrpc.h"
 
@@ -52,7 +53,8 @@ static void
 melo_event_jsonrpc_player_status (JsonObject *obj, gpointer data)
 {
   const MeloPlayerStatus *status = melo_event_player_status_parse (data);
-  JsonObject *o = melo_player_jsonrpc_status_to_object (status,
+  JsonObject *o = melo_player_jsonrpc_status_to_object_with_pos (status,
+                                         status->pos,
                                          MELO_PLAYER_JSONRPC_STATUS_FIELDS_FULL,
                                          MELO_TAGS_FIELDS_FULL, 0);
   json_object_set_object_member (obj, "status", o);
@@ -152,13 +154,96 @@ static MeloEventJsonrpcParser melo_event_jsonrpc_player_parsers[] = {
   [MELO_EVENT_PLAYER_TAGS] = melo_event_jsonrpc_player_tags,
 };
 
+/* Playlist event parsers */
+static void
+melo_event_jsonrpc_playlist_add (JsonObject *obj, gpointer data)
+{
+  MeloPlaylistItem *item;
+  JsonObject *o;
+  gint index;
+
+  json_object_set_int_member (obj, "version",
+                              melo_event_playlist_get_version (data));
+  item = melo_event_playlist_add_parse (data, &index);
+  json_object_set_int_member (obj, "index", index);
+  o = melo_playlist_jsonrpc_item_to_object (item, MELO_TAGS_FIELDS_FULL);
+  json_object_set_object_member (obj, "item", o);
+}
+
+static void
+melo_event_jsonrpc_playlist_remove (JsonObject *obj, gpointer data)
+{
+  json_object_set_int_member (obj, "version",
+                              melo_event_playlist_get_version (data));
+  json_object_set_string_member (obj, "media_id",
+                                 melo_event_playlist_remove_parse (data));
+}
+
+static void
+melo_event_jsonrpc_playlist_move (JsonObject *obj, gpointer data)
+{
+  const gchar *media_id, *after;
+  guint count;
+
+  json_object_set_int_member (obj, "version",
+                              melo_event_playlist_get_version (data));
+  media_id = melo_event_playlist_move_parse (data, &count, &after);
+  json_object_set_string_member (obj, "media_id", media_id);
+  json_object_set_int_member (obj, "count", count);
+  json_object_set_string_member (obj, "after", after);
+}
+
+static void
+melo_event_jsonrpc_playlist_current (JsonObject *obj, gpointer data)
+{
+  json_object_set_int_member (obj, "version",
+                              melo_event_playlist_get_version (data));
+  json_object_set_string_member (obj, "media_id",
+                                 melo_event_playlist_current_parse (data));
+}
+
+static void
+melo_event_jsonrpc_playlist_sort (JsonObject *obj, gpointer data)
+{
+  const gchar * const *media_ids;
+  const gchar *after;
+  JsonArray *array;
+
+  json_object_set_int_member (obj, "version",
+                              melo_event_playlist_get_version (data));
+  media_ids = melo_event_playlist_sort_parse (data, &after);
+  json_object_set_string_member (obj, "after", after);
+
+  /* Add sorted media IDs */
+  array = json_array_new ();
+  while (media_ids && *media_ids)
+    json_array_add_string_element (array, *media_ids++);
+  json_object_set_array_member (obj, "media_ids", array);
+}
+
+static void
+melo_event_jsonrpc_playlist_empty (JsonObject *obj, gpointer data)
+{
+  json_object_set_int_member (obj, "version",
+                              melo_event_playlist_get_version (data));
+}
+
+static MeloEventJsonrpcParser melo_event_jsonrpc_playlist_parsers[] = {
+  [MELO_EVENT_PLAYLIST_ADD] = melo_event_jsonrpc_playlist_add,
+  [MELO_EVENT_PLAYLIST_REMOVE] = melo_event_jsonrpc_playlist_remove,
+  [MELO_EVENT_PLAYLIST_MOVE] = melo_event_jsonrpc_playlist_move,
+  [MELO_EVENT_PLAYLIST_CURRENT] = melo_event_jsonrpc_playlist_current,
+  [MELO_EVENT_PLAYLIST_SORT] = melo_event_jsonrpc_playlist_sort,
+  [MELO_EVENT_PLAYLIST_EMPTY] = melo_event_jsonrpc_playlist_empty,
+};
+
 /* Melo event type persers */
 static MeloEventJsonrpcParser *melo_event_jsonrpc_parsers[] = {
   [MELO_EVENT_TYPE_GENERAL] = NULL,
   [MELO_EVENT_TYPE_MODULE] = NULL,
   [MELO_EVENT_TYPE_BROWSER] = NULL,
   [MELO_EVENT_TYPE_PLAYER] = melo_event_jsonrpc_player_parsers,
-  [MELO_EVENT_TYPE_PLAYLIST] = NULL,
+  [MELO_EVENT_TYPE_PLAYLIST] = melo_event_jsonrpc_playlist_parsers,
 };
 
 static MeloEventJsonrpcString melo_event_jsonrpc_strings[] = {
@@ -166,7 +251,7 @@ static MeloEventJsonrpcString melo_event_jsonrpc_strings[] = {
   [MELO_EVENT_TYPE_MODULE] = NULL,
   [MELO_EVENT_TYPE_BROWSER] = NULL,
   [MELO_EVENT_TYPE_PLAYER] = melo_event_player_to_string,
-  [MELO_EVENT_TYPE_PLAYLIST] = NULL,
+  [MELO_EVENT_TYPE_PLAYLIST] = melo_event_playlist_to_string,
 };
 
 /**
@@ -187,6 +272,7 @@ melo_event_jsonrpc_event_to_object (MeloEventType type, guint event,
 {
   const gchar *event_string = NULL;
   JsonObject *obj;
+  guint64 seq;
 
   /* Create new object */
   obj = json_object_new ();
@@ -202,6 +288,11 @@ melo_event_jsonrpc_event_to_object (MeloEventType type, guint event,
   /* Add id string */
   json_object_set_string_member (obj, "id", id);
 
+  /* Add sequence number (only available from an event callback) */
+  seq = melo_event_get_seq ();
+  if (seq)
+    json_object_set_int_member (obj, "seq", seq);
+
   /* Parse event and add members to current object */
   if (melo_event_jsonrpc_parsers[type] &&
       melo_event_jsonrpc_parsers[type][event])
@@ -209,3 +300,51 @@ melo_event_jsonrpc_event_to_object (MeloEventType type, guint event,
 
   return obj;
 }
+
+/**
+ * melo_event_jsonrpc_event_to_bytes:
+ * @type: the event type
+ * @event: the event (depending on @type)
+ * @id: the ID of the Melo object (depending on @type)
+ * @data: the data associated to the event (depending on @event)
+ *
+ * Generate a serialized #JsonObject from a specific #MeloEventType and event
+ * ID. This function can be used with melo_event_get_serialized() to serialize
+ * each event only once for all clients.
+ *
+ * Returns: (transfer full): a new #GBytes containing the event serialized in a
+ * null-terminated JSON string (the null byte is not included in the size), or
+ * %NULL on error.
+ */
+GBytes *
+melo_event_jsonrpc_event_to_bytes (MeloEventType type, guint event,
+                                   const gchar *id, gpointer data)
+{
+  JsonGenerator *gen;
+  JsonObject *obj;
+  JsonNode *node;
+  gsize len;
+  gchar *str;
+
+  /* Convert event to Json object */
+  obj = melo_event_jsonrpc_event_to_object (type, event, id, data);
+  if (!obj)
+    return NULL;
+
+  /* Create node */
+  node = json_node_new (JSON_NODE_OBJECT);
+  json_node_take_object (node, obj);
+
+  /* Generate Json string */
+  gen = json_generator_new ();
+  if (!gen) {
+    json_node_unref (node);
+    return NULL;
+  }
+  json_generator_set_root (gen, node);
+  str = json_generator_to_data (gen, &len);
+  json_node_unref (node);
+  g_object_unref (gen);
+
+  return g_bytes_new_take (str, len);
+}
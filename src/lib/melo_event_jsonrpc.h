@@ -27,5 +27,7 @@
 
 JsonObject *melo_event_jsonrpc_event_to_object (MeloEventType type, guint event,
                                                 const gchar *id, gpointer data);
+GBytes *melo_event_jsonrpc_event_to_bytes (MeloEventType type, guint event,
+                                           const gchar *id, gpointer data);
 
 #endif /* __MELO_EVENT_JSONRPC_H__ */
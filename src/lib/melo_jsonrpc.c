@@ -19,6 +19,7 @@
  * Boston, MA  02110-1301, USA.
  */
 
+#include <math.h>
 #include <string.h>
 
 #include "melo_jsonrpc.h"
@@ -45,33 +46,196 @@
  *
  * The melo_jsonrpc_parse_request() should be only called by the main
  * application and not from any Melo object like #MeloModule.
+ *
+ * The responses are serialized with a #MeloJSONRPCWriter, a buffer reused by
+ * each thread, in which the method results can also be written directly with
+ * melo_jsonrpc_get_result_writer(), without building a #JsonNode tree.
+ *
+ * The requests of a batch calling methods registered with
+ * %MELO_JSONRPC_FLAG_CONCURRENT are processed concurrently by a shared thread
+ * pool, with at most 4 requests of the same batch at a time. Any other request
+ * is an ordering barrier: it is processed alone, after all previous requests
+ * and before the next ones. The responses are sent in the order of the
+ * requests. The callbacks of concurrent methods must then be thread-safe.
+ *
+ * A method can also complete its call later, from any thread, with
+ * melo_jsonrpc_defer() and melo_jsonrpc_complete(). The transport should then
+ * use melo_jsonrpc_parse_request_async() to not block a thread until the
+ * response is ready.
  */
 
+/* Number of latency buckets: bucket N counts calls under 2^N us */
+#define MELO_JSONRPC_STATS_BUCKETS 28
+
+/* Compiled form of one entry of a params schema */
+typedef enum {
+  MELO_JSONRPC_PARAM_TYPE_BOOLEAN,
+  MELO_JSONRPC_PARAM_TYPE_INTEGER,
+  MELO_JSONRPC_PARAM_TYPE_DOUBLE,
+  MELO_JSONRPC_PARAM_TYPE_STRING,
+  MELO_JSONRPC_PARAM_TYPE_OBJECT,
+  MELO_JSONRPC_PARAM_TYPE_ARRAY,
+} MeloJSONRPCParamType;
+
+typedef struct _MeloJSONRPCParam {
+  const gchar *name;
+  MeloJSONRPCParamType type;
+  gboolean required;
+} MeloJSONRPCParam;
+
 typedef struct _MeloJSONRPCInternalMethod {
+  /* References: the method table and the calls in progress */
+  gint ref_count;
+  gint removed;
+
   /* Schema nodes */
   JsonArray *params;
   JsonObject *result;
+
+  /* Compiled params schema: names are owned by params */
+  MeloJSONRPCParam *desc;
+  guint desc_count;
+
   /* Callback */
   MeloJSONRPCCallback callback;
   gpointer user_data;
+  MeloJSONRPCFlags flags;
+  MeloJSONRPCPriority priority;
 
+  /* Statistics */
+  gint calls;
+  gint errors;
+  gint latency[MELO_JSONRPC_STATS_BUCKETS];
 } MeloJSONRPCInternalMethod;
 
-/* List of groups and methods */
+/* Maximum nesting level supported by the writer */
+#define MELO_JSONRPC_WRITER_MAX_DEPTH 64
+/* Minimal size of a response chunk */
+#define MELO_JSONRPC_WRITER_CHUNK_SIZE 16384
+/* Maximal size of the buffer kept between two requests */
+#define MELO_JSONRPC_WRITER_MAX_SIZE (1024 * 1024)
+
+/* Number of threads shared by all batch requests */
+#define MELO_JSONRPC_BATCH_THREADS 8
+/* Maximal number of elements of one batch processed concurrently */
+#define MELO_JSONRPC_BATCH_CONCURRENCY 4
+
+struct _MeloJSONRPCWriter {
+  GString *str;
+  guint depth;
+  guint64 items;
+  gboolean member;
+  gboolean overflow;
+  guint skipped;
+  gboolean busy;
+  gboolean canonical;
+};
+
+typedef struct _MeloJSONRPCWriterMark {
+  gsize length;
+  guint depth;
+  guint64 items;
+  gboolean member;
+  gboolean overflow;
+  guint skipped;
+} MeloJSONRPCWriterMark;
+
+typedef struct _MeloJSONRPCRequest {
+  gint ref_count;
+  GMutex mutex;
+  GCond cond;
+
+  /* Batch requests */
+  JsonArray *array;
+  gboolean *concurrent;
+  gboolean barrier;
+  guint next;
+  guint active;
+
+  /* Serialized responses */
+  guint count;
+  gchar **responses;
+  gsize *lengths;
+
+  /* Calls not yet completed */
+  gint pending;
+
+  /* Response callbacks */
+  MeloJSONRPCChunkFunc func;
+  MeloJSONRPCDoneFunc done;
+  gpointer user_data;
+} MeloJSONRPCRequest;
+
+typedef struct _MeloJSONRPCFlight {
+  gchar *key;
+  GList *waiters;
+} MeloJSONRPCFlight;
+
+typedef struct _MeloJSONRPCCall {
+  MeloJSONRPCRequest *req;
+  guint index;
+  const gchar *id;
+  gint64 nid;
+  gboolean notification;
+  MeloJSONRPCCompletion *completion;
+  MeloJSONRPCFlight *flight;
+  MeloJSONRPCInternalMethod *method;
+  gint64 start;
+} MeloJSONRPCCall;
+
+struct _MeloJSONRPCCompletion {
+  MeloJSONRPCRequest *req;
+  guint index;
+  gchar *id;
+  gint64 nid;
+  MeloJSONRPCFlight *flight;
+
+  /* Deferred call, counted in statistics on completion */
+  MeloJSONRPCInternalMethod *method;
+  gint64 start;
+};
+
+typedef enum {
+  MELO_JSONRPC_RESPONSE_NONE = 0,
+  MELO_JSONRPC_RESPONSE_READY,
+  MELO_JSONRPC_RESPONSE_DEFERRED,
+} MeloJSONRPCResponse;
+
+/* List of groups and methods: the table is never modified once published,
+ * the mutex only serializes the updates.
+ */
 G_LOCK_DEFINE_STATIC (melo_jsonrpc_mutex);
 static GHashTable *melo_jsonrpc_methods = NULL;
 
+/* Readers of the method table, counted per epoch */
+static gint melo_jsonrpc_epoch;
+static gint melo_jsonrpc_readers[2];
+
+/* Wake up of the updates waiting for the end of readers or calls */
+static GMutex melo_jsonrpc_wait_mutex;
+static GCond melo_jsonrpc_wait_cond;
+
+/* Calls of read-only methods in progress */
+G_LOCK_DEFINE_STATIC (melo_jsonrpc_flight_mutex);
+static GHashTable *melo_jsonrpc_flights = NULL;
+
+/* Thread pool for batch requests */
+G_LOCK_DEFINE_STATIC (melo_jsonrpc_batch_mutex);
+static GThreadPool *melo_jsonrpc_batch_pool = NULL;
+
+/* Per-thread response writer and writer of the current result */
+static GPrivate melo_jsonrpc_writer_key =
+                   G_PRIVATE_INIT ((GDestroyNotify) melo_jsonrpc_writer_free);
+static GPrivate melo_jsonrpc_result_writer_key;
+
+/* Current call of the thread */
+static GPrivate melo_jsonrpc_call_key;
+
 /* Helpers */
-static gchar *melo_jsonrpc_node_to_string (JsonNode *node);
-static JsonNode *melo_jsonrpc_build_error (const char *id, gint64 nid,
-                                           MeloJSONRPCError error_code,
-                                           const char *error_format, ...);
-static gchar *melo_jsonrpc_build_error_str (MeloJSONRPCError error_code,
-                                            const char *error_format, ...);
-static JsonNode *melo_jsonrpc_build_response_node (JsonNode *result,
-                                                   JsonNode *error,
-                                                   const gchar *id,
-                                                   gint64 nid);
+static void melo_jsonrpc_writer_add_separator (MeloJSONRPCWriter *w);
+static void melo_jsonrpc_write_error (MeloJSONRPCWriter *w, const char *id,
+                                      gint64 nid, MeloJSONRPCError error_code,
+                                      const char *error_message);
 
 /* Register a JSON-RPC method */
 static void
@@ -84,68 +248,242 @@ melo_jsonrpc_free_method (gpointer data)
     json_array_unref (m->params);
   if (m->result)
     json_object_unref (m->result);
+  g_free (m->desc);
 
   /* Free method */
   g_slice_free (MeloJSONRPCInternalMethod, m);
 }
 
-/**
- * melo_jsonrpc_register_method:
- * @group: prefix of the method
- * @method: the method name
- * @params: the schema of the parameters accepted as JSON
- * @result: the schema of the result provided as JSON
- * @callback: the callback of type #MeloJSONRPCCallback to call when @method,
- *    @params and @result are matching
- * @user_data: the user data to use when calling @callback
- *
- * Register one JSON-RPC method named @method and prefixed with @group.
- * The final method will be as "@group.@name".
- * For more details on the @params and @method, please see #MeloJSONRPCMethod.
- *
- * Returns: %TRUE if method has been registered, %FALSE otherwise.
- */
-gboolean
-melo_jsonrpc_register_method (const gchar *group, const gchar *method,
-                              JsonArray *params, JsonObject *result,
-                              MeloJSONRPCCallback callback,
-                              gpointer user_data)
+static void
+melo_jsonrpc_wake_up (void)
+{
+  g_mutex_lock (&melo_jsonrpc_wait_mutex);
+  g_cond_broadcast (&melo_jsonrpc_wait_cond);
+  g_mutex_unlock (&melo_jsonrpc_wait_mutex);
+}
+
+static void
+melo_jsonrpc_read_unlock (guint epoch)
+{
+  /* Last reader of a previous epoch: wake up the table update */
+  if (g_atomic_int_dec_and_test (&melo_jsonrpc_readers[epoch & 1]) &&
+      g_atomic_int_get (&melo_jsonrpc_epoch) != (gint) epoch)
+    melo_jsonrpc_wake_up ();
+}
+
+/* Method table snapshot: a reader must only hold it for a lookup */
+static guint
+melo_jsonrpc_read_lock (void)
+{
+  guint epoch;
+
+  /* Enter current epoch */
+  while (1) {
+    epoch = g_atomic_int_get (&melo_jsonrpc_epoch);
+    g_atomic_int_inc (&melo_jsonrpc_readers[epoch & 1]);
+    if (g_atomic_int_get (&melo_jsonrpc_epoch) == (gint) epoch)
+      break;
+    melo_jsonrpc_read_unlock (epoch);
+  }
+
+  return epoch;
+}
+
+static GHashTable *
+melo_jsonrpc_methods_copy (void)
+{
+  GHashTableIter iter;
+  GHashTable *methods;
+  gpointer key, value;
+
+  /* Create new table: methods are shared between tables */
+  methods = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+
+  /* Copy current methods */
+  if (melo_jsonrpc_methods) {
+    g_hash_table_iter_init (&iter, melo_jsonrpc_methods);
+    while (g_hash_table_iter_next (&iter, &key, &value))
+      g_hash_table_insert (methods, g_strdup (key), value);
+  }
+
+  return methods;
+}
+
+static void
+melo_jsonrpc_methods_publish (GHashTable *methods)
+{
+  GHashTable *old;
+  guint epoch;
+
+  /* Free new table if empty */
+  if (methods && !g_hash_table_size (methods)) {
+    g_hash_table_unref (methods);
+    methods = NULL;
+  }
+
+  /* Replace table */
+  old = g_atomic_pointer_get (&melo_jsonrpc_methods);
+  g_atomic_pointer_set (&melo_jsonrpc_methods, methods);
+
+  /* Start a new epoch and wait end of readers of the previous one */
+  epoch = g_atomic_int_get (&melo_jsonrpc_epoch);
+  g_atomic_int_set (&melo_jsonrpc_epoch, epoch + 1);
+  g_mutex_lock (&melo_jsonrpc_wait_mutex);
+  while (g_atomic_int_get (&melo_jsonrpc_readers[epoch & 1]))
+    g_cond_wait (&melo_jsonrpc_wait_cond, &melo_jsonrpc_wait_mutex);
+  g_mutex_unlock (&melo_jsonrpc_wait_mutex);
+
+  /* Old table is not used anymore */
+  if (old)
+    g_hash_table_unref (old);
+}
+
+static MeloJSONRPCInternalMethod *
+melo_jsonrpc_method_acquire (const gchar *method)
+{
+  MeloJSONRPCInternalMethod *m = NULL;
+  GHashTable *methods;
+  guint epoch;
+
+  /* Get registered method and keep it until release */
+  epoch = melo_jsonrpc_read_lock ();
+  methods = g_atomic_pointer_get (&melo_jsonrpc_methods);
+  if (methods)
+    m = g_hash_table_lookup (methods, method);
+  if (m)
+    g_atomic_int_inc (&m->ref_count);
+  melo_jsonrpc_read_unlock (epoch);
+
+  return m;
+}
+
+static void
+melo_jsonrpc_method_release (MeloJSONRPCInternalMethod *m)
+{
+  gint old;
+
+  /* Free method or wake up its unregistration on end of last call */
+  old = g_atomic_int_add (&m->ref_count, -1);
+  if (old == 1)
+    melo_jsonrpc_free_method (m);
+  else if (old == 2 && g_atomic_int_get (&m->removed))
+    melo_jsonrpc_wake_up ();
+}
+
+/* Compile a params schema */
+static gboolean
+melo_jsonrpc_compile_params (JsonArray *schema_params, MeloJSONRPCParam **desc,
+                             guint *count)
+{
+  MeloJSONRPCParam *d;
+  JsonObject *schema;
+  const gchar *type;
+  JsonNode *node;
+  guint i;
+
+  /* Allocate compiled schema */
+  *count = json_array_get_length (schema_params);
+  d = g_new0 (MeloJSONRPCParam, *count);
+
+  for (i = 0; i < *count; i++) {
+    /* Get next schema object */
+    schema = json_array_get_object_element (schema_params, i);
+    if (!schema)
+      goto failed;
+
+    /* Get name and type */
+    d[i].name = json_object_get_string_member (schema, "name");
+    type = json_object_get_string_member (schema, "type");
+    if (!d[i].name || !type)
+      goto failed;
+
+    /* Get type: only the first letter is checked */
+    switch (type[0]) {
+      case 'b':
+        d[i].type = MELO_JSONRPC_PARAM_TYPE_BOOLEAN;
+        break;
+      case 'i':
+        d[i].type = MELO_JSONRPC_PARAM_TYPE_INTEGER;
+        break;
+      case 'd':
+        d[i].type = MELO_JSONRPC_PARAM_TYPE_DOUBLE;
+        break;
+      case 's':
+        d[i].type = MELO_JSONRPC_PARAM_TYPE_STRING;
+        break;
+      case 'o':
+        d[i].type = MELO_JSONRPC_PARAM_TYPE_OBJECT;
+        break;
+      case 'a':
+        d[i].type = MELO_JSONRPC_PARAM_TYPE_ARRAY;
+        break;
+      default:
+        goto failed;
+    }
+
+    /* Get required flag: required if not defined */
+    node = json_object_get_member (schema, "required");
+    d[i].required = !node || json_node_get_boolean (node);
+  }
+
+  *desc = d;
+  return TRUE;
+
+failed:
+  g_free (d);
+  return FALSE;
+}
+
+/* Add a JSON-RPC method to the table */
+static gboolean
+melo_jsonrpc_add_method (const gchar *group, const gchar *method,
+                         JsonArray *params, JsonObject *result,
+                         MeloJSONRPCFlags flags, MeloJSONRPCPriority priority,
+                         MeloJSONRPCCallback callback, gpointer user_data)
 {
   MeloJSONRPCInternalMethod *m;
+  MeloJSONRPCParam *desc = NULL;
+  GHashTable *methods;
   gchar *complete_method;
+  guint count = 0;
+
+  /* Compile params schema */
+  if (params && !melo_jsonrpc_compile_params (params, &desc, &count))
+    return FALSE;
 
   /* Create complete method */
   complete_method = g_strdup_printf ("%s.%s", group, method);
 
-  /* Lock method list access */
+  /* Lock method list update */
   G_LOCK (melo_jsonrpc_mutex);
 
-  /* Create hash table if not yet created */
-  if (!melo_jsonrpc_methods) {
-    melo_jsonrpc_methods = g_hash_table_new_full (g_str_hash, g_str_equal,
-                                                  g_free,
-                                                  melo_jsonrpc_free_method);
-  }
-
   /* Method already exists */
-  if (g_hash_table_lookup (melo_jsonrpc_methods, complete_method))
+  if (melo_jsonrpc_methods &&
+      g_hash_table_lookup (melo_jsonrpc_methods, complete_method))
     goto failed;
 
   /* Create new method handler */
-  m = g_slice_new (MeloJSONRPCInternalMethod);
+  m = g_slice_new0 (MeloJSONRPCInternalMethod);
   if (!m)
     goto failed;
 
   /* Fill handler */
+  m->ref_count = 1;
   m->params = params;
   m->result = result;
+  m->desc = desc;
+  m->desc_count = count;
   m->callback = callback;
   m->user_data = user_data;
+  m->flags = flags;
+  m->priority = priority;
 
-  /* Add method */
-  g_hash_table_insert (melo_jsonrpc_methods, complete_method, m);
+  /* Add method to a new table */
+  methods = melo_jsonrpc_methods_copy ();
+  g_hash_table_insert (methods, complete_method, m);
+  melo_jsonrpc_methods_publish (methods);
 
-  /* Unlock method list access */
+  /* Unlock method list update */
   G_UNLOCK (melo_jsonrpc_mutex);
 
   return TRUE;
@@ -153,39 +491,89 @@ melo_jsonrpc_register_method (const gchar *group, const gchar *method,
 failed:
   G_UNLOCK (melo_jsonrpc_mutex);
   g_free (complete_method);
+  g_free (desc);
   return FALSE;
 }
 
+/**
+ * melo_jsonrpc_register_method:
+ * @group: prefix of the method
+ * @method: the method name
+ * @params: the schema of the parameters accepted as JSON
+ * @result: the schema of the result provided as JSON
+ * @callback: the callback of type #MeloJSONRPCCallback to call when @method,
+ *    @params and @result are matching
+ * @user_data: the user data to use when calling @callback
+ *
+ * Register one JSON-RPC method named @method and prefixed with @group.
+ * The final method will be as "@group.@name".
+ * For more details on the @params and @method, please see #MeloJSONRPCMethod.
+ *
+ * The requests look up the methods without any lock, in a table which is
+ * replaced on each registration. This function only waits for the end of the
+ * lookups in the previous table: the method callbacks are called outside of
+ * the table.
+ *
+ * Returns: %TRUE if method has been registered, %FALSE otherwise.
+ */
+gboolean
+melo_jsonrpc_register_method (const gchar *group, const gchar *method,
+                              JsonArray *params, JsonObject *result,
+                              MeloJSONRPCCallback callback,
+                              gpointer user_data)
+{
+  return melo_jsonrpc_add_method (group, method, params, result,
+                                  MELO_JSONRPC_FLAG_NONE,
+                                  MELO_JSONRPC_PRIORITY_DEFAULT, callback,
+                                  user_data);
+}
+
 /**
  * melo_jsonrpc_unregister_method:
  * @group: prefix of the method
  * @method: the method name
  *
  * Unregister one JSON-RPC method named @method and prefixed with @group.
+ * When the function returns, the method is not called anymore and its
+ * user data can be released: the function waits for the end of the calls in
+ * progress, including the deferred calls not yet completed, so it must not be
+ * called from the callback of @method.
  */
 void
 melo_jsonrpc_unregister_method (const gchar *group, const gchar *method)
 {
+  MeloJSONRPCInternalMethod *m = NULL;
+  GHashTable *methods;
   gchar *complete_method;
 
   /* Create complete method */
   complete_method = g_strdup_printf ("%s.%s", group, method);
 
-  /* Lock method list access */
+  /* Lock method list update */
   G_LOCK (melo_jsonrpc_mutex);
 
-  /* Remove method */
-  g_hash_table_remove (melo_jsonrpc_methods, complete_method);
-
-  /* Free hash table if empty */
-  if (!g_hash_table_size (melo_jsonrpc_methods)) {
-    g_hash_table_unref (melo_jsonrpc_methods);
-    melo_jsonrpc_methods = NULL;
+  /* Remove method from a new table */
+  if (melo_jsonrpc_methods)
+    m = g_hash_table_lookup (melo_jsonrpc_methods, complete_method);
+  if (m) {
+    methods = melo_jsonrpc_methods_copy ();
+    g_hash_table_remove (methods, complete_method);
+    melo_jsonrpc_methods_publish (methods);
   }
 
-  /* Unlock method list access */
+  /* Unlock method list update */
   G_UNLOCK (melo_jsonrpc_mutex);
 
+  /* No new call can use the method: wait end of calls in progress */
+  if (m) {
+    g_atomic_int_set (&m->removed, TRUE);
+    g_mutex_lock (&melo_jsonrpc_wait_mutex);
+    while (g_atomic_int_get (&m->ref_count) > 1)
+      g_cond_wait (&melo_jsonrpc_wait_cond, &melo_jsonrpc_wait_mutex);
+    g_mutex_unlock (&melo_jsonrpc_wait_mutex);
+    melo_jsonrpc_method_release (m);
+  }
+
   /* Free complete method */
   g_free (complete_method);
 }
@@ -247,9 +635,9 @@ melo_jsonrpc_register_methods (const gchar *group, MeloJSONRPCMethod *methods,
       result = NULL;
 
     /* Register method */
-    ret = melo_jsonrpc_register_method (group, methods[i].method, params,
-                                        result, methods[i].callback,
-                                        methods[i].user_data);
+    ret = melo_jsonrpc_add_method (group, methods[i].method, params, result,
+                                   methods[i].flags, methods[i].priority,
+                                   methods[i].callback, methods[i].user_data);
 
     /* Failed to register method */
     if (!ret) {
@@ -286,370 +674,1575 @@ melo_jsonrpc_unregister_methods (const gchar *group, MeloJSONRPCMethod *methods,
     melo_jsonrpc_unregister_method (group, methods[i].method);
 }
 
-/* Parse JSON-RPC request */
-static JsonNode *
-melo_jsonrpc_parse_node (JsonNode *node)
+/* Method statistics */
+static void
+melo_jsonrpc_stats_add (MeloJSONRPCInternalMethod *m, gint64 latency,
+                        JsonNode *error)
 {
-  MeloJSONRPCInternalMethod *m;
-  MeloJSONRPCCallback callback = NULL;
-  gpointer user_data = NULL;
-  JsonArray *s_params = NULL;
-  JsonNode *result = NULL;
-  JsonNode *error = NULL;
-  JsonNode *params;
-  JsonObject *obj;
-  const char *version;
-  const char *method;
-  const char *id = NULL;
-  gint64 nid = -1;
-
-  /* Not an object */
-  if (JSON_NODE_TYPE (node) != JSON_NODE_OBJECT)
-    goto invalid;
-
-  /* Get object from nide */
-  obj = json_node_get_object (node);
-  if (!obj)
-    goto internal;
-
-  /* Check if jsonrpc is present */
-  if (!json_object_has_member (obj, "jsonrpc"))
-    goto invalid;
-
-  /* Check JSON-RPC version */
-  version = json_object_get_string_member (obj, "jsonrpc");
-  if (!version || strcmp (version, "2.0"))
-    goto invalid;
-
-  /* Check if method is present */
-  if (!json_object_has_member (obj, "method"))
-    goto invalid;
-
-  /* Get method */
-  method = json_object_get_string_member (obj, "method");
-  if (!method)
-    goto invalid;
+  guint bucket;
+
+  /* Find latency bucket */
+  bucket = latency > 0 ? g_bit_storage (latency) : 0;
+  if (bucket >= MELO_JSONRPC_STATS_BUCKETS)
+    bucket = MELO_JSONRPC_STATS_BUCKETS - 1;
+
+  /* Update counters */
+  g_atomic_int_inc (&m->calls);
+  g_atomic_int_inc (&m->latency[bucket]);
+  if (error)
+    g_atomic_int_inc (&m->errors);
+}
 
-  /* Get params */
-  params = json_object_get_member (obj, "params");
-  if (params) {
-    JsonNodeType type;
+static gint64
+melo_jsonrpc_stats_get_percentile (const gint *latency, guint count,
+                                   guint percent)
+{
+  guint64 target, sum = 0;
+  guint i;
 
-    /* Check params type: only object or array allowed */
-    type = json_node_get_node_type (params);
-    if (type != JSON_NODE_ARRAY && type != JSON_NODE_OBJECT)
-      goto invalid;
-  }
+  /* No call */
+  if (!count)
+    return 0;
 
-  /* Get registered method */
-  G_LOCK (melo_jsonrpc_mutex);
-  if (melo_jsonrpc_methods) {
-    m = g_hash_table_lookup (melo_jsonrpc_methods, method);
-    if (m) {
-      callback = m->callback;
-      user_data = m->user_data;
-      if (m->params)
-        s_params = json_array_ref (m->params);
-    }
+  /* Find bucket of the percentile and return its upper bound */
+  target = ((guint64) count * percent + 99) / 100;
+  for (i = 0; i < MELO_JSONRPC_STATS_BUCKETS - 1; i++) {
+    sum += latency[i];
+    if (sum >= target)
+      break;
   }
-  G_UNLOCK (melo_jsonrpc_mutex);
 
-  /* Check if id is present */
-  if (!json_object_has_member (obj, "id")) {
-    /* This is a notification: try to call callback */
-    if (callback) {
-      callback (method, s_params, params, &result, &error, user_data);
-      if (s_params)
-        json_array_unref (s_params);
-      if (error)
-        json_node_free (error);
-      if (result)
-        json_node_free (result);
-    }
-    return NULL;
-  }
+  return G_GINT64_CONSTANT (1) << i;
+}
 
-  /* Get id */
-  nid = json_object_get_int_member (obj, "id");
-  id = json_object_get_string_member (obj, "id");
+static JsonObject *
+melo_jsonrpc_stats_to_object (const gchar *name, MeloJSONRPCInternalMethod *m)
+{
+  gint latency[MELO_JSONRPC_STATS_BUCKETS];
+  JsonObject *obj;
+  guint count = 0;
+  guint i;
 
-  /* No callback provided */
-  if (!callback)
-    goto not_found;
+  /* Take a copy of the histogram */
+  for (i = 0; i < MELO_JSONRPC_STATS_BUCKETS; i++) {
+    latency[i] = g_atomic_int_get (&m->latency[i]);
+    count += latency[i];
+  }
 
-  /* Call user callback */
-  callback (method, s_params, params, &result, &error, user_data);
-  if (s_params)
-    json_array_unref (s_params);
+  /* Generate object */
+  obj = json_object_new ();
+  json_object_set_string_member (obj, "method", name);
+  json_object_set_int_member (obj, "calls", g_atomic_int_get (&m->calls));
+  json_object_set_int_member (obj, "errors", g_atomic_int_get (&m->errors));
+  json_object_set_int_member (obj, "p50", melo_jsonrpc_stats_get_percentile (
+                                                        latency, count, 50));
+  json_object_set_int_member (obj, "p95", melo_jsonrpc_stats_get_percentile (
+                                                        latency, count, 95));
+  json_object_set_int_member (obj, "p99", melo_jsonrpc_stats_get_percentile (
+                                                        latency, count, 99));
 
-  /* No error or result */
-  if (!error && !result)
-    goto not_found;
+  return obj;
+}
 
-  /* Build response */
-  return melo_jsonrpc_build_response_node (result, error, id, nid);
+static void
+melo_jsonrpc_stats_reset (MeloJSONRPCInternalMethod *m)
+{
+  guint i;
 
-invalid:
-  return melo_jsonrpc_build_error (NULL, -1,
-                                        MELO_JSONRPC_ERROR_INVALID_REQUEST,
-                                        "Invalid request");
-not_found:
-  return melo_jsonrpc_build_error (id, nid,
-                                        MELO_JSONRPC_ERROR_METHOD_NOT_FOUND,
-                                        "Method not found");
-internal:
-  return melo_jsonrpc_build_error (id, -1,
-                                        MELO_JSONRPC_ERROR_INTERNAL_ERROR,
-                                        "Internal error");
+  /* Reset counters */
+  g_atomic_int_set (&m->calls, 0);
+  g_atomic_int_set (&m->errors, 0);
+  for (i = 0; i < MELO_JSONRPC_STATS_BUCKETS; i++)
+    g_atomic_int_set (&m->latency[i], 0);
 }
 
 /**
- * melo_jsonrpc_parse_request:
- * @request: the JSON-RPC requrest serialized in a string
- * @length: the length og @request, can be -1 for null-terminated string
- * @error: a pointer to a #GError which is set if an error occurred
+ * melo_jsonrpc_get_stats:
+ * @method: the complete name of a method, or %NULL for all methods
  *
- * Parse a string @request containing a JSON-RPC serialized request, call the
- * registered callback which match the request method and present the result
- * as a JSON-RPC response serialized in a string.
- * If the method is not registered, a JSON-RPC response is generated with the
- * error MELO_JSONRPC_ERROR_METHOD_NOT_FOUND.
+ * Get the call statistics of one or all registered methods. Each entry of the
+ * array is an object with the following members:
+ *  - "method": the complete name of the method,
+ *  - "calls": the number of calls since registration or last reset,
+ *  - "errors": the number of calls which returned an error,
+ *  - "p50", "p95" and "p99": the percentiles of the call latency, in
+ *    microseconds. The latencies are counted in power of two buckets, so the
+ *    values are the upper bounds of the buckets.
  *
- * Returns: (transfer full): a string containing the serialized #JsonNode
- * corresponding to the respond to the JSON-RPC request. Use g_free() after
- * usage.
+ * A call deferred with melo_jsonrpc_defer() is counted when it is completed
+ * with melo_jsonrpc_complete(), with its full latency.
+ *
+ * Returns: (transfer full): a #JsonArray containing the statistics. Use
+ * json_array_unref() after usage.
  */
-gchar *
-melo_jsonrpc_parse_request (const gchar *request, gsize length, GError **error)
+JsonArray *
+melo_jsonrpc_get_stats (const gchar *method)
 {
-  JsonParser *parser;
-  JsonNodeType type;
-  JsonNode *req;
-  JsonNode *res;
-  GError *err = NULL;
-  gchar *str;
+  MeloJSONRPCInternalMethod *m;
+  GHashTableIter iter;
+  GHashTable *methods;
+  JsonArray *array;
+  gpointer key;
+  guint epoch;
+
+  /* Create array */
+  array = json_array_new ();
+
+  /* Get statistics of methods */
+  epoch = melo_jsonrpc_read_lock ();
+  methods = g_atomic_pointer_get (&melo_jsonrpc_methods);
+  if (methods && method) {
+    m = g_hash_table_lookup (methods, method);
+    if (m)
+      json_array_add_object_element (array,
+                                     melo_jsonrpc_stats_to_object (method, m));
+  } else if (methods) {
+    g_hash_table_iter_init (&iter, methods);
+    while (g_hash_table_iter_next (&iter, &key, (gpointer *) &m))
+      json_array_add_object_element (array,
+                                     melo_jsonrpc_stats_to_object (key, m));
+  }
+  melo_jsonrpc_read_unlock (epoch);
 
-  /* Create parser */
-  parser = json_parser_new ();
-  if (!parser)
-    return melo_jsonrpc_build_error_str (MELO_JSONRPC_ERROR_INTERNAL_ERROR,
-                                         "Internal error");
+  return array;
+}
 
-  /* Parse request */
-  if (!json_parser_load_from_data (parser, request, length, &err) ||
-      (req = json_parser_get_root (parser)) == NULL) {
-    g_clear_error (&err);
-    goto parse_error;
+/**
+ * melo_jsonrpc_reset_stats:
+ * @method: the complete name of a method, or %NULL for all methods
+ *
+ * Reset the call statistics of one or all registered methods.
+ */
+void
+melo_jsonrpc_reset_stats (const gchar *method)
+{
+  MeloJSONRPCInternalMethod *m;
+  GHashTableIter iter;
+  GHashTable *methods;
+  guint epoch;
+
+  /* Reset statistics of methods */
+  epoch = melo_jsonrpc_read_lock ();
+  methods = g_atomic_pointer_get (&melo_jsonrpc_methods);
+  if (methods && method) {
+    m = g_hash_table_lookup (methods, method);
+    if (m)
+      melo_jsonrpc_stats_reset (m);
+  } else if (methods) {
+    g_hash_table_iter_init (&iter, methods);
+    while (g_hash_table_iter_next (&iter, NULL, (gpointer *) &m))
+      melo_jsonrpc_stats_reset (m);
   }
+  melo_jsonrpc_read_unlock (epoch);
+}
 
-  /* Get node type */
-  type = json_node_get_node_type (req);
+typedef struct {
+  MeloJSONRPCValue method;
+} MeloJSONRPCStatsParams;
 
-  /* Parse node */
-  if (type == JSON_NODE_OBJECT) {
+static void
+melo_jsonrpc_rpc_get_stats (const gchar *method,
+                            JsonArray *s_params, JsonNode *params,
+                            JsonNode **result, JsonNode **error,
+                            gpointer user_data)
+{
+  MeloJSONRPCStatsParams p = { { 0 } };
+
+  /* Get parameters */
+  if (!melo_jsonrpc_get_params (s_params, params, &p, error))
+    return;
+
+  /* Return result */
+  *result = json_node_new (JSON_NODE_ARRAY);
+  json_node_take_array (*result, melo_jsonrpc_get_stats (p.method.s));
+}
+
+static void
+melo_jsonrpc_rpc_reset_stats (const gchar *method,
+                              JsonArray *s_params, JsonNode *params,
+                              JsonNode **result, JsonNode **error,
+                              gpointer user_data)
+{
+  MeloJSONRPCStatsParams p = { { 0 } };
+  JsonObject *obj;
+
+  /* Get parameters */
+  if (!melo_jsonrpc_get_params (s_params, params, &p, error))
+    return;
+
+  /* Reset statistics */
+  melo_jsonrpc_reset_stats (p.method.s);
+
+  /* Create response */
+  obj = json_object_new ();
+  json_object_set_boolean_member (obj, "done", TRUE);
+
+  /* Return result */
+  *result = json_node_new (JSON_NODE_OBJECT);
+  json_node_take_object (*result, obj);
+}
+
+/* List of methods */
+static MeloJSONRPCMethod melo_jsonrpc_rpc_methods[] = {
+  {
+    .method = "get_stats",
+    .params = "["
+              "  {"
+              "    \"name\": \"method\", \"type\": \"string\","
+              "    \"required\": false"
+              "  }"
+              "]",
+    .result = "{\"type\":\"array\"}",
+    .callback = melo_jsonrpc_rpc_get_stats,
+    .user_data = NULL,
+  },
+  {
+    .method = "reset_stats",
+    .params = "["
+              "  {"
+              "    \"name\": \"method\", \"type\": \"string\","
+              "    \"required\": false"
+              "  }"
+              "]",
+    .result = "{\"type\":\"object\"}",
+    .callback = melo_jsonrpc_rpc_reset_stats,
+    .user_data = NULL,
+  },
+};
+
+/**
+ * melo_jsonrpc_register_rpc_methods:
+ *
+ * Register the JSON-RPC methods of the JSON-RPC parser itself, prefixed with
+ * "rpc".
+ */
+void
+melo_jsonrpc_register_rpc_methods (void)
+{
+  melo_jsonrpc_register_methods ("rpc", melo_jsonrpc_rpc_methods,
+                                 G_N_ELEMENTS (melo_jsonrpc_rpc_methods));
+}
+
+/**
+ * melo_jsonrpc_unregister_rpc_methods:
+ *
+ * Unregister the JSON-RPC methods of the JSON-RPC parser itself.
+ */
+void
+melo_jsonrpc_unregister_rpc_methods (void)
+{
+  melo_jsonrpc_unregister_methods ("rpc", melo_jsonrpc_rpc_methods,
+                                   G_N_ELEMENTS (melo_jsonrpc_rpc_methods));
+}
+
+/* Writer helpers */
+static void
+melo_jsonrpc_writer_mark (MeloJSONRPCWriter *w, MeloJSONRPCWriterMark *mark)
+{
+  mark->length = w->str->len;
+  mark->depth = w->depth;
+  mark->items = w->items;
+  mark->member = w->member;
+  mark->overflow = w->overflow;
+  mark->skipped = w->skipped;
+}
+
+static void
+melo_jsonrpc_writer_rewind (MeloJSONRPCWriter *w,
+                            const MeloJSONRPCWriterMark *mark)
+{
+  g_string_truncate (w->str, mark->length);
+  w->depth = mark->depth;
+  w->items = mark->items;
+  w->member = mark->member;
+  w->overflow = mark->overflow;
+  w->skipped = mark->skipped;
+}
+
+static MeloJSONRPCWriter *
+melo_jsonrpc_writer_acquire (void)
+{
+  MeloJSONRPCWriter *w;
+
+  /* Get writer of current thread */
+  w = g_private_get (&melo_jsonrpc_writer_key);
+  if (!w) {
+    w = melo_jsonrpc_writer_new ();
+    g_private_set (&melo_jsonrpc_writer_key, w);
+  }
+
+  /* Writer is already used by this thread: use a temporary one */
+  if (w->busy)
+    return melo_jsonrpc_writer_new ();
+
+  w->busy = TRUE;
+  return w;
+}
+
+static void
+melo_jsonrpc_writer_release (MeloJSONRPCWriter *w)
+{
+  /* Temporary writer */
+  if (!w->busy) {
+    melo_jsonrpc_writer_free (w);
+    return;
+  }
+
+  /* Do not keep a huge buffer for next requests */
+  if (w->str->allocated_len > MELO_JSONRPC_WRITER_MAX_SIZE) {
+    g_string_free (w->str, TRUE);
+    w->str = g_string_sized_new (MELO_JSONRPC_WRITER_CHUNK_SIZE);
+  }
+
+  /* Reset writer for next request */
+  melo_jsonrpc_writer_reset (w);
+  w->busy = FALSE;
+}
+
+static void
+melo_jsonrpc_writer_flush (MeloJSONRPCWriter *w, MeloJSONRPCChunkFunc func,
+                           gpointer user_data)
+{
+  if (!func || !w->str->len)
+    return;
+
+  /* Send chunk and reuse buffer */
+  func (w->str->str, w->str->len, user_data);
+  g_string_truncate (w->str, 0);
+}
+
+static void
+melo_jsonrpc_write_id (MeloJSONRPCWriter *w, const gchar *id, gint64 nid)
+{
+  /* Add id member: we assume ID cannot be negative */
+  melo_jsonrpc_writer_set_member_name (w, "id");
+  if (nid < 0 || id)
+    melo_jsonrpc_writer_add_string_value (w, id);
+  else
+    melo_jsonrpc_writer_add_int_value (w, nid);
+}
+
+/* Request context */
+static MeloJSONRPCRequest *
+melo_jsonrpc_request_new (MeloJSONRPCChunkFunc func, MeloJSONRPCDoneFunc done,
+                          gpointer user_data)
+{
+  MeloJSONRPCRequest *req;
+
+  /* Create request context: the caller holds one pending call */
+  req = g_slice_new0 (MeloJSONRPCRequest);
+  req->ref_count = 1;
+  req->pending = 1;
+  g_mutex_init (&req->mutex);
+  g_cond_init (&req->cond);
+  req->func = func;
+  req->done = done;
+  req->user_data = user_data;
+
+  return req;
+}
+
+static void
+melo_jsonrpc_request_set_count (MeloJSONRPCRequest *req, guint count)
+{
+  req->count = count;
+  req->responses = g_new0 (gchar *, count);
+  req->lengths = g_new0 (gsize, count);
+}
+
+static void
+melo_jsonrpc_request_unref (MeloJSONRPCRequest *req)
+{
+  guint i;
+
+  if (!g_atomic_int_dec_and_test (&req->ref_count))
+    return;
+
+  /* Free responses */
+  for (i = 0; i < req->count; i++)
+    g_free (req->responses[i]);
+  g_free (req->responses);
+  g_free (req->lengths);
+
+  /* Free request */
+  if (req->array)
+    json_array_unref (req->array);
+  g_free (req->concurrent);
+  g_mutex_clear (&req->mutex);
+  g_cond_clear (&req->cond);
+  g_slice_free (MeloJSONRPCRequest, req);
+}
+
+static void
+melo_jsonrpc_request_set_response (MeloJSONRPCRequest *req, guint index,
+                                   MeloJSONRPCWriter *w,
+                                   const MeloJSONRPCWriterMark *mark)
+{
+  /* Keep response serialized after the mark */
+  req->lengths[index] = w->str->len - mark->length;
+  req->responses[index] = g_strndup (w->str->str + mark->length,
+                                     req->lengths[index]);
+  melo_jsonrpc_writer_rewind (w, mark);
+}
+
+static void
+melo_jsonrpc_request_finish (MeloJSONRPCRequest *req, MeloJSONRPCWriter *w)
+{
+  MeloJSONRPCWriterMark mark;
+  gboolean ret = FALSE;
+  guint i;
+
+  /* Begin response array */
+  melo_jsonrpc_writer_mark (w, &mark);
+  if (req->array)
+    melo_jsonrpc_writer_begin_array (w);
+
+  /* Add responses in request order */
+  for (i = 0; i < req->count; i++) {
+    if (!req->responses[i])
+      continue;
+
+    /* Add response */
+    melo_jsonrpc_writer_add_separator (w);
+    g_string_append_len (w->str, req->responses[i], req->lengths[i]);
+    ret = TRUE;
+
+    /* Send a chunk when enough data is available */
+    if (w->str->len >= MELO_JSONRPC_WRITER_CHUNK_SIZE)
+      melo_jsonrpc_writer_flush (w, req->func, req->user_data);
+  }
+
+  /* Send last chunk */
+  if (ret) {
+    if (req->array)
+      melo_jsonrpc_writer_end_array (w);
+    melo_jsonrpc_writer_flush (w, req->func, req->user_data);
+  }
+  melo_jsonrpc_writer_rewind (w, &mark);
+
+  /* Request is done */
+  if (req->done)
+    req->done (ret, req->user_data);
+}
+
+static void
+melo_jsonrpc_request_complete_call (MeloJSONRPCRequest *req,
+                                    MeloJSONRPCWriter *w)
+{
+  /* Last pending call: send response */
+  if (g_atomic_int_dec_and_test (&req->pending))
+    melo_jsonrpc_request_finish (req, w);
+}
+
+/* Call helpers */
+static void
+melo_jsonrpc_write_response_begin (MeloJSONRPCWriter *w)
+{
+  melo_jsonrpc_writer_begin_object (w);
+  melo_jsonrpc_writer_set_member_name (w, "jsonrpc");
+  melo_jsonrpc_writer_add_string_value (w, "2.0");
+}
+
+static void
+melo_jsonrpc_write_response_body (MeloJSONRPCWriter *w, JsonNode *result,
+                                  JsonNode *error)
+{
+  JsonNode *node;
+
+  /* No error or result */
+  if (!error && !result) {
+    node = melo_jsonrpc_build_error_node (MELO_JSONRPC_ERROR_METHOD_NOT_FOUND,
+                                          "Method not found");
+    melo_jsonrpc_writer_set_member_name (w, "error");
+    melo_jsonrpc_writer_add_node (w, node);
+    json_node_free (node);
+    return;
+  }
+
+  /* Add error or result */
+  melo_jsonrpc_writer_set_member_name (w, error ? "error" : "result");
+  melo_jsonrpc_writer_add_node (w, error ? error : result);
+}
+
+static void
+melo_jsonrpc_write_response_overflow (MeloJSONRPCWriter *w,
+                                      const MeloJSONRPCWriterMark *mark)
+{
+  JsonNode *error;
+
+  /* Replace partial response by an error */
+  melo_jsonrpc_writer_rewind (w, mark);
+  melo_jsonrpc_write_response_begin (w);
+  error = melo_jsonrpc_build_error_node (MELO_JSONRPC_ERROR_INTERNAL_ERROR,
+                                         "Result is too deep");
+  melo_jsonrpc_write_response_body (w, NULL, error);
+  json_node_free (error);
+}
+
+static void
+melo_jsonrpc_write_response_end (MeloJSONRPCWriter *w, const gchar *id,
+                                 gint64 nid)
+{
+  melo_jsonrpc_write_id (w, id, nid);
+  melo_jsonrpc_writer_end_object (w);
+}
+
+/* Completion helpers */
+static MeloJSONRPCCompletion *
+melo_jsonrpc_completion_new (MeloJSONRPCRequest *req, guint index,
+                             const gchar *id, gint64 nid)
+{
+  MeloJSONRPCCompletion *completion;
+
+  /* Create completion handle: the call is now pending */
+  completion = g_slice_new0 (MeloJSONRPCCompletion);
+  completion->req = req;
+  completion->index = index;
+  completion->id = g_strdup (id);
+  completion->nid = nid;
+  g_atomic_int_inc (&req->ref_count);
+  g_atomic_int_inc (&req->pending);
+
+  return completion;
+}
+
+static void
+melo_jsonrpc_completion_send (MeloJSONRPCCompletion *completion,
+                              MeloJSONRPCWriter *w,
+                              const MeloJSONRPCWriterMark *mark)
+{
+  MeloJSONRPCRequest *req = completion->req;
+
+  /* Keep response and send request response if it was the last call */
+  melo_jsonrpc_request_set_response (req, completion->index, w, mark);
+  melo_jsonrpc_request_complete_call (req, w);
+  melo_jsonrpc_request_unref (req);
+
+  /* Free completion */
+  g_free (completion->id);
+  g_slice_free (MeloJSONRPCCompletion, completion);
+}
+
+/* Coalescing of read-only calls */
+static gchar *
+melo_jsonrpc_flight_get_key (MeloJSONRPCWriter *w, const gchar *method,
+                             JsonNode *params)
+{
+  MeloJSONRPCWriterMark mark;
+  gsize start;
+  gchar *key;
+
+  /* Serialize canonical parameters after current content */
+  melo_jsonrpc_writer_mark (w, &mark);
+  w->canonical = TRUE;
+  melo_jsonrpc_writer_add_node (w, params);
+  w->canonical = FALSE;
+
+  /* Parameters are too deep: the call is not coalesced */
+  if (w->overflow) {
+    melo_jsonrpc_writer_rewind (w, &mark);
+    return NULL;
+  }
+
+  /* Skip separator */
+  start = mark.length;
+  if (w->str->str[start] == ',')
+    start++;
+
+  /* Generate key */
+  key = g_strdup_printf ("%s:%s", method, w->str->str + start);
+  melo_jsonrpc_writer_rewind (w, &mark);
+
+  return key;
+}
+
+static MeloJSONRPCFlight *
+melo_jsonrpc_flight_join (MeloJSONRPCWriter *w, const gchar *method,
+                          JsonNode *params, MeloJSONRPCRequest *req,
+                          guint index, const gchar *id, gint64 nid,
+                          gboolean *leader)
+{
+  MeloJSONRPCFlight *flight;
+  gchar *key;
+
+  /* Generate key */
+  key = melo_jsonrpc_flight_get_key (w, method, params);
+  if (!key) {
+    *leader = TRUE;
+    return NULL;
+  }
+
+  G_LOCK (melo_jsonrpc_flight_mutex);
+
+  /* Create table */
+  if (!melo_jsonrpc_flights)
+    melo_jsonrpc_flights = g_hash_table_new (g_str_hash, g_str_equal);
+
+  /* Same call in progress: wait for its result */
+  flight = g_hash_table_lookup (melo_jsonrpc_flights, key);
+  if (flight) {
+    flight->waiters = g_list_prepend (flight->waiters,
+                                      melo_jsonrpc_completion_new (req, index,
+                                                                   id, nid));
+    G_UNLOCK (melo_jsonrpc_flight_mutex);
+    g_free (key);
+    *leader = FALSE;
+    return flight;
+  }
+
+  /* New call */
+  flight = g_slice_new0 (MeloJSONRPCFlight);
+  flight->key = key;
+  g_hash_table_insert (melo_jsonrpc_flights, key, flight);
+
+  G_UNLOCK (melo_jsonrpc_flight_mutex);
+
+  *leader = TRUE;
+  return flight;
+}
+
+static void
+melo_jsonrpc_flight_finish (MeloJSONRPCFlight *flight, const gchar *body,
+                            gsize length)
+{
+  MeloJSONRPCCompletion *completion;
+  MeloJSONRPCWriterMark mark;
+  MeloJSONRPCWriter *w;
+  GList *waiters, *l;
+
+  /* Remove call: new calls will not join it anymore */
+  G_LOCK (melo_jsonrpc_flight_mutex);
+  g_hash_table_remove (melo_jsonrpc_flights, flight->key);
+  waiters = flight->waiters;
+  G_UNLOCK (melo_jsonrpc_flight_mutex);
+
+  /* Send shared result to all waiting calls */
+  if (waiters) {
+    w = melo_jsonrpc_writer_acquire ();
+    melo_jsonrpc_writer_mark (w, &mark);
+    for (l = waiters; l != NULL; l = l->next) {
+      completion = l->data;
+      melo_jsonrpc_write_response_begin (w);
+      g_string_append_len (w->str, body, length);
+      melo_jsonrpc_write_response_end (w, completion->id, completion->nid);
+      melo_jsonrpc_completion_send (completion, w, &mark);
+    }
+    melo_jsonrpc_writer_release (w);
+    g_list_free (waiters);
+  }
+
+  /* Free call */
+  g_free (flight->key);
+  g_slice_free (MeloJSONRPCFlight, flight);
+}
+
+static void
+melo_jsonrpc_call (MeloJSONRPCCall *call, MeloJSONRPCInternalMethod *m,
+                   const gchar *method, JsonNode *params, JsonNode **result,
+                   JsonNode **error)
+{
+  MeloJSONRPCCall *prev_call;
+
+  /* Set current call for melo_jsonrpc_defer() and the compiled params */
+  prev_call = g_private_get (&melo_jsonrpc_call_key);
+  g_private_set (&melo_jsonrpc_call_key, call);
+
+  /* Call user callback */
+  call->method = m;
+  call->start = g_get_monotonic_time ();
+  m->callback (method, m->params, params, result, error, m->user_data);
+
+  /* Deferred call is counted by melo_jsonrpc_complete() */
+  if (!call->completion)
+    melo_jsonrpc_stats_add (m, g_get_monotonic_time () - call->start, *error);
+
+  /* Restore previous call */
+  g_private_set (&melo_jsonrpc_call_key, prev_call);
+}
+
+/* Parse JSON-RPC request */
+static MeloJSONRPCResponse
+melo_jsonrpc_parse_node (JsonNode *node, MeloJSONRPCWriter *w,
+                         MeloJSONRPCRequest *req, guint index)
+{
+  MeloJSONRPCInternalMethod *m = NULL;
+  MeloJSONRPCFlight *flight = NULL;
+  MeloJSONRPCWriterMark mark;
+  MeloJSONRPCWriter *prev_writer;
+  MeloJSONRPCCall call = { 0 };
+  gboolean overflow;
+  gboolean leader;
+  gsize body;
+  JsonNode *result = NULL;
+  JsonNode *error = NULL;
+  JsonNode *params;
+  JsonObject *obj;
+  const char *version;
+  const char *method;
+  const char *id = NULL;
+  gint64 nid = -1;
+
+  /* Not an object */
+  if (JSON_NODE_TYPE (node) != JSON_NODE_OBJECT)
+    goto invalid;
+
+  /* Get object from nide */
+  obj = json_node_get_object (node);
+  if (!obj)
+    goto internal;
+
+  /* Check if jsonrpc is present */
+  if (!json_object_has_member (obj, "jsonrpc"))
+    goto invalid;
+
+  /* Check JSON-RPC version */
+  version = json_object_get_string_member (obj, "jsonrpc");
+  if (!version || strcmp (version, "2.0"))
+    goto invalid;
+
+  /* Check if method is present */
+  if (!json_object_has_member (obj, "method"))
+    goto invalid;
+
+  /* Get method */
+  method = json_object_get_string_member (obj, "method");
+  if (!method)
+    goto invalid;
+
+  /* Get params */
+  params = json_object_get_member (obj, "params");
+  if (params) {
+    JsonNodeType type;
+
+    /* Check params type: only object or array allowed */
+    type = json_node_get_node_type (params);
+    if (type != JSON_NODE_ARRAY && type != JSON_NODE_OBJECT)
+      goto invalid;
+  }
+
+  /* Get registered method: it stays valid until its release */
+  m = melo_jsonrpc_method_acquire (method);
+
+  /* Check if id is present */
+  if (!json_object_has_member (obj, "id")) {
+    /* This is a notification: try to call callback */
+    if (m) {
+      call.notification = TRUE;
+      melo_jsonrpc_call (&call, m, method, params, &result, &error);
+      melo_jsonrpc_method_release (m);
+    }
+    if (error)
+      json_node_free (error);
+    if (result)
+      json_node_free (result);
+    return MELO_JSONRPC_RESPONSE_NONE;
+  }
+
+  /* Get id */
+  nid = json_object_get_int_member (obj, "id");
+  id = json_object_get_string_member (obj, "id");
+
+  /* No callback provided */
+  if (!m)
+    goto not_found;
+
+  /* Same read-only call in progress: share its result */
+  if (m->flags & MELO_JSONRPC_FLAG_READ_ONLY) {
+    flight = melo_jsonrpc_flight_join (w, method, params, req, index, id, nid,
+                                       &leader);
+    if (!leader) {
+      melo_jsonrpc_method_release (m);
+      return MELO_JSONRPC_RESPONSE_DEFERRED;
+    }
+  }
+
+  /* Begin response */
+  melo_jsonrpc_writer_mark (w, &mark);
+  melo_jsonrpc_write_response_begin (w);
+  body = w->str->len;
+
+  /* Let callback write its result directly into the response */
+  melo_jsonrpc_writer_set_member_name (w, "result");
+  prev_writer = g_private_get (&melo_jsonrpc_result_writer_key);
+  g_private_set (&melo_jsonrpc_result_writer_key, w);
+
+  /* Call method */
+  call.req = req;
+  call.index = index;
+  call.id = id;
+  call.nid = nid;
+  call.flight = flight;
+  melo_jsonrpc_call (&call, m, method, params, &result, &error);
+  melo_jsonrpc_method_release (m);
+  g_private_set (&melo_jsonrpc_result_writer_key, prev_writer);
+
+  /* Response will be generated by melo_jsonrpc_complete(): the completion
+   * can already be freed, and it finishes the flight.
+   */
+  if (call.completion) {
+    melo_jsonrpc_writer_rewind (w, &mark);
+    if (error)
+      json_node_free (error);
+    if (result)
+      json_node_free (result);
+    return MELO_JSONRPC_RESPONSE_DEFERRED;
+  }
+
+  /* Result has not been written by the callback */
+  if (error || w->member || w->depth != mark.depth + 1 || w->overflow) {
+    /* Remove partial result and add error or result */
+    overflow = w->overflow;
+    melo_jsonrpc_writer_rewind (w, &mark);
+    melo_jsonrpc_write_response_begin (w);
+    if (!overflow)
+      melo_jsonrpc_write_response_body (w, result, error);
+
+    /* Result is too deep to be serialized */
+    if (overflow || w->overflow)
+      melo_jsonrpc_write_response_overflow (w, &mark);
+  }
+  if (error)
+    json_node_free (error);
+  if (result)
+    json_node_free (result);
+
+  /* Send result to identical calls */
+  if (flight)
+    melo_jsonrpc_flight_finish (flight, w->str->str + body,
+                                w->str->len - body);
+
+  /* End response */
+  melo_jsonrpc_write_response_end (w, id, nid);
+
+  return MELO_JSONRPC_RESPONSE_READY;
+
+invalid:
+  melo_jsonrpc_write_error (w, NULL, -1, MELO_JSONRPC_ERROR_INVALID_REQUEST,
+                            "Invalid request");
+  return MELO_JSONRPC_RESPONSE_READY;
+not_found:
+  melo_jsonrpc_write_error (w, id, nid, MELO_JSONRPC_ERROR_METHOD_NOT_FOUND,
+                            "Method not found");
+  return MELO_JSONRPC_RESPONSE_READY;
+internal:
+  melo_jsonrpc_write_error (w, id, -1, MELO_JSONRPC_ERROR_INTERNAL_ERROR,
+                            "Internal error");
+  return MELO_JSONRPC_RESPONSE_READY;
+}
+
+/* Batch requests */
+static gboolean
+melo_jsonrpc_batch_is_concurrent (JsonNode *node)
+{
+  MeloJSONRPCInternalMethod *m = NULL;
+  const gchar *method = NULL;
+  gboolean concurrent = TRUE;
+  GHashTable *methods;
+  JsonObject *obj;
+  guint epoch;
+
+  /* Get method name */
+  if (JSON_NODE_TYPE (node) == JSON_NODE_OBJECT) {
+    obj = json_node_get_object (node);
+    if (obj && json_object_has_member (obj, "method"))
+      method = json_object_get_string_member (obj, "method");
+  }
+
+  /* Invalid request: no method is called */
+  if (!method)
+    return TRUE;
+
+  /* Get method flags */
+  epoch = melo_jsonrpc_read_lock ();
+  methods = g_atomic_pointer_get (&melo_jsonrpc_methods);
+  if (methods)
+    m = g_hash_table_lookup (methods, method);
+  if (m)
+    concurrent = m->flags & MELO_JSONRPC_FLAG_CONCURRENT;
+  melo_jsonrpc_read_unlock (epoch);
+
+  return concurrent;
+}
+
+static void
+melo_jsonrpc_batch_process (MeloJSONRPCRequest *req, MeloJSONRPCWriter *w)
+{
+  MeloJSONRPCWriterMark mark;
+  MeloJSONRPCResponse res;
+  JsonNode *node;
+  guint i;
+
+  /* Responses are serialized after current content of the writer */
+  melo_jsonrpc_writer_mark (w, &mark);
+
+  g_mutex_lock (&req->mutex);
+  while (req->next < req->count) {
+    /* A call which is not concurrent is an ordering barrier: it is started
+     * once all previous calls are done, and next calls wait for its end.
+     */
+    if (req->barrier || (!req->concurrent[req->next] && req->active)) {
+      g_cond_wait (&req->cond, &req->mutex);
+      continue;
+    }
+
+    /* Take next request of the batch */
+    i = req->next++;
+    req->active++;
+    req->barrier = !req->concurrent[i];
+    g_mutex_unlock (&req->mutex);
+
+    /* Process request and keep its response */
+    node = json_array_get_element (req->array, i);
+    res = melo_jsonrpc_parse_node (node, w, req, i);
+    if (res == MELO_JSONRPC_RESPONSE_READY)
+      melo_jsonrpc_request_set_response (req, i, w, &mark);
+
+    /* Request done: wake up waiting workers */
+    g_mutex_lock (&req->mutex);
+    req->active--;
+    if (!req->concurrent[i])
+      req->barrier = FALSE;
+    g_cond_broadcast (&req->cond);
+  }
+  g_mutex_unlock (&req->mutex);
+}
+
+static void
+melo_jsonrpc_batch_func (gpointer data, gpointer user_data)
+{
+  MeloJSONRPCRequest *req = data;
+  MeloJSONRPCWriter *w;
+
+  /* Help to process remaining requests of the batch */
+  w = melo_jsonrpc_writer_acquire ();
+  melo_jsonrpc_batch_process (req, w);
+  melo_jsonrpc_writer_release (w);
+
+  /* Release request */
+  melo_jsonrpc_request_unref (req);
+}
+
+static GThreadPool *
+melo_jsonrpc_batch_get_pool (void)
+{
+  GThreadPool *pool;
+
+  /* Create thread pool on first batch */
+  G_LOCK (melo_jsonrpc_batch_mutex);
+  if (!melo_jsonrpc_batch_pool)
+    melo_jsonrpc_batch_pool = g_thread_pool_new (melo_jsonrpc_batch_func, NULL,
+                                                 MELO_JSONRPC_BATCH_THREADS,
+                                                 FALSE, NULL);
+  pool = melo_jsonrpc_batch_pool;
+  G_UNLOCK (melo_jsonrpc_batch_mutex);
+
+  return pool;
+}
+
+static void
+melo_jsonrpc_parse_batch (MeloJSONRPCRequest *req, JsonArray *array,
+                          guint count, MeloJSONRPCWriter *w)
+{
+  GThreadPool *pool = NULL;
+  guint i, concurrent = 0;
+  JsonNode *node;
+
+  /* Setup batch */
+  req->array = json_array_ref (array);
+  melo_jsonrpc_request_set_count (req, count);
+
+  /* Only the concurrent calls are processed at the same time */
+  req->concurrent = g_new (gboolean, count);
+  for (i = 0; i < count; i++) {
+    node = json_array_get_element (array, i);
+    req->concurrent[i] = melo_jsonrpc_batch_is_concurrent (node);
+    if (req->concurrent[i])
+      concurrent++;
+  }
+
+  /* Start workers: the calling thread is one of them */
+  if (concurrent > 1)
+    pool = melo_jsonrpc_batch_get_pool ();
+  for (i = 1; pool && i < MIN (concurrent, MELO_JSONRPC_BATCH_CONCURRENCY);
+       i++) {
+    g_atomic_int_inc (&req->ref_count);
+    if (!g_thread_pool_push (pool, req, NULL)) {
+      melo_jsonrpc_request_unref (req);
+      break;
+    }
+  }
+
+  /* Process requests and wait end of the ones taken by other workers */
+  melo_jsonrpc_batch_process (req, w);
+  g_mutex_lock (&req->mutex);
+  while (req->active)
+    g_cond_wait (&req->cond, &req->mutex);
+  g_mutex_unlock (&req->mutex);
+
+  /* Send response if no call has been deferred or all are completed */
+  melo_jsonrpc_request_complete_call (req, w);
+}
+
+/**
+ * melo_jsonrpc_get_request_priority:
+ * @request: the JSON-RPC requrest serialized in a string
+ * @length: the length og @request, can be -1 for null-terminated string
+ *
+ * Find the priority class of a request before parsing it: the method names
+ * are extracted with a quick scan of @request, without building any
+ * #JsonNode. Only the "method" members of the request object (or of the
+ * objects of a batch) are considered, so a "method" name in the parameters
+ * cannot change the class. The request is in the
+ * %MELO_JSONRPC_PRIORITY_CONTROL class only if all its methods (for a batch)
+ * are in this class.
+ *
+ * Returns: the #MeloJSONRPCPriority of the request.
+ */
+MeloJSONRPCPriority
+melo_jsonrpc_get_request_priority (const gchar *request, gsize length)
+{
+  MeloJSONRPCPriority priority = MELO_JSONRPC_PRIORITY_DEFAULT;
+  MeloJSONRPCInternalMethod *m;
+  const gchar *p, *end, *name;
+  GHashTable *methods;
+  gchar method[128];
+  gint depth = 0, target;
+  guint epoch;
+  gsize len;
+
+  /* Get end of request */
+  if (length == (gsize) -1)
+    length = strlen (request);
+  end = request + length;
+
+  /* The methods are members of the request object, or of the request objects
+   * of a batch: the names found at any other depth (in the parameters) are
+   * ignored.
+   */
+  p = request;
+  while (p < end && g_ascii_isspace (*p))
+    p++;
+  target = p < end && *p == '[' ? 2 : 1;
+
+  epoch = melo_jsonrpc_read_lock ();
+  methods = g_atomic_pointer_get (&melo_jsonrpc_methods);
+
+  /* Find all method names */
+  while (methods && p < end) {
+    /* Track depth */
+    if (*p == '{' || *p == '[') {
+      depth++;
+      p++;
+      continue;
+    } else if (*p == '}' || *p == ']') {
+      depth--;
+      p++;
+      continue;
+    } else if (*p != '"') {
+      p++;
+      continue;
+    }
+
+    /* Skip string */
+    name = ++p;
+    while (p < end && *p != '"') {
+      if (*p == '\\')
+        p++;
+      p++;
+    }
+    if (p >= end)
+      goto default_priority;
+    len = p++ - name;
+
+    /* Not a method member name */
+    if (depth != target || len != 6 || memcmp (name, "method", 6))
+      continue;
+    while (p < end && g_ascii_isspace (*p))
+      p++;
+    if (p >= end || *p != ':')
+      continue;
+
+    /* Skip separator */
+    p++;
+    while (p < end && g_ascii_isspace (*p))
+      p++;
+    if (p >= end || *p++ != '"')
+      goto default_priority;
+
+    /* Get method name */
+    name = p;
+    while (p < end && *p != '"' && *p != '\\')
+      p++;
+    len = p - name;
+    if (p >= end || *p++ != '"' || len >= sizeof (method))
+      goto default_priority;
+    memcpy (method, name, len);
+    method[len] = '\0';
+
+    /* Check method priority */
+    m = g_hash_table_lookup (methods, method);
+    if (!m || m->priority != MELO_JSONRPC_PRIORITY_CONTROL)
+      goto default_priority;
+    priority = MELO_JSONRPC_PRIORITY_CONTROL;
+  }
+
+  melo_jsonrpc_read_unlock (epoch);
+  return priority;
+
+default_priority:
+  melo_jsonrpc_read_unlock (epoch);
+  return MELO_JSONRPC_PRIORITY_DEFAULT;
+}
+
+/**
+ * melo_jsonrpc_parse_request_async:
+ * @request: the JSON-RPC requrest serialized in a string
+ * @length: the length og @request, can be -1 for null-terminated string
+ * @func: the function to call for each chunk of the response
+ * @done: the function to call when the response is complete
+ * @user_data: the data to pass to @func and @done
+ *
+ * Same as melo_jsonrpc_parse_request_chunked() but the function does not wait
+ * for the methods which deferred their result with melo_jsonrpc_defer(). The
+ * chunks of the response are passed to @func and then @done is called, from
+ * the thread which completes the last call of the request. When no method
+ * deferred its result, it happens before this function returns.
+ *
+ * The @done is always called once, with %TRUE as first argument if a response
+ * has been generated, or %FALSE otherwise (for a notification).
+ */
+void
+melo_jsonrpc_parse_request_async (const gchar *request, gsize length,
+                                  MeloJSONRPCChunkFunc func,
+                                  MeloJSONRPCDoneFunc done, gpointer user_data)
+{
+  MeloJSONRPCRequest *req;
+  MeloJSONRPCResponse res;
+  MeloJSONRPCWriter *w;
+  JsonParser *parser;
+  JsonNodeType type;
+  JsonNode *node;
+
+  /* Get a writer and create request context */
+  w = melo_jsonrpc_writer_acquire ();
+  req = melo_jsonrpc_request_new (func, done, user_data);
+
+  /* Create parser */
+  parser = json_parser_new ();
+  if (!parser) {
+    melo_jsonrpc_write_error (w, NULL, -1, MELO_JSONRPC_ERROR_INTERNAL_ERROR,
+                              "Internal error");
+    goto error;
+  }
+
+  /* Parse request */
+  if (!json_parser_load_from_data (parser, request, length, NULL) ||
+      (node = json_parser_get_root (parser)) == NULL) {
+    melo_jsonrpc_write_error (w, NULL, -1, MELO_JSONRPC_ERROR_PARSE_ERROR,
+                              "Parse error");
+    goto error;
+  }
+
+  /* Get node type */
+  type = json_node_get_node_type (node);
+
+  /* Parse node */
+  if (type == JSON_NODE_OBJECT) {
     /* Parse single request */
-    res = melo_jsonrpc_parse_node (req);
+    melo_jsonrpc_request_set_count (req, 1);
+    res = melo_jsonrpc_parse_node (node, w, req, 0);
+
+    /* Response is ready: send it directly */
+    if (res != MELO_JSONRPC_RESPONSE_DEFERRED) {
+      melo_jsonrpc_writer_flush (w, func, user_data);
+      if (done)
+        done (res == MELO_JSONRPC_RESPONSE_READY, user_data);
+      goto end;
+    }
+
+    /* Send response if the call is already completed */
+    melo_jsonrpc_request_complete_call (req, w);
   } else if (type == JSON_NODE_ARRAY) {
     /* Parse multiple requests: batch */
     JsonArray *req_array;
-    JsonArray *res_array;
-    JsonNode *node;
-    guint count, i;
+    guint count;
+
+    /* Get array from node */
+    req_array = json_node_get_array (node);
+    count = json_array_get_length (req_array);
+    if (!count) {
+      melo_jsonrpc_write_error (w, NULL, -1, MELO_JSONRPC_ERROR_INVALID_REQUEST,
+                                "Invalid request");
+      goto error;
+    }
+
+    /* Process concurrent requests at the same time */
+    melo_jsonrpc_parse_batch (req, req_array, count, w);
+  } else {
+    melo_jsonrpc_write_error (w, NULL, -1, MELO_JSONRPC_ERROR_INVALID_REQUEST,
+                              "Invalid request");
+    goto error;
+  }
+
+end:
+  if (parser)
+    g_object_unref (parser);
+
+  /* Release request context and writer */
+  melo_jsonrpc_request_unref (req);
+  melo_jsonrpc_writer_release (w);
+  return;
+
+error:
+  /* Send error response */
+  melo_jsonrpc_writer_flush (w, func, user_data);
+  if (done)
+    done (TRUE, user_data);
+  goto end;
+}
+
+typedef struct {
+  GMutex mutex;
+  GCond cond;
+  gboolean done;
+  gboolean response;
+  MeloJSONRPCChunkFunc func;
+  gpointer user_data;
+} MeloJSONRPCSyncRequest;
+
+static void
+melo_jsonrpc_sync_chunk (const gchar *data, gsize length, gpointer user_data)
+{
+  MeloJSONRPCSyncRequest *sync = user_data;
+
+  /* Forward chunk */
+  if (sync->func)
+    sync->func (data, length, sync->user_data);
+}
+
+static void
+melo_jsonrpc_sync_done (gboolean response, gpointer user_data)
+{
+  MeloJSONRPCSyncRequest *sync = user_data;
+
+  /* Wake up caller */
+  g_mutex_lock (&sync->mutex);
+  sync->response = response;
+  sync->done = TRUE;
+  g_cond_signal (&sync->cond);
+  g_mutex_unlock (&sync->mutex);
+}
+
+static void
+melo_jsonrpc_string_append (const gchar *data, gsize length,
+                            gpointer user_data)
+{
+  g_string_append_len ((GString *) user_data, data, length);
+}
+
+/**
+ * melo_jsonrpc_parse_request:
+ * @request: the JSON-RPC requrest serialized in a string
+ * @length: the length og @request, can be -1 for null-terminated string
+ * @error: a pointer to a #GError which is set if an error occurred
+ *
+ * Parse a string @request containing a JSON-RPC serialized request, call the
+ * registered callback which match the request method and present the result
+ * as a JSON-RPC response serialized in a string.
+ * If the method is not registered, a JSON-RPC response is generated with the
+ * error MELO_JSONRPC_ERROR_METHOD_NOT_FOUND.
+ *
+ * Returns: (transfer full): a string containing the serialized #JsonNode
+ * corresponding to the respond to the JSON-RPC request. Use g_free() after
+ * usage.
+ */
+gchar *
+melo_jsonrpc_parse_request (const gchar *request, gsize length, GError **error)
+{
+  GString *str;
+
+  /* Parse request and collect response */
+  str = g_string_new (NULL);
+  if (!melo_jsonrpc_parse_request_chunked (request, length,
+                                           melo_jsonrpc_string_append, str)) {
+    g_string_free (str, TRUE);
+    return NULL;
+  }
+
+  return g_string_free (str, FALSE);
+}
+
+/**
+ * melo_jsonrpc_parse_request_chunked:
+ * @request: the JSON-RPC requrest serialized in a string
+ * @length: the length og @request, can be -1 for null-terminated string
+ * @func: the function to call for each chunk of the response
+ * @user_data: the data to pass to @func
+ *
+ * Same as melo_jsonrpc_parse_request() but the response is not returned as a
+ * new string: it is serialized in a buffer reused by the calling thread and
+ * it is passed to @func in one or more chunks. It avoids a copy of the whole
+ * response for big results, and the chunks can be appended directly to the
+ * body of the transport message.
+ *
+ * If a method deferred its result with melo_jsonrpc_defer(), this function
+ * blocks until melo_jsonrpc_complete() is called for it.
+ *
+ * Returns: %TRUE if a response has been generated, %FALSE otherwise (for a
+ * notification).
+ */
+gboolean
+melo_jsonrpc_parse_request_chunked (const gchar *request, gsize length,
+                                    MeloJSONRPCChunkFunc func,
+                                    gpointer user_data)
+{
+  MeloJSONRPCSyncRequest sync = { 0 };
+
+  /* Init synchronous request */
+  g_mutex_init (&sync.mutex);
+  g_cond_init (&sync.cond);
+  sync.func = func;
+  sync.user_data = user_data;
+
+  /* Parse request and send response chunks */
+  melo_jsonrpc_parse_request_async (request, length, melo_jsonrpc_sync_chunk,
+                                    melo_jsonrpc_sync_done, &sync);
+
+  /* Wait end of deferred calls */
+  g_mutex_lock (&sync.mutex);
+  while (!sync.done)
+    g_cond_wait (&sync.cond, &sync.mutex);
+  g_mutex_unlock (&sync.mutex);
+
+  /* Clear synchronous request */
+  g_mutex_clear (&sync.mutex);
+  g_cond_clear (&sync.cond);
+
+  return sync.response;
+}
 
-    /* Get array from node */
-    req_array = json_node_get_array (req);
-    count = json_array_get_length (req_array);
-    if (!count)
-      goto invalid;
+/**
+ * melo_jsonrpc_defer:
+ *
+ * Defer the result of the current call. This function can only be called from
+ * a #MeloJSONRPCCallback, which must then return without setting any result or
+ * error. The result is provided later, from any thread, by calling
+ * melo_jsonrpc_complete() with the returned handle. It allows slow methods to
+ * release the thread which is processing the request.
+ *
+ * The @params passed to the callback are only valid during the callback call,
+ * they must be copied if needed to complete the call.
+ *
+ * Returns: (transfer full): a #MeloJSONRPCCompletion to pass to
+ * melo_jsonrpc_complete(), or %NULL if not called from a #MeloJSONRPCCallback.
+ */
+MeloJSONRPCCompletion *
+melo_jsonrpc_defer (void)
+{
+  MeloJSONRPCCompletion *completion;
+  MeloJSONRPCCall *call;
 
-    /* Create a new array for response */
-    res_array = json_array_sized_new (count);
-    res = json_node_new (JSON_NODE_ARRAY);
-    json_node_take_array (res, res_array);
+  /* Get current call */
+  call = g_private_get (&melo_jsonrpc_call_key);
+  if (!call || call->completion)
+    return NULL;
 
-    /* Parse each elements of array */
-    for (i = 0; i < count; i++) {
-      /* Get element */
-      node = json_array_get_element (req_array, i);
+  /* Create completion handle: no response for notifications */
+  if (!call->notification)
+    completion = melo_jsonrpc_completion_new (call->req, call->index,
+                                              call->id, call->nid);
+  else
+    completion = g_slice_new0 (MeloJSONRPCCompletion);
+  call->completion = completion;
 
-      /* Process requesit */
-      node = melo_jsonrpc_parse_node (node);
+  /* Identical calls wait for the result of this call */
+  completion->flight = call->flight;
 
-      /* Add new response to array */
-      if (node)
-        json_array_add_element (res_array, node);
-    }
+  /* Keep method for statistics */
+  completion->method = call->method;
+  completion->start = call->start;
+  g_atomic_int_inc (&call->method->ref_count);
 
-    /* Check if array is empty */
-    count = json_array_get_length (res_array);
-    if (!count) {
-      json_node_free (res);
-      goto empty;
-    }
-  } else
-    goto invalid;
+  return completion;
+}
+
+/**
+ * melo_jsonrpc_complete:
+ * @completion: the #MeloJSONRPCCompletion returned by melo_jsonrpc_defer()
+ * @result: (transfer full): the result of the call, or %NULL
+ * @error: (transfer full): the error of the call, or %NULL
+ *
+ * Complete a call deferred with melo_jsonrpc_defer(). As for a synchronous
+ * #MeloJSONRPCCallback, only one of @result or @error should be set. This
+ * function can be called from any thread and takes the ownership of @result
+ * and @error. The @completion is freed by this function.
+ *
+ * When it is the last pending call of the request, the response is sent
+ * before this function returns.
+ */
+void
+melo_jsonrpc_complete (MeloJSONRPCCompletion *completion, JsonNode *result,
+                       JsonNode *error)
+{
+  MeloJSONRPCWriterMark mark;
+  MeloJSONRPCWriter *w;
+  gsize body;
+
+  /* Count deferred call in method statistics */
+  if (completion->method) {
+    melo_jsonrpc_stats_add (completion->method,
+                            g_get_monotonic_time () - completion->start, error);
+    melo_jsonrpc_method_release (completion->method);
+    completion->method = NULL;
+  }
 
-  /* No response */
-  if (!res)
-    goto empty;
+  /* Notification: no response */
+  if (!completion->req) {
+    g_slice_free (MeloJSONRPCCompletion, completion);
+    goto end;
+  }
 
-  /* Generate final string */
-  str = melo_jsonrpc_node_to_string (res);
+  /* Serialize response */
+  w = melo_jsonrpc_writer_acquire ();
+  melo_jsonrpc_writer_mark (w, &mark);
+  melo_jsonrpc_write_response_begin (w);
+  body = w->str->len;
+  melo_jsonrpc_write_response_body (w, result, error);
 
-  /* Free parser and root node */
-  json_node_free (res);
-  g_object_unref (parser);
+  /* Result is too deep to be serialized */
+  if (w->overflow)
+    melo_jsonrpc_write_response_overflow (w, &mark);
 
-  return str;
+  /* Send result to identical calls */
+  if (completion->flight)
+    melo_jsonrpc_flight_finish (completion->flight, w->str->str + body,
+                                w->str->len - body);
 
-parse_error:
-  g_object_unref (parser);
-  return melo_jsonrpc_build_error_str (MELO_JSONRPC_ERROR_PARSE_ERROR,
-                                       "Parse error");
-invalid:
-  g_object_unref (parser);
-  return melo_jsonrpc_build_error_str (MELO_JSONRPC_ERROR_INVALID_REQUEST,
-                                       "Invalid request");
-empty:
-  g_object_unref (parser);
-  return NULL;
+  /* Send response */
+  melo_jsonrpc_write_response_end (w, completion->id, completion->nid);
+  melo_jsonrpc_completion_send (completion, w, &mark);
+  melo_jsonrpc_writer_release (w);
+
+end:
+  /* Free nodes */
+  if (error)
+    json_node_free (error);
+  if (result)
+    json_node_free (result);
 }
 
 /* Params utils */
 static gboolean
-melo_jsonrpc_add_node (JsonNode *node, JsonObject *schema,
-                       JsonObject *obj, JsonArray *array)
+melo_jsonrpc_get_value (JsonNode *node, const MeloJSONRPCParam *desc,
+                        MeloJSONRPCValue *value)
 {
   GType vtype = G_TYPE_INVALID;
-  const gchar *s_name;
-  const gchar *s_type;
   JsonNodeType type;
 
-  /* Get name and type from schema */
-  s_name = json_object_get_string_member (schema, "name");
-  s_type = json_object_get_string_member (schema, "type");
-  if (!s_name || !s_type)
-    return FALSE;
-
   /* Get type */
   type = json_node_get_node_type (node);
   if (type == JSON_NODE_VALUE)
     vtype = json_node_get_value_type (node);
 
-  /* Check type:
-   * We check only first letter of the type string.
-   */
-  switch (s_type[0]) {
-    case 'b':
-      /* Boolean: check type */
+  /* Check type and get value */
+  switch (desc->type) {
+    case MELO_JSONRPC_PARAM_TYPE_BOOLEAN:
       if (vtype != G_TYPE_BOOLEAN)
         return FALSE;
-
-      /* Add to object / array */
-      if (obj || array) {
-        gboolean v;
-        v = json_node_get_boolean (node);
-        if (obj)
-          json_object_set_boolean_member (obj, s_name, v);
-        else
-          json_array_add_boolean_element (array, v);
-        break;
-      }
+      value->b = json_node_get_boolean (node);
       break;
-    case 'i':
-      /* Integer: check type */
+    case MELO_JSONRPC_PARAM_TYPE_INTEGER:
       if (vtype != G_TYPE_INT64)
         return FALSE;
-
-      /* Add to object / array */
-      if (obj || array) {
-        gint64 v;
-        v = json_node_get_int (node);
-        if (obj)
-          json_object_set_int_member (obj, s_name, v);
-        else
-          json_array_add_int_element (array, v);
-      }
+      value->i = json_node_get_int (node);
       break;
-    case 'd':
-      /* Double: check type */
+    case MELO_JSONRPC_PARAM_TYPE_DOUBLE:
       if (vtype != G_TYPE_DOUBLE)
         return FALSE;
-
-      /* Add to object / array */
-      if (obj || array) {
-        gdouble v;
-        v = json_node_get_double (node);
-        if (obj)
-          json_object_set_double_member (obj, s_name, v);
-        else
-          json_array_add_double_element (array, v);
-      }
+      value->d = json_node_get_double (node);
       break;
-    case 's':
-      /* String: check type */
+    case MELO_JSONRPC_PARAM_TYPE_STRING:
       if (vtype != G_TYPE_STRING)
         return FALSE;
-
-      /* Add to object / array */
-      if (obj || array) {
-        const gchar *v;
-        v = json_node_get_string (node);
-        if (obj)
-          json_object_set_string_member (obj, s_name, v);
-        else
-          json_array_add_string_element (array, v);
-      }
+      value->s = json_node_get_string (node);
       break;
-    case 'o':
-      /* Object: check type */
+    case MELO_JSONRPC_PARAM_TYPE_OBJECT:
       if (type != JSON_NODE_OBJECT)
         return FALSE;
-
-      /* Add to object / array */
-      if (obj || array) {
-        JsonObject *v;
-        v = json_node_dup_object (node);
-        if (obj)
-          json_object_set_object_member (obj, s_name, v);
-        else
-          json_array_add_object_element (array, v);
-      }
+      value->o = json_node_get_object (node);
       break;
-    case 'a':
-      /* Array: check type */
+    case MELO_JSONRPC_PARAM_TYPE_ARRAY:
       if (type != JSON_NODE_ARRAY)
         return FALSE;
-
-      /* Add to object / array */
-      if (obj || array) {
-        JsonArray *v;
-        v = json_node_dup_array (node);
-        if (obj)
-          json_object_set_array_member (obj, s_name, v);
-        else
-          json_array_add_array_element (array, v);
-      }
+      value->a = json_node_get_array (node);
       break;
     default:
       return FALSE;
   }
+
   return TRUE;
 }
 
+static void
+melo_jsonrpc_add_value (const MeloJSONRPCParam *desc,
+                        const MeloJSONRPCValue *value, JsonObject *obj,
+                        JsonArray *array)
+{
+  /* Add to object / array */
+  switch (desc->type) {
+    case MELO_JSONRPC_PARAM_TYPE_BOOLEAN:
+      if (obj)
+        json_object_set_boolean_member (obj, desc->name, value->b);
+      else
+        json_array_add_boolean_element (array, value->b);
+      break;
+    case MELO_JSONRPC_PARAM_TYPE_INTEGER:
+      if (obj)
+        json_object_set_int_member (obj, desc->name, value->i);
+      else
+        json_array_add_int_element (array, value->i);
+      break;
+    case MELO_JSONRPC_PARAM_TYPE_DOUBLE:
+      if (obj)
+        json_object_set_double_member (obj, desc->name, value->d);
+      else
+        json_array_add_double_element (array, value->d);
+      break;
+    case MELO_JSONRPC_PARAM_TYPE_STRING:
+      if (obj)
+        json_object_set_string_member (obj, desc->name, value->s);
+      else
+        json_array_add_string_element (array, value->s);
+      break;
+    case MELO_JSONRPC_PARAM_TYPE_OBJECT:
+      if (obj)
+        json_object_set_object_member (obj, desc->name,
+                                       json_object_ref (value->o));
+      else
+        json_array_add_object_element (array, json_object_ref (value->o));
+      break;
+    case MELO_JSONRPC_PARAM_TYPE_ARRAY:
+      if (obj)
+        json_object_set_array_member (obj, desc->name,
+                                      json_array_ref (value->a));
+      else
+        json_array_add_array_element (array, json_array_ref (value->a));
+      break;
+  }
+}
+
 static gboolean
-melo_jsonrpc_get_json_node (JsonArray *schema_params, JsonNode *params,
-                            JsonObject *obj, JsonArray *array,
-                            JsonNode **error)
+melo_jsonrpc_parse_params (const MeloJSONRPCParam *desc, guint count,
+                           JsonNode *params, MeloJSONRPCValue *values,
+                           JsonObject *obj, JsonArray *array,
+                           JsonNode **error)
 {
-  JsonObject *schema;
-  JsonNodeType type;
+  MeloJSONRPCValue value;
+  guint params_count = 0;
+  JsonObject *o = NULL;
+  JsonArray *a = NULL;
   JsonNode *node;
-  guint count, i;
-
-  /* Check schema */
-  if (!schema_params)
-    return FALSE;
+  guint i;
 
   /* No params to check */
   if (!params) {
@@ -660,357 +2253,755 @@ melo_jsonrpc_get_json_node (JsonArray *schema_params, JsonNode *params,
     return FALSE;
   }
 
-  /* Get element count from schema */
+  /* Get params as an object or an array */
+  if (JSON_NODE_TYPE (params) == JSON_NODE_OBJECT)
+    o = json_node_get_object (params);
+  else if (JSON_NODE_TYPE (params) == JSON_NODE_ARRAY) {
+    a = json_node_get_array (params);
+    params_count = json_array_get_length (a);
+  } else
+    return TRUE;
+
+  for (i = 0; i < count; i++) {
+    /* Get node */
+    if (o)
+      node = json_object_get_member (o, desc[i].name);
+    else
+      node = i < params_count ? json_array_get_element (a, i) : NULL;
+
+    /* Parameter not present */
+    if (!node) {
+      if (desc[i].required)
+        goto failed;
+
+      /* When not required:
+       *  - stop when there is no more parameters in array or when converting
+       *    to an array,
+       *  - skip otherwise.
+       */
+      if (a || array)
+        return TRUE;
+      continue;
+    }
+
+    /* Check node type and get value */
+    if (!melo_jsonrpc_get_value (node, &desc[i], &value))
+      goto failed;
+
+    /* Set value */
+    if (values)
+      values[i] = value;
+    if (obj || array)
+      melo_jsonrpc_add_value (&desc[i], &value, obj, array);
+  }
+  return TRUE;
+
+failed:
+  if (error && *error == NULL)
+    *error = melo_jsonrpc_build_error_node (MELO_JSONRPC_ERROR_INVALID_PARAMS,
+                                            "Invalid params");
+  return FALSE;
+}
+
+static gboolean
+melo_jsonrpc_get_json_node (JsonArray *schema_params, JsonNode *params,
+                            MeloJSONRPCValue *values, JsonObject *obj,
+                            JsonArray *array, JsonNode **error)
+{
+  MeloJSONRPCParam *desc;
+  MeloJSONRPCCall *call;
+  gboolean ret;
+  guint count;
+
+  /* Check schema */
+  if (!schema_params)
+    return FALSE;
+
+  /* Use schema compiled at registration of the method being called */
+  call = g_private_get (&melo_jsonrpc_call_key);
+  if (call && call->method && call->method->params == schema_params)
+    return melo_jsonrpc_parse_params (call->method->desc,
+                                      call->method->desc_count, params, values,
+                                      obj, array, error);
+
+  /* Compile schema for this call only */
+  if (!melo_jsonrpc_compile_params (schema_params, &desc, &count)) {
+    if (error && *error == NULL)
+      *error = melo_jsonrpc_build_error_node (MELO_JSONRPC_ERROR_INVALID_PARAMS,
+                                              "Invalid params");
+    return FALSE;
+  }
+  ret = melo_jsonrpc_parse_params (desc, count, params, values, obj, array,
+                                   error);
+  g_free (desc);
+
+  return ret;
+}
+
+/**
+ * melo_jsonrpc_check_params:
+ * @schema_params: the schema to use for parameters checking (see
+ *    #MeloJSONRPCMethod for more details)
+ * @params: the parameters to check
+ * @error: a pointer to a #JsonNode which is set with a valid JSON-RPC error if
+ *    an error has occurred
+ *
+ * Check if JSON-RPC parameters in @params are matching the schema in
+ * @schema_params.
+ *
+ * Returns: %TRUE if the parameters are valid, %FALSE otherwise.
+ */
+gboolean
+melo_jsonrpc_check_params (JsonArray *schema_params, JsonNode *params,
+                           JsonNode **error)
+{
+  return melo_jsonrpc_get_json_node (schema_params, params, NULL, NULL, NULL,
+                                     error);
+}
+
+/**
+ * melo_jsonrpc_get_object:
+ * @schema_params: the schema to use for parameters conversion (see
+ *    #MeloJSONRPCMethod for more details)
+ * @params: the parameters to convert
+ * @error: a pointer to a #JsonNode which is set with a valid JSON-RPC error if
+ *    an error has occurred
+ *
+ * Convert the #JsonNode containing the parameters into a #JsonObject with all
+ * members corresponding to each parameters.
+ *
+ * Returns: (transfer full): a new #JsonObject containing all parameters sorted
+ * by name, or %NULL if an error occurred. Use json_object_unref() after usage.
+ */
+JsonObject *
+melo_jsonrpc_get_object (JsonArray *schema_params, JsonNode *params,
+                         JsonNode **error)
+{
+  JsonObject *obj;
+
+  /* Allocate new object */
+  obj = json_object_new ();
+
+  /* Get node */
+  if (!melo_jsonrpc_get_json_node (schema_params, params, NULL, obj, NULL,
+                                   error)) {
+    json_object_unref (obj);
+    return NULL;
+  }
+
+  return obj;
+}
+
+/**
+ * melo_jsonrpc_get_array:
+ * @schema_params: the schema to use for parameters conversion (see
+ *    #MeloJSONRPCMethod for more details)
+ * @params: the parameters to convert
+ * @error: a pointer to a #JsonNode which is set with a valid JSON-RPC error if
+ *    an error has occurred
+ *
+ * Convert the #JsonNode containing the parameters into a #JsonArray with all
+ * items sorted as the provided schema.
+ *
+ * Returns: (transfer full): a new #JsonArray containing all parameters sorted
+ * as provided schema, or %NULL if an error occurred. Use json_array_unref()
+ * after usage.
+ */
+JsonArray *
+melo_jsonrpc_get_array (JsonArray *schema_params, JsonNode *params,
+                        JsonNode **error)
+{
+  JsonArray *array;
+  guint count;
+
+  /* Get array length */
   count = json_array_get_length (schema_params);
 
-  /* Get type */
-  type = json_node_get_node_type (params);
+  /* Allocate new array */
+  array = json_array_sized_new (count);
 
-  /* Already an object */
-  if (type == JSON_NODE_OBJECT) {
-    const gchar *name;
-    JsonObject *o;
+  /* Get array */
+  if (!melo_jsonrpc_get_json_node (schema_params, params, NULL, NULL, array,
+                                   error)) {
+    json_array_unref (array);
+    return NULL;
+  }
 
-    /* Get object */
-    o = json_node_get_object (params);
+  return array;
+}
 
-    /* Parse object */
-    for (i = 0; i < count; i++) {
-      /* Get next schema object */
-      schema = json_array_get_object_element (schema_params, i);
-      if (!schema)
-        goto failed;
+/**
+ * melo_jsonrpc_get_params:
+ * @schema_params: the schema to use for parameters conversion (see
+ *    #MeloJSONRPCMethod for more details)
+ * @params: the parameters to convert
+ * @values: a pointer to an array of #MeloJSONRPCValue to fill, with one entry
+ *    for each parameter of @schema_params, in the same order
+ * @error: a pointer to a #JsonNode which is set with a valid JSON-RPC error if
+ *    an error has occurred
+ *
+ * Check the parameters in @params against @schema_params and set each value
+ * in @values, at the index of the parameter in the schema. A structure with
+ * only #MeloJSONRPCValue members, declared in the order of the schema, can be
+ * used for @values. The optional parameters which are not present in @params
+ * are not touched, so @values should be initialized with default values
+ * before calling this function.
+ *
+ * When called from a #MeloJSONRPCCallback with its schema, the schema compiled
+ * during the registration of the method is used.
+ *
+ * The strings, #JsonObject and #JsonArray are not copied: they are owned by
+ * @params and are valid as long as @params is.
+ *
+ * Returns: %TRUE if the parameters are valid, %FALSE otherwise.
+ */
+gboolean
+melo_jsonrpc_get_params (JsonArray *schema_params, JsonNode *params,
+                         gpointer values, JsonNode **error)
+{
+  return melo_jsonrpc_get_json_node (schema_params, params, values, NULL, NULL,
+                                     error);
+}
 
-      /* Get parameter name */
-      name = json_object_get_string_member (schema, "name");
-      if (!name)
-        goto failed;
+/* Helpers */
+static JsonNode *
+melo_jsonrpc_build_error_nodev (MeloJSONRPCError error_code,
+                                const char *error_format, va_list args)
+{
+  gchar *error_message;
+  JsonObject *obj;
+  JsonNode *node;
 
-      /* Get node */
-      node = json_object_get_member (o, name);
-      if (!node) {
-        /* Get required flag: failed if not defined or TRUE */
-        node = json_object_get_member (schema, "required");
-        if (!node || (node && json_node_get_boolean (node)))
-          goto failed;
-
-        /* When not required:
-         *  - skip when converting to an object,
-         *  - stop when converting to an array.
-         */
-        if (obj)
-            continue;
-        if (array)
-        return TRUE;
-      }
+  /* Create a new JSON builder */
+  obj = json_object_new ();
+  if (!obj)
+    return NULL;
 
-      /* Check node type */
-      if (!melo_jsonrpc_add_node (node, schema, obj, array))
-        goto failed;
-    }
-  } else if (type == JSON_NODE_ARRAY) {
-    guint params_count;
-    JsonArray *a;
+  /* Generate error message */
+  error_message = g_strdup_vprintf (error_format, args);
 
-    /* Get array */
-    a = json_node_get_array (params);
-    params_count = json_array_get_length (a);
+  /* Begin a new object */
+  json_object_set_int_member (obj, "code", error_code);
+  json_object_set_string_member (obj, "message", error_message);
 
-    /* Parse object */
-    for (i = 0; i < count; i++) {
-      /* Get next schema object */
-      schema = json_array_get_object_element (schema_params, i);
-      if (!schema)
-        goto failed;
+  /* Free message */
+  g_free (error_message);
 
-      /* No more parameters available */
-      if (i >= params_count) {
-        /* Get required flag: failed if not defined or TRUE */
-        node = json_object_get_member (schema, "required");
-        if (!node || (node && json_node_get_boolean (node)))
-          goto failed;
+  /* Create node */
+  node = json_node_new (JSON_NODE_OBJECT);
+  json_node_take_object (node, obj);
 
-        /* If this parameter was not required: stop conversion */
-        return TRUE;
-      }
+  return node;
+}
 
-      /* Get node */
-      node = json_array_get_element (a, i);
-      if (!node)
-        goto failed;
+static void
+melo_jsonrpc_write_error (MeloJSONRPCWriter *w, const char *id, gint64 nid,
+                          MeloJSONRPCError error_code,
+                          const char *error_message)
+{
+  /* Generate response with error */
+  melo_jsonrpc_writer_begin_object (w);
+  melo_jsonrpc_writer_set_member_name (w, "jsonrpc");
+  melo_jsonrpc_writer_add_string_value (w, "2.0");
+  melo_jsonrpc_writer_set_member_name (w, "error");
+  melo_jsonrpc_writer_begin_object (w);
+  melo_jsonrpc_writer_set_member_name (w, "code");
+  melo_jsonrpc_writer_add_int_value (w, error_code);
+  melo_jsonrpc_writer_set_member_name (w, "message");
+  melo_jsonrpc_writer_add_string_value (w, error_message);
+  melo_jsonrpc_writer_end_object (w);
+  melo_jsonrpc_write_id (w, id, nid);
+  melo_jsonrpc_writer_end_object (w);
+}
+
+/**
+ * melo_jsonrpc_build_error_node:
+ * @error_code: the JSON-RPC error code
+ * @error_format: the string format. See the printf() documentation
+ * @...: the parameters to insert into the format string
+ *
+ * Generate a JSON-RPC response with @error set.
+ *
+ * Returns: (transfer full): a new #JsonNode containing the JSON-RPC response
+ * with @error set, or %NULL if an error occurred. Use json_node_unref() after
+ * usage.
+ */
+JsonNode *
+melo_jsonrpc_build_error_node (MeloJSONRPCError error_code,
+                               const char *error_format, ...)
+{
+  JsonNode *node;
+  va_list args;
 
-      /* Check node type */
-      if (!melo_jsonrpc_add_node (node, schema, obj, array))
-        goto failed;
-    }
-  }
-  return TRUE;
+  /* Generate error node */
+  va_start (args, error_format);
+  node = melo_jsonrpc_build_error_nodev (error_code, error_format, args);
+  va_end (args);
 
-failed:
-  if (error && *error == NULL)
-    *error = melo_jsonrpc_build_error_node (MELO_JSONRPC_ERROR_INVALID_PARAMS,
-                                            "Invalid params");
-  return FALSE;
+  return node;
 }
 
 /**
- * melo_jsonrpc_check_params:
- * @schema_params: the schema to use for parameters checking (see
- *    #MeloJSONRPCMethod for more details)
- * @params: the parameters to check
- * @error: a pointer to a #JsonNode which is set with a valid JSON-RPC error if
- *    an error has occurred
+ * melo_jsonrpc_get_result_writer:
  *
- * Check if JSON-RPC parameters in @params are matching the schema in
- * @schema_params.
+ * Get the #MeloJSONRPCWriter in which the result of the method currently
+ * called can be written directly. It must be called from a
+ * #MeloJSONRPCCallback and only one value (generally an object or an array)
+ * should be written. When the result has been written in the writer, the
+ * @result parameter of the callback must be left untouched. If the @error is
+ * set, the content of the writer is discarded.
  *
- * Returns: %TRUE if the parameters are valid, %FALSE otherwise.
+ * The writer is not available for notifications or when the callback is not
+ * called from melo_jsonrpc_parse_request(), in this case the callback must
+ * set @result with a #JsonNode as usual.
+ *
+ * Returns: (transfer none): the #MeloJSONRPCWriter to use for the result, or
+ * %NULL if not available.
  */
-gboolean
-melo_jsonrpc_check_params (JsonArray *schema_params, JsonNode *params,
-                           JsonNode **error)
+MeloJSONRPCWriter *
+melo_jsonrpc_get_result_writer (void)
 {
-  return melo_jsonrpc_get_json_node (schema_params, params, NULL, NULL, error);
+  return g_private_get (&melo_jsonrpc_result_writer_key);
 }
 
 /**
- * melo_jsonrpc_get_object:
- * @schema_params: the schema to use for parameters conversion (see
- *    #MeloJSONRPCMethod for more details)
- * @params: the parameters to convert
- * @error: a pointer to a #JsonNode which is set with a valid JSON-RPC error if
- *    an error has occurred
+ * melo_jsonrpc_writer_new:
  *
- * Convert the #JsonNode containing the parameters into a #JsonObject with all
- * members corresponding to each parameters.
+ * Create a new #MeloJSONRPCWriter. A writer serializes JSON values directly
+ * into a string buffer, without building any #JsonNode tree. The API is
+ * similar to the #JsonBuilder one.
  *
- * Returns: (transfer full): a new #JsonObject containing all parameters sorted
- * by name, or %NULL if an error occurred. Use json_object_unref() after usage.
+ * Returns: (transfer full): a new #MeloJSONRPCWriter. Use
+ * melo_jsonrpc_writer_free() after usage.
  */
-JsonObject *
-melo_jsonrpc_get_object (JsonArray *schema_params, JsonNode *params,
-                         JsonNode **error)
+MeloJSONRPCWriter *
+melo_jsonrpc_writer_new (void)
 {
-  JsonObject *obj;
+  MeloJSONRPCWriter *w;
 
-  /* Allocate new object */
-  obj = json_object_new ();
+  /* Create new writer */
+  w = g_slice_new0 (MeloJSONRPCWriter);
+  w->str = g_string_sized_new (MELO_JSONRPC_WRITER_CHUNK_SIZE);
 
-  /* Get node */
-  if (!melo_jsonrpc_get_json_node (schema_params, params, obj, NULL, error)) {
-    json_object_unref (obj);
-    return NULL;
-  }
+  return w;
+}
 
-  return obj;
+/**
+ * melo_jsonrpc_writer_free:
+ * @writer: a #MeloJSONRPCWriter
+ *
+ * Free a #MeloJSONRPCWriter and its buffer.
+ */
+void
+melo_jsonrpc_writer_free (MeloJSONRPCWriter *writer)
+{
+  if (!writer)
+    return;
+
+  g_string_free (writer->str, TRUE);
+  g_slice_free (MeloJSONRPCWriter, writer);
 }
 
 /**
- * melo_jsonrpc_get_array:
- * @schema_params: the schema to use for parameters conversion (see
- *    #MeloJSONRPCMethod for more details)
- * @params: the parameters to convert
- * @error: a pointer to a #JsonNode which is set with a valid JSON-RPC error if
- *    an error has occurred
+ * melo_jsonrpc_writer_reset:
+ * @writer: a #MeloJSONRPCWriter
  *
- * Convert the #JsonNode containing the parameters into a #JsonArray with all
- * items sorted as the provided schema.
+ * Discard all data written in @writer. The buffer is kept for next usage.
+ */
+void
+melo_jsonrpc_writer_reset (MeloJSONRPCWriter *writer)
+{
+  g_string_truncate (writer->str, 0);
+  writer->depth = 0;
+  writer->items = 0;
+  writer->member = FALSE;
+  writer->overflow = FALSE;
+  writer->skipped = 0;
+}
+
+/**
+ * melo_jsonrpc_writer_get_data:
+ * @writer: a #MeloJSONRPCWriter
+ * @length: a pointer to a #gsize to set with the length of data, or %NULL
  *
- * Returns: (transfer full): a new #JsonArray containing all parameters sorted
- * as provided schema, or %NULL if an error occurred. Use json_array_unref()
- * after usage.
+ * Get the serialized data written in @writer.
+ *
+ * Returns: (transfer none): the serialized JSON data, owned by @writer.
  */
-JsonArray *
-melo_jsonrpc_get_array (JsonArray *schema_params, JsonNode *params,
-                        JsonNode **error)
+const gchar *
+melo_jsonrpc_writer_get_data (MeloJSONRPCWriter *writer, gsize *length)
 {
-  JsonArray *array;
-  guint count;
+  if (length)
+    *length = writer->str->len;
+  return writer->str->str;
+}
 
-  /* Get array length */
-  count = json_array_get_length (schema_params);
+/**
+ * melo_jsonrpc_writer_has_overflow:
+ * @writer: a #MeloJSONRPCWriter
+ *
+ * Check if an object or an array has been opened beyond the maximal depth of
+ * the writer since its last reset. In this case, the data written in @writer
+ * is not valid JSON and it must be discarded.
+ *
+ * Returns: %TRUE if the maximal depth has been reached, %FALSE otherwise.
+ */
+gboolean
+melo_jsonrpc_writer_has_overflow (MeloJSONRPCWriter *writer)
+{
+  return writer->overflow;
+}
 
-  /* Allocate new array */
-  array = json_array_sized_new (count);
+static void
+melo_jsonrpc_writer_add_separator (MeloJSONRPCWriter *w)
+{
+  guint64 bit = G_GUINT64_CONSTANT (1) << w->depth;
 
-  /* Get array */
-  if (!melo_jsonrpc_get_json_node (schema_params, params, NULL, array, error)) {
-    json_array_unref (array);
-    return NULL;
+  /* Value of a member */
+  if (w->member) {
+    w->member = FALSE;
+    return;
   }
 
-  return array;
+  /* Add a separator if not first item */
+  if (w->items & bit)
+    g_string_append_c (w->str, ',');
+  else
+    w->items |= bit;
 }
 
-/* Helpers */
-static gchar *
-melo_jsonrpc_node_to_string (JsonNode *node)
+static void
+melo_jsonrpc_writer_append_string (GString *str, const gchar *value)
 {
-  JsonGenerator *gen;
-  gchar *str;
+  const gchar *start = value;
+  const gchar *p;
 
-  /* Create a new generator */
-  gen = json_generator_new ();
-  if (!gen)
-    return NULL;
+  g_string_append_c (str, '"');
+
+  /* Escape string */
+  for (p = value; *p != '\0'; p++) {
+    guchar c = (guchar) *p;
 
-  /* Set root node */
-  json_generator_set_root (gen, node);
+    /* Nothing to escape */
+    if (c >= 0x20 && c != '"' && c != '\\')
+      continue;
 
-  /* Generate string */
-  str = json_generator_to_data (gen, NULL);
+    /* Add previous characters */
+    g_string_append_len (str, start, p - start);
+    start = p + 1;
 
-  /* Free generator */
-  g_object_unref (gen);
+    /* Add escaped character */
+    switch (c) {
+      case '"':
+        g_string_append (str, "\\\"");
+        break;
+      case '\\':
+        g_string_append (str, "\\\\");
+        break;
+      case '\b':
+        g_string_append (str, "\\b");
+        break;
+      case '\f':
+        g_string_append (str, "\\f");
+        break;
+      case '\n':
+        g_string_append (str, "\\n");
+        break;
+      case '\r':
+        g_string_append (str, "\\r");
+        break;
+      case '\t':
+        g_string_append (str, "\\t");
+        break;
+      default:
+        g_string_append_printf (str, "\\u%04x", c);
+    }
+  }
+  g_string_append_len (str, start, p - start);
 
-  return str;
+  g_string_append_c (str, '"');
 }
 
-static JsonNode *
-melo_jsonrpc_build_response_node (JsonNode *result, JsonNode *error,
-                                  const gchar *id, gint64 nid)
+/**
+ * melo_jsonrpc_writer_begin_object:
+ * @writer: a #MeloJSONRPCWriter
+ *
+ * Open a new object. It must be closed with melo_jsonrpc_writer_end_object().
+ * When the maximal depth is reached, the object is not opened and the writer
+ * is marked as overflowed: see melo_jsonrpc_writer_has_overflow().
+ */
+void
+melo_jsonrpc_writer_begin_object (MeloJSONRPCWriter *writer)
 {
-  JsonBuilder *builder;
-  JsonNode *node;
+  /* Maximal depth reached: the content is not valid anymore */
+  if (writer->depth + 1 >= MELO_JSONRPC_WRITER_MAX_DEPTH) {
+    writer->overflow = TRUE;
+    writer->skipped++;
+    return;
+  }
 
-  /* Create new builder */
-  builder = json_builder_new ();
-  if (!builder)
-    return NULL;
+  melo_jsonrpc_writer_add_separator (writer);
+  g_string_append_c (writer->str, '{');
+  writer->depth++;
+  writer->items &= ~(G_GUINT64_CONSTANT (1) << writer->depth);
+}
 
-  /* Begin a new object */
-  json_builder_begin_object (builder);
+/**
+ * melo_jsonrpc_writer_end_object:
+ * @writer: a #MeloJSONRPCWriter
+ *
+ * Close the current object.
+ */
+void
+melo_jsonrpc_writer_end_object (MeloJSONRPCWriter *writer)
+{
+  /* Level not opened after overflow */
+  if (writer->skipped) {
+    writer->skipped--;
+    return;
+  }
 
-  /* Add jsonrpc member */
-  json_builder_set_member_name (builder, "jsonrpc");
-  json_builder_add_string_value (builder, "2.0");
+  g_return_if_fail (writer->depth > 0);
 
-  /* Set result or error */
-  if (error) {
-    /* Add error member */
-    json_builder_set_member_name (builder, "error");
-    json_builder_add_value (builder, error);
+  writer->depth--;
+  g_string_append_c (writer->str, '}');
+}
 
-    /* Free result if exists */
-    if (result)
-      json_node_free (result);
-  } else if (result) {
-    /* Add result member */
-    json_builder_set_member_name (builder, "result");
-    json_builder_add_value (builder, result);
+/**
+ * melo_jsonrpc_writer_begin_array:
+ * @writer: a #MeloJSONRPCWriter
+ *
+ * Open a new array. It must be closed with melo_jsonrpc_writer_end_array().
+ * When the maximal depth is reached, the array is not opened and the writer
+ * is marked as overflowed: see melo_jsonrpc_writer_has_overflow().
+ */
+void
+melo_jsonrpc_writer_begin_array (MeloJSONRPCWriter *writer)
+{
+  /* Maximal depth reached: the content is not valid anymore */
+  if (writer->depth + 1 >= MELO_JSONRPC_WRITER_MAX_DEPTH) {
+    writer->overflow = TRUE;
+    writer->skipped++;
+    return;
   }
 
-  /* Add id member: we assume ID cannot be negative */
-  json_builder_set_member_name (builder, "id");
-  if (nid < 0 || id)
-    json_builder_add_string_value (builder, id);
-  else
-    json_builder_add_int_value (builder, nid);
-
-  json_builder_end_object (builder);
+  melo_jsonrpc_writer_add_separator (writer);
+  g_string_append_c (writer->str, '[');
+  writer->depth++;
+  writer->items &= ~(G_GUINT64_CONSTANT (1) << writer->depth);
+}
 
-  /* Get final object */
-  node = json_builder_get_root (builder);
+/**
+ * melo_jsonrpc_writer_end_array:
+ * @writer: a #MeloJSONRPCWriter
+ *
+ * Close the current array.
+ */
+void
+melo_jsonrpc_writer_end_array (MeloJSONRPCWriter *writer)
+{
+  /* Level not opened after overflow */
+  if (writer->skipped) {
+    writer->skipped--;
+    return;
+  }
 
-  /* Free builder */
-  g_object_unref (builder);
+  g_return_if_fail (writer->depth > 0);
 
-  return node;
+  writer->depth--;
+  g_string_append_c (writer->str, ']');
 }
 
-static JsonNode *
-melo_jsonrpc_build_error_nodev (MeloJSONRPCError error_code,
-                                const char *error_format, va_list args)
+/**
+ * melo_jsonrpc_writer_set_member_name:
+ * @writer: a #MeloJSONRPCWriter
+ * @name: the name of the member
+ *
+ * Add a new member in the current object. The value of the member must be
+ * added just after this call.
+ */
+void
+melo_jsonrpc_writer_set_member_name (MeloJSONRPCWriter *writer,
+                                     const gchar *name)
 {
-  gchar *error_message;
-  JsonObject *obj;
-  JsonNode *node;
+  melo_jsonrpc_writer_add_separator (writer);
+  melo_jsonrpc_writer_append_string (writer->str, name);
+  g_string_append_c (writer->str, ':');
+  writer->member = TRUE;
+}
 
-  /* Create a new JSON builder */
-  obj = json_object_new ();
-  if (!obj)
-    return NULL;
+/**
+ * melo_jsonrpc_writer_add_string_value:
+ * @writer: a #MeloJSONRPCWriter
+ * @value: the string to add, can be %NULL
+ *
+ * Add a string value. If @value is %NULL, a null value is added.
+ */
+void
+melo_jsonrpc_writer_add_string_value (MeloJSONRPCWriter *writer,
+                                      const gchar *value)
+{
+  if (!value) {
+    melo_jsonrpc_writer_add_null_value (writer);
+    return;
+  }
 
-  /* Generate error message */
-  error_message = g_strdup_vprintf (error_format, args);
+  melo_jsonrpc_writer_add_separator (writer);
+  melo_jsonrpc_writer_append_string (writer->str, value);
+}
 
-  /* Begin a new object */
-  json_object_set_int_member (obj, "code", error_code);
-  json_object_set_string_member (obj, "message", error_message);
+/**
+ * melo_jsonrpc_writer_add_int_value:
+ * @writer: a #MeloJSONRPCWriter
+ * @value: the integer to add
+ *
+ * Add an integer value.
+ */
+void
+melo_jsonrpc_writer_add_int_value (MeloJSONRPCWriter *writer, gint64 value)
+{
+  melo_jsonrpc_writer_add_separator (writer);
+  g_string_append_printf (writer->str, "%" G_GINT64_FORMAT, value);
+}
 
-  /* Free message */
-  g_free (error_message);
+/**
+ * melo_jsonrpc_writer_add_double_value:
+ * @writer: a #MeloJSONRPCWriter
+ * @value: the double to add
+ *
+ * Add a double value. JSON has no representation for NaN and infinite values,
+ * so a null value is added for them.
+ */
+void
+melo_jsonrpc_writer_add_double_value (MeloJSONRPCWriter *writer, gdouble value)
+{
+  gchar buf[G_ASCII_DTOSTR_BUF_SIZE];
 
-  /* Create node */
-  node = json_node_new (JSON_NODE_OBJECT);
-  json_node_take_object (node, obj);
+  /* Non-finite value */
+  if (!isfinite (value)) {
+    melo_jsonrpc_writer_add_null_value (writer);
+    return;
+  }
 
-  return node;
+  melo_jsonrpc_writer_add_separator (writer);
+  g_string_append (writer->str, g_ascii_dtostr (buf, sizeof (buf), value));
 }
 
-static JsonNode *
-melo_jsonrpc_build_error (const char *id, gint64 nid,
-                          MeloJSONRPCError error_code,
-                          const char *error_format, ...)
+/**
+ * melo_jsonrpc_writer_add_boolean_value:
+ * @writer: a #MeloJSONRPCWriter
+ * @value: the boolean to add
+ *
+ * Add a boolean value.
+ */
+void
+melo_jsonrpc_writer_add_boolean_value (MeloJSONRPCWriter *writer,
+                                       gboolean value)
 {
-  JsonNode *node;
-  va_list args;
-
-  /* Generate error node */
-  va_start (args, error_format);
-  node = melo_jsonrpc_build_error_nodev (error_code, error_format, args);
-  va_end (args);
-
-  /* Generate final response */
-  return melo_jsonrpc_build_response_node (NULL, node, id, nid);
+  melo_jsonrpc_writer_add_separator (writer);
+  g_string_append (writer->str, value ? "true" : "false");
 }
 
-static gchar *
-melo_jsonrpc_build_error_str (MeloJSONRPCError error_code,
-                              const char *error_format, ...)
+/**
+ * melo_jsonrpc_writer_add_null_value:
+ * @writer: a #MeloJSONRPCWriter
+ *
+ * Add a null value.
+ */
+void
+melo_jsonrpc_writer_add_null_value (MeloJSONRPCWriter *writer)
 {
-  JsonNode *node;
-  va_list args;
-  gchar *str;
+  melo_jsonrpc_writer_add_separator (writer);
+  g_string_append (writer->str, "null");
+}
 
-  /* Generate error node */
-  va_start (args, error_format);
-  node = melo_jsonrpc_build_error_nodev (error_code, error_format, args);
-  va_end (args);
+static void
+melo_jsonrpc_writer_add_member (JsonObject *object, const gchar *name,
+                                JsonNode *node, gpointer user_data)
+{
+  MeloJSONRPCWriter *w = user_data;
 
-  /* Generate final response */
-  node = melo_jsonrpc_build_response_node (NULL, node, NULL, -1);
+  melo_jsonrpc_writer_set_member_name (w, name);
+  melo_jsonrpc_writer_add_node (w, node);
+}
 
-  /* Generate string */
-  str = melo_jsonrpc_node_to_string (node);
-  json_node_free (node);
+static void
+melo_jsonrpc_writer_add_sorted_members (MeloJSONRPCWriter *w,
+                                        JsonObject *object)
+{
+  GList *members, *l;
+
+  /* Add members sorted by name */
+  members = g_list_sort (json_object_get_members (object),
+                         (GCompareFunc) g_strcmp0);
+  for (l = members; l != NULL; l = l->next)
+    melo_jsonrpc_writer_add_member (object, l->data,
+                                    json_object_get_member (object, l->data),
+                                    w);
+  g_list_free (members);
+}
 
-  return str;
+static void
+melo_jsonrpc_writer_add_element (JsonArray *array, guint index,
+                                 JsonNode *node, gpointer user_data)
+{
+  melo_jsonrpc_writer_add_node ((MeloJSONRPCWriter *) user_data, node);
 }
 
 /**
- * melo_jsonrpc_build_error_node:
- * @error_code: the JSON-RPC error code
- * @error_format: the string format. See the printf() documentation
- * @...: the parameters to insert into the format string
- *
- * Generate a JSON-RPC response with @error set.
+ * melo_jsonrpc_writer_add_node:
+ * @writer: a #MeloJSONRPCWriter
+ * @node: the #JsonNode to add, can be %NULL
  *
- * Returns: (transfer full): a new #JsonNode containing the JSON-RPC response
- * with @error set, or %NULL if an error occurred. Use json_node_unref() after
- * usage.
+ * Serialize a #JsonNode and add it as a value. It can be used to mix existing
+ * #JsonNode based code with a #MeloJSONRPCWriter.
  */
-JsonNode *
-melo_jsonrpc_build_error_node (MeloJSONRPCError error_code,
-                               const char *error_format, ...)
+void
+melo_jsonrpc_writer_add_node (MeloJSONRPCWriter *writer, JsonNode *node)
 {
-  JsonNode *node;
-  va_list args;
+  GType vtype;
 
-  /* Generate error node */
-  va_start (args, error_format);
-  node = melo_jsonrpc_build_error_nodev (error_code, error_format, args);
-  va_end (args);
+  /* Null node */
+  if (!node) {
+    melo_jsonrpc_writer_add_null_value (writer);
+    return;
+  }
 
-  return node;
+  switch (json_node_get_node_type (node)) {
+    case JSON_NODE_OBJECT:
+      melo_jsonrpc_writer_begin_object (writer);
+      if (writer->canonical)
+        melo_jsonrpc_writer_add_sorted_members (writer,
+                                                json_node_get_object (node));
+      else
+        json_object_foreach_member (json_node_get_object (node),
+                                    melo_jsonrpc_writer_add_member, writer);
+      melo_jsonrpc_writer_end_object (writer);
+      break;
+    case JSON_NODE_ARRAY:
+      melo_jsonrpc_writer_begin_array (writer);
+      json_array_foreach_element (json_node_get_array (node),
+                                  melo_jsonrpc_writer_add_element, writer);
+      melo_jsonrpc_writer_end_array (writer);
+      break;
+    case JSON_NODE_VALUE:
+      vtype = json_node_get_value_type (node);
+      if (vtype == G_TYPE_INT64)
+        melo_jsonrpc_writer_add_int_value (writer, json_node_get_int (node));
+      else if (vtype == G_TYPE_DOUBLE)
+        melo_jsonrpc_writer_add_double_value (writer,
+                                              json_node_get_double (node));
+      else if (vtype == G_TYPE_BOOLEAN)
+        melo_jsonrpc_writer_add_boolean_value (writer,
+                                               json_node_get_boolean (node));
+      else if (vtype == G_TYPE_STRING)
+        melo_jsonrpc_writer_add_string_value (writer,
+                                              json_node_get_string (node));
+      else
+        melo_jsonrpc_writer_add_null_value (writer);
+      break;
+    case JSON_NODE_NULL:
+    default:
+      melo_jsonrpc_writer_add_null_value (writer);
+  }
 }
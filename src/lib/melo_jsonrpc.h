@@ -25,6 +25,9 @@
 #include <glib.h>
 #include <json-glib/json-glib.h>
 
+typedef struct _MeloJSONRPCWriter MeloJSONRPCWriter;
+typedef struct _MeloJSONRPCCompletion MeloJSONRPCCompletion;
+
 /**
  * MeloJSONRPCError:
  * @MELO_JSONRPC_ERROR_PARSE_ERROR: parse error
@@ -45,6 +48,43 @@ typedef enum {
   MELO_JSONRPC_ERROR_SERVER_ERROR = -32000,
 } MeloJSONRPCError;
 
+/**
+ * MeloJSONRPCFlags:
+ * @MELO_JSONRPC_FLAG_NONE: no flag
+ * @MELO_JSONRPC_FLAG_READ_ONLY: the method has no side effect and its result
+ *    only depends on its parameters: identical calls running at the same time
+ *    are coalesced into one call and share its result
+ * @MELO_JSONRPC_FLAG_CONCURRENT: the method has no side effect and its
+ *    callback is thread-safe: in a batch, it can run at the same time than the
+ *    other requests with this flag, instead of being an ordering barrier
+ *
+ * Flags of a #MeloJSONRPCMethod.
+ */
+typedef enum {
+  MELO_JSONRPC_FLAG_NONE = 0,
+  MELO_JSONRPC_FLAG_READ_ONLY = (1 << 0),
+  MELO_JSONRPC_FLAG_CONCURRENT = (1 << 1),
+} MeloJSONRPCFlags;
+
+/**
+ * MeloJSONRPCPriority:
+ * @MELO_JSONRPC_PRIORITY_DEFAULT: default priority, for methods which can take
+ *    some time to complete (browsing, searching, ...)
+ * @MELO_JSONRPC_PRIORITY_CONTROL: priority for short control methods (play,
+ *    pause, volume, ...) which should not wait behind slow methods
+ * @MELO_JSONRPC_PRIORITY_COUNT: number of priority classes
+ *
+ * Priority class of a #MeloJSONRPCMethod. The transport can use
+ * melo_jsonrpc_get_request_priority() to process the requests of each class
+ * with dedicated resources.
+ */
+typedef enum {
+  MELO_JSONRPC_PRIORITY_DEFAULT = 0,
+  MELO_JSONRPC_PRIORITY_CONTROL,
+
+  MELO_JSONRPC_PRIORITY_COUNT,
+} MeloJSONRPCPriority;
+
 /**
  * MeloJSONRPCCallback:
  * @method: the current method name
@@ -66,10 +106,16 @@ typedef enum {
  *
  * The @params can be converted into a #JsonArray with melo_jsonrpc_get_array()
  * or into a #JsonObject with  melo_jsonrpc_get_object(). It uses the
- * @schema_params to present the #JsonNode as a more readable object.
+ * @schema_params to present the #JsonNode as a more readable object. For the
+ * most frequently called methods, the parameters can also be checked and
+ * extracted directly into an array of #MeloJSONRPCValue with
+ * melo_jsonrpc_get_params(), which avoids allocating a new #JsonObject at each
+ * call.
  *
  * The @result or @error should be set before returning, in order to prevent a
- * default MELO_JSONRPC_ERROR_METHOD_NOT_FOUND error.
+ * default MELO_JSONRPC_ERROR_METHOD_NOT_FOUND error. A slow method can instead
+ * call melo_jsonrpc_defer() and return immediately: the result is then
+ * provided later with melo_jsonrpc_complete().
  */
 typedef void (*MeloJSONRPCCallback) (const gchar *method,
                                      JsonArray *schema_params, JsonNode *params,
@@ -84,6 +130,8 @@ typedef void (*MeloJSONRPCCallback) (const gchar *method,
  * @callback: the callback of type #MeloJSONRPCCallback to call when @method,
  *    @params and @result are matching
  * @user_data: the user data to use when calling @callback
+ * @flags: the #MeloJSONRPCFlags of the method
+ * @priority: the #MeloJSONRPCPriority class of the method
  *
  * The #MeloJSONRPCMethod describe a JSON-RPC method to register in JSON-RPC
  * parser. The registration is done with melo_jsonrpc_register_method() or
@@ -122,7 +170,8 @@ typedef void (*MeloJSONRPCCallback) (const gchar *method,
  * ]|
  *
  * If the @params or @result cannot be parsed, the registration function will
- * fail.
+ * fail. The @params schema is compiled during registration, so the parameters
+ * are checked without walking the JSON schema at each call.
  */
 typedef struct _MeloJSONRPCMethod {
   const gchar *method;
@@ -130,8 +179,55 @@ typedef struct _MeloJSONRPCMethod {
   const gchar *result;
   MeloJSONRPCCallback callback;
   gpointer user_data;
+  MeloJSONRPCFlags flags;
+  MeloJSONRPCPriority priority;
 } MeloJSONRPCMethod;
 
+/**
+ * MeloJSONRPCValue:
+ * @b: the value of a "boolean" parameter
+ * @i: the value of an "integer" parameter
+ * @d: the value of a "double" parameter
+ * @s: the value of a "string" parameter
+ * @o: the value of an "object" parameter
+ * @a: the value of an "array" parameter
+ *
+ * The value of one parameter extracted by melo_jsonrpc_get_params(). The
+ * member to use depends on the type of the parameter in the @params schema
+ * (see #MeloJSONRPCMethod).
+ */
+typedef union _MeloJSONRPCValue {
+  gboolean b;
+  gint64 i;
+  gdouble d;
+  const gchar *s;
+  JsonObject *o;
+  JsonArray *a;
+} MeloJSONRPCValue;
+
+/**
+ * MeloJSONRPCChunkFunc:
+ * @data: a chunk of the serialized JSON-RPC response
+ * @length: the length of @data
+ * @user_data: the user data passed to melo_jsonrpc_parse_request_chunked()
+ *
+ * This function is called by melo_jsonrpc_parse_request_chunked() each time a
+ * new chunk of the response is ready. The @data is only valid during the call,
+ * it must be copied to be kept.
+ */
+typedef void (*MeloJSONRPCChunkFunc) (const gchar *data, gsize length,
+                                      gpointer user_data);
+
+/**
+ * MeloJSONRPCDoneFunc:
+ * @response: %TRUE if a response has been sent, %FALSE otherwise
+ * @user_data: the user data passed to melo_jsonrpc_parse_request_async()
+ *
+ * This function is called by melo_jsonrpc_parse_request_async() when the last
+ * chunk of the response has been passed to the #MeloJSONRPCChunkFunc.
+ */
+typedef void (*MeloJSONRPCDoneFunc) (gboolean response, gpointer user_data);
+
 /* Register a JSON-RPC method */
 gboolean melo_jsonrpc_register_method (const gchar *group, const gchar *method,
                                        JsonArray *params, JsonObject *result,
@@ -145,9 +241,31 @@ guint melo_jsonrpc_register_methods (const gchar *group,
 void melo_jsonrpc_unregister_methods (const gchar *group,
                                      MeloJSONRPCMethod *methods, guint count);
 
+/* Register JSON-RPC methods of the parser */
+void melo_jsonrpc_register_rpc_methods (void);
+void melo_jsonrpc_unregister_rpc_methods (void);
+
+/* Method statistics */
+JsonArray *melo_jsonrpc_get_stats (const gchar *method);
+void melo_jsonrpc_reset_stats (const gchar *method);
+
 /* Parse a JSON-RPC request */
 gchar *melo_jsonrpc_parse_request (const gchar *request, gsize length,
                                    GError **error);
+gboolean melo_jsonrpc_parse_request_chunked (const gchar *request, gsize length,
+                                             MeloJSONRPCChunkFunc func,
+                                             gpointer user_data);
+MeloJSONRPCPriority melo_jsonrpc_get_request_priority (const gchar *request,
+                                                      gsize length);
+void melo_jsonrpc_parse_request_async (const gchar *request, gsize length,
+                                       MeloJSONRPCChunkFunc func,
+                                       MeloJSONRPCDoneFunc done,
+                                       gpointer user_data);
+
+/* Deferred result */
+MeloJSONRPCCompletion *melo_jsonrpc_defer (void);
+void melo_jsonrpc_complete (MeloJSONRPCCompletion *completion,
+                            JsonNode *result, JsonNode *error);
 
 /* Parameters utils */
 gboolean melo_jsonrpc_check_params (JsonArray *schema_params, JsonNode *params,
@@ -156,9 +274,38 @@ JsonArray *melo_jsonrpc_get_array (JsonArray *schema_params, JsonNode *params,
                                    JsonNode **error);
 JsonObject *melo_jsonrpc_get_object (JsonArray *schema_params,
                                      JsonNode *params, JsonNode **error);
+gboolean melo_jsonrpc_get_params (JsonArray *schema_params, JsonNode *params,
+                                  gpointer values, JsonNode **error);
 
 /* Utils */
 JsonNode *melo_jsonrpc_build_error_node (MeloJSONRPCError error_code,
                                          const char *error_format, ...);
 
+/* Streaming result writer */
+MeloJSONRPCWriter *melo_jsonrpc_get_result_writer (void);
+
+MeloJSONRPCWriter *melo_jsonrpc_writer_new (void);
+void melo_jsonrpc_writer_free (MeloJSONRPCWriter *writer);
+void melo_jsonrpc_writer_reset (MeloJSONRPCWriter *writer);
+const gchar *melo_jsonrpc_writer_get_data (MeloJSONRPCWriter *writer,
+                                           gsize *length);
+gboolean melo_jsonrpc_writer_has_overflow (MeloJSONRPCWriter *writer);
+
+void melo_jsonrpc_writer_begin_object (MeloJSONRPCWriter *writer);
+void melo_jsonrpc_writer_end_object (MeloJSONRPCWriter *writer);
+void melo_jsonrpc_writer_begin_array (MeloJSONRPCWriter *writer);
+void melo_jsonrpc_writer_end_array (MeloJSONRPCWriter *writer);
+void melo_jsonrpc_writer_set_member_name (MeloJSONRPCWriter *writer,
+                                          const gchar *name);
+void melo_jsonrpc_writer_add_string_value (MeloJSONRPCWriter *writer,
+                                           const gchar *value);
+void melo_jsonrpc_writer_add_int_value (MeloJSONRPCWriter *writer,
+                                        gint64 value);
+void melo_jsonrpc_writer_add_double_value (MeloJSONRPCWriter *writer,
+                                           gdouble value);
+void melo_jsonrpc_writer_add_boolean_value (MeloJSONRPCWriter *writer,
+                                            gboolean value);
+void melo_jsonrpc_writer_add_null_value (MeloJSONRPCWriter *writer);
+void melo_jsonrpc_writer_add_node (MeloJSONRPCWriter *writer, JsonNode *node);
+
 #endif /* __MELO_JSONRPC_H__ */
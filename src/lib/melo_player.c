@@ -42,6 +42,9 @@
  * does not need to handle a #MeloPlayerStatus instance since the base class
  * already embed one instance and offers many safe-thread helpers to change the
  * values. It is highly recommended to use the internal status.
+ * The internal status is never modified once published: each update creates a
+ * new #MeloPlayerStatus which replaces atomically the previous one, so the
+ * readers never wait for the thread which updates the status.
  * Moreover, the event system of Melo (see #MeloEvent) is supported internally
  * to generate automatically all player events when using the status helpers.
  *
@@ -49,6 +52,11 @@
  * melo_player_play() has no rules but it is recommended to use a path using
  * same schema than URI.
  *
+ * The position returned by melo_player_get_pos() is interpolated from the last
+ * known position with the monotonic clock while the player is playing, and the
+ * #MeloPlayer subclass is only queried for the real position at a low interval
+ * (see melo_player_set_pos_sync_interval()), after a state change or a seek.
+ *
  * Every instance of #MeloPlayer is automatically stored in a global list in
  * order to get a #MeloPlayer from any place with only the ID provided during
  * instantiation with melo_player_new().
@@ -59,10 +67,17 @@ G_LOCK_DEFINE_STATIC (melo_player_mutex);
 static GHashTable *melo_player_hash = NULL;
 static GList *melo_player_list = NULL;
 
+/* Interval between two real position queries (in ms) */
+static gint melo_player_pos_sync_interval =
+                                       MELO_PLAYER_POS_SYNC_INTERVAL_DEFAULT;
+
 struct _MeloPlayerStatusPrivate {
   GMutex mutex;
   gint ref_count;
 
+  /* Publication time (used as version) */
+  gint64 timestamp;
+
   /* Strings */
   gchar *name;
   gchar *error;
@@ -76,8 +91,20 @@ struct _MeloPlayerPrivate {
   gchar *id;
   gchar *name;
   MeloPlayerInfo info;
+
+  /* Status snapshot: the mutex only serializes the updates */
   MeloPlayerStatus *status;
-  gint64 last_update;
+  gint epoch;
+  gint readers[2];
+
+  /* Position clock */
+  GMutex clock_mutex;
+  guint clock_gen;
+  gboolean clock_valid;
+  gboolean clock_running;
+  gint clock_pos;
+  gint clock_duration;
+  gint64 clock_time;
 };
 
 enum {
@@ -95,6 +122,9 @@ static void melo_player_get_property (GObject *object, guint property_id,
 static MeloPlayerStatus *melo_player_status_new (MeloPlayerState state,
                                                  const gchar *name,
                                                  MeloTags *tags);
+static MeloPlayerStatus *melo_player_status_copy (
+                                               const MeloPlayerStatus *status);
+static MeloPlayerStatus *melo_player_status_get (MeloPlayerPrivate *priv);
 
 G_DEFINE_ABSTRACT_TYPE_WITH_PRIVATE (MeloPlayer, melo_player, G_TYPE_OBJECT)
 
@@ -129,6 +159,7 @@ melo_player_finalize (GObject *gobject)
     g_object_unref (player->playlist);
 
   /* Free player mutex */
+  g_mutex_clear (&priv->clock_mutex);
   g_mutex_clear (&priv->mutex);
 
   /* Chain up to the parent class */
@@ -181,6 +212,7 @@ melo_player_init (MeloPlayer *self)
 
   /* Init player mutex */
   g_mutex_init (&priv->mutex);
+  g_mutex_init (&priv->clock_mutex);
 }
 
 /**
@@ -600,7 +632,11 @@ melo_player_set_pos (MeloPlayer *player, gint pos)
 
   g_return_val_if_fail (pclass->set_pos, 0);
 
-  return pclass->set_pos (player, pos);
+  /* Seek and query real position at next call */
+  pos = pclass->set_pos (player, pos);
+  melo_player_resync_pos (player);
+
+  return pos;
 }
 
 /**
@@ -669,31 +705,70 @@ melo_player_set_mute (MeloPlayer *player, gboolean mute)
  * To use correctly the @timestamp value, for the first call, it should be set
  * to zero, than it should be the same value as returned in the
  * #MeloPlayerStatus.
+ * This function never blocks on status updates: the returned
+ * #MeloPlayerStatus is a snapshot which can be shared with other callers, so
+ * it must not be modified.
  *
  * Returns: (transfer full): a reference to a #MeloPlayerStatus containing the
  * last player status. After use, call melo_player_status_unref().
  */
 MeloPlayerStatus *
 melo_player_get_status (MeloPlayer *player, gint64 *timestamp)
+{
+  MeloPlayerStatus *status, *copy;
+  gint pos;
+
+  /* Get status snapshot */
+  status = melo_player_get_status_snapshot (player, timestamp);
+  if (!status)
+    return NULL;
+
+  /* Update position: the snapshot is shared, so a copy is used */
+  pos = melo_player_get_pos (player);
+  if (pos != status->pos) {
+    copy = melo_player_status_copy (status);
+    melo_player_status_unref (status);
+    if (!copy)
+      return NULL;
+    status = copy;
+    status->pos = pos;
+  }
+
+  return status;
+}
+
+/**
+ * melo_player_get_status_snapshot:
+ * @player: the player
+ * @timestamp: the base timestamp
+ *
+ * Same as melo_player_get_status() but the position of the returned
+ * #MeloPlayerStatus is the one saved at last status update. It never copies
+ * the status, so it should be preferred when the status is polled: the
+ * current position can be retrieved with melo_player_get_pos().
+ *
+ * Returns: (transfer full): a reference to the shared #MeloPlayerStatus
+ * containing the last player status. After use, call
+ * melo_player_status_unref().
+ */
+MeloPlayerStatus *
+melo_player_get_status_snapshot (MeloPlayer *player, gint64 *timestamp)
 {
   MeloPlayerPrivate *priv = player->priv;
   MeloPlayerStatus *status;
 
-  /* */
+  /* Get status snapshot */
+  status = melo_player_status_get (priv);
+
+  /* Status not updated since last call */
   if (timestamp) {
-    if (*timestamp && *timestamp >= priv->last_update)
+    if (*timestamp && *timestamp >= status->priv->timestamp) {
+      melo_player_status_unref (status);
       return NULL;
-    *timestamp = priv->last_update;
+    }
+    *timestamp = status->priv->timestamp;
   }
 
-  /* Copy status */
-  g_mutex_lock (&priv->mutex);
-  status = melo_player_status_ref (priv->status);
-  g_mutex_unlock (&priv->mutex);
-
-  /* Update position */
-  status->pos = melo_player_get_pos (player);
-
   return status;
 }
 
@@ -709,12 +784,13 @@ MeloPlayerState
 melo_player_get_state (MeloPlayer *player)
 {
   MeloPlayerPrivate *priv = player->priv;
+  MeloPlayerStatus *status;
   MeloPlayerState state;
 
   /* Get player state */
-  g_mutex_lock (&priv->mutex);
-  state = priv->status->state;
-  g_mutex_unlock (&priv->mutex);
+  status = melo_player_status_get (priv);
+  state = status->state;
+  melo_player_status_unref (status);
 
   return state;
 }
@@ -732,12 +808,13 @@ gchar *
 melo_player_get_media_name (MeloPlayer *player)
 {
   MeloPlayerPrivate *priv = player->priv;
+  MeloPlayerStatus *status;
   gchar *name;
 
   /* Copy media name */
-  g_mutex_lock (&priv->mutex);
-  name = melo_player_status_get_name (priv->status);
-  g_mutex_unlock (&priv->mutex);
+  status = melo_player_status_get (priv);
+  name = melo_player_status_get_name (status);
+  melo_player_status_unref (status);
 
   return name;
 }
@@ -754,10 +831,98 @@ gint
 melo_player_get_pos (MeloPlayer *player)
 {
   MeloPlayerClass *pclass = MELO_PLAYER_GET_CLASS (player);
+  MeloPlayerPrivate *priv = player->priv;
+  gint64 now, interval;
+  guint gen;
+  gint pos;
 
   g_return_val_if_fail (pclass->get_pos, 0);
 
-  return pclass->get_pos (player);
+  /* Get current time and sync interval */
+  now = g_get_monotonic_time ();
+  interval = (gint64) g_atomic_int_get (&melo_player_pos_sync_interval) * 1000;
+
+  /* Lock position clock */
+  g_mutex_lock (&priv->clock_mutex);
+
+  /* Interpolate position from last known position */
+  if (priv->clock_valid && now - priv->clock_time < interval) {
+    pos = priv->clock_pos;
+    if (priv->clock_running)
+      pos += (now - priv->clock_time) / 1000;
+    if (priv->clock_duration > 0 && pos > priv->clock_duration)
+      pos = priv->clock_duration;
+    g_mutex_unlock (&priv->clock_mutex);
+    return pos;
+  }
+  gen = priv->clock_gen;
+
+  /* Unlock position clock */
+  g_mutex_unlock (&priv->clock_mutex);
+
+  /* Query real position */
+  pos = pclass->get_pos (player);
+
+  /* Save position if no state change or seek occurred during query */
+  g_mutex_lock (&priv->clock_mutex);
+  if (gen == priv->clock_gen) {
+    priv->clock_valid = TRUE;
+    priv->clock_pos = pos;
+    priv->clock_time = g_get_monotonic_time ();
+  }
+  g_mutex_unlock (&priv->clock_mutex);
+
+  return pos;
+}
+
+static void
+melo_player_clock_reset (MeloPlayerPrivate *priv, MeloPlayerState state)
+{
+  /* Next position will be queried */
+  g_mutex_lock (&priv->clock_mutex);
+  priv->clock_gen++;
+  priv->clock_valid = FALSE;
+  priv->clock_running = state == MELO_PLAYER_STATE_PLAYING;
+  g_mutex_unlock (&priv->clock_mutex);
+}
+
+/**
+ * melo_player_resync_pos:
+ * @player: the player
+ *
+ * Drop the position interpolated from the last known position, in order to
+ * query the real position at next melo_player_get_pos() call. It should be
+ * called by the #MeloPlayer subclass when the stream position changed without
+ * any status update, for example when an asynchronous seek is done.
+ */
+void
+melo_player_resync_pos (MeloPlayer *player)
+{
+  MeloPlayerPrivate *priv = player->priv;
+
+  /* Invalidate position */
+  g_mutex_lock (&priv->clock_mutex);
+  priv->clock_gen++;
+  priv->clock_valid = FALSE;
+  g_mutex_unlock (&priv->clock_mutex);
+}
+
+/**
+ * melo_player_set_pos_sync_interval:
+ * @interval: the interval (in ms) between two real position queries, 0 to
+ *    query on each call
+ *
+ * Set the interval at which the #MeloPlayer subclasses are queried for the
+ * real stream position in melo_player_get_pos(). Between two queries, the
+ * position is interpolated with the monotonic clock, which avoids querying the
+ * pipeline each time a client polls the player status.
+ *
+ * The default interval is 1000 ms.
+ */
+void
+melo_player_set_pos_sync_interval (guint interval)
+{
+  g_atomic_int_set (&melo_player_pos_sync_interval, interval);
 }
 
 /**
@@ -772,12 +937,13 @@ gdouble
 melo_player_get_volume (MeloPlayer *player)
 {
   MeloPlayerPrivate *priv = player->priv;
+  MeloPlayerStatus *status;
   gdouble volume;
 
   /* Get current volume */
-  g_mutex_lock (&priv->mutex);
-  volume = priv->status->volume;
-  g_mutex_unlock (&priv->mutex);
+  status = melo_player_status_get (priv);
+  volume = status->volume;
+  melo_player_status_unref (status);
 
   return volume;
 }
@@ -794,12 +960,13 @@ gboolean
 melo_player_get_mute (MeloPlayer *player)
 {
   MeloPlayerPrivate *priv = player->priv;
+  MeloPlayerStatus *status;
   gboolean mute;
 
   /* Get current mute */
-  g_mutex_lock (&priv->mutex);
-  mute = priv->status->mute;
-  g_mutex_unlock (&priv->mutex);
+  status = melo_player_status_get (priv);
+  mute = status->mute;
+  melo_player_status_unref (status);
 
   return mute;
 }
@@ -817,12 +984,13 @@ MeloTags *
 melo_player_get_tags (MeloPlayer *player)
 {
   MeloPlayerPrivate *priv = player->priv;
+  MeloPlayerStatus *status;
   MeloTags *tags;
 
   /* Get tags */
-  g_mutex_lock (&priv->mutex);
-  tags = melo_player_status_get_tags (priv->status);
-  g_mutex_unlock (&priv->mutex);
+  status = melo_player_status_get (priv);
+  tags = melo_player_status_get_tags (status);
+  melo_player_status_unref (status);
 
   return tags;
 }
@@ -860,10 +1028,96 @@ melo_player_status_new (MeloPlayerState state, const gchar *name,
   return status;
 }
 
+static MeloPlayerStatus *
+melo_player_status_copy (const MeloPlayerStatus *status)
+{
+  MeloPlayerStatus *copy;
+
+  /* Create new status */
+  copy = melo_player_status_new (status->state, status->priv->name,
+                                 status->priv->tags ?
+                                 melo_tags_ref (status->priv->tags) : NULL);
+  if (!copy)
+    return NULL;
+
+  /* Copy values */
+  copy->buffer_percent = status->buffer_percent;
+  copy->pos = status->pos;
+  copy->duration = status->duration;
+  copy->has_prev = status->has_prev;
+  copy->has_next = status->has_next;
+  copy->volume = status->volume;
+  copy->mute = status->mute;
+  copy->priv->error = g_strdup (status->priv->error);
+  copy->priv->timestamp = status->priv->timestamp;
+
+  return copy;
+}
+
+static MeloPlayerStatus *
+melo_player_status_get (MeloPlayerPrivate *priv)
+{
+  MeloPlayerStatus *status;
+  gint epoch;
+
+  /* Enter current epoch */
+  while (1) {
+    epoch = g_atomic_int_get (&priv->epoch);
+    g_atomic_int_inc (&priv->readers[epoch & 1]);
+    if (g_atomic_int_get (&priv->epoch) == epoch)
+      break;
+    g_atomic_int_add (&priv->readers[epoch & 1], -1);
+  }
+
+  /* Get a reference to current status */
+  status = melo_player_status_ref (g_atomic_pointer_get (&priv->status));
+
+  /* Leave epoch */
+  g_atomic_int_add (&priv->readers[epoch & 1], -1);
+
+  return status;
+}
+
+static MeloPlayerStatus *
+melo_player_status_edit (MeloPlayerPrivate *priv)
+{
+  MeloPlayerStatus *status;
+
+  /* Lock status update */
+  g_mutex_lock (&priv->mutex);
+
+  /* Copy current status */
+  status = melo_player_status_copy (priv->status);
+  if (!status)
+    g_mutex_unlock (&priv->mutex);
+
+  return status;
+}
+
 static void
-melo_player_updated (MeloPlayerPrivate *priv)
+melo_player_status_publish (MeloPlayerPrivate *priv, MeloPlayerStatus *status)
 {
-  priv->last_update = g_get_monotonic_time ();
+  MeloPlayerStatus *old;
+  gint epoch;
+
+  /* Set publication time */
+  status->priv->timestamp = g_get_monotonic_time ();
+
+  /* Replace status */
+  old = priv->status;
+  g_atomic_pointer_set (&priv->status, status);
+
+  /* Start a new epoch and wait end of readers of the previous one */
+  epoch = g_atomic_int_get (&priv->epoch);
+  g_atomic_int_set (&priv->epoch, epoch + 1);
+  while (g_atomic_int_get (&priv->readers[epoch & 1]))
+    g_thread_yield ();
+
+  /* Unlock status update */
+  g_mutex_unlock (&priv->mutex);
+
+  /* Release previous status */
+  melo_player_status_unref (old);
 }
 
 /**
@@ -892,7 +1146,7 @@ melo_player_reset_status (MeloPlayer *player, MeloPlayerState state,
   if (!status)
     return FALSE;
 
-  /* Lock player status access */
+  /* Lock player status update */
   g_mutex_lock (&priv->mutex);
 
   /* Copy values from previous status */
@@ -901,12 +1155,14 @@ melo_player_reset_status (MeloPlayer *player, MeloPlayerState state,
   status->has_prev = priv->status->has_prev;
   status->has_next = priv->status->has_next;
 
-  /* Set new player status */
-  melo_player_status_unref (priv->status);
-  priv->status = status;
+  /* Publish new player status */
+  melo_player_status_publish (priv, status);
 
-  /* Unlock player status access */
-  g_mutex_unlock (&priv->mutex);
+  /* Reset position clock */
+  melo_player_clock_reset (priv, state);
+  g_mutex_lock (&priv->clock_mutex);
+  priv->clock_duration = 0;
+  g_mutex_unlock (&priv->clock_mutex);
 
   return TRUE;
 }
@@ -923,15 +1179,20 @@ void
 melo_player_set_status_state (MeloPlayer *player, MeloPlayerState state)
 {
   MeloPlayerPrivate *priv = player->priv;
+  MeloPlayerStatus *status;
 
   /* Update state */
-  g_mutex_lock (&priv->mutex);
-  priv-> status->state = state;
-  g_mutex_unlock (&priv->mutex);
+  status = melo_player_status_edit (priv);
+  if (!status)
+    return;
+  status->state = state;
+  melo_player_status_publish (priv, status);
+
+  /* Reset position clock */
+  melo_player_clock_reset (priv, state);
 
   /* Send 'player state' event */
   melo_event_player_state (priv->id, state);
-  melo_player_updated (priv);
 }
 
 /**
@@ -948,16 +1209,21 @@ melo_player_set_status_buffering (MeloPlayer *player, MeloPlayerState state,
                                   guint percent)
 {
   MeloPlayerPrivate *priv = player->priv;
+  MeloPlayerStatus *status;
 
   /* Update state and buffer percent */
-  g_mutex_lock (&priv->mutex);
-  priv->status->state = state;
-  priv->status->buffer_percent = percent;
-  g_mutex_unlock (&priv->mutex);
+  status = melo_player_status_edit (priv);
+  if (!status)
+    return;
+  status->state = state;
+  status->buffer_percent = percent;
+  melo_player_status_publish (priv, status);
+
+  /* Reset position clock */
+  melo_player_clock_reset (priv, state);
 
   /* Send 'player buffering' event */
   melo_event_player_buffering (priv->id, state, percent);
-  melo_player_updated (priv);
 }
 
 /**
@@ -973,15 +1239,25 @@ void
 melo_player_set_status_pos (MeloPlayer *player, gint pos)
 {
   MeloPlayerPrivate *priv = player->priv;
+  MeloPlayerStatus *status;
 
   /* Update position */
-  g_mutex_lock (&priv->mutex);
-  priv->status->pos = pos;
-  g_mutex_unlock (&priv->mutex);
+  status = melo_player_status_edit (priv);
+  if (!status)
+    return;
+  status->pos = pos;
+  melo_player_status_publish (priv, status);
+
+  /* Set position clock */
+  g_mutex_lock (&priv->clock_mutex);
+  priv->clock_gen++;
+  priv->clock_valid = TRUE;
+  priv->clock_pos = pos;
+  priv->clock_time = g_get_monotonic_time ();
+  g_mutex_unlock (&priv->clock_mutex);
 
   /* Send 'player seek' event */
   melo_event_player_seek (priv->id, pos);
-  melo_player_updated (priv);
 }
 
 /**
@@ -996,15 +1272,22 @@ void
 melo_player_set_status_duration (MeloPlayer *player, gint duration)
 {
   MeloPlayerPrivate *priv = player->priv;
+  MeloPlayerStatus *status;
 
   /* Update duration */
-  g_mutex_lock (&priv->mutex);
-  priv->status->duration = duration;
-  g_mutex_unlock (&priv->mutex);
+  status = melo_player_status_edit (priv);
+  if (!status)
+    return;
+  status->duration = duration;
+  melo_player_status_publish (priv, status);
+
+  /* Set position clock limit */
+  g_mutex_lock (&priv->clock_mutex);
+  priv->clock_duration = duration;
+  g_mutex_unlock (&priv->clock_mutex);
 
   /* Send 'player duration' event */
   melo_event_player_duration (priv->id, duration);
-  melo_player_updated (priv);
 }
 
 /**
@@ -1022,16 +1305,18 @@ melo_player_set_status_playlist (MeloPlayer *player, gboolean has_prev,
                                  gboolean has_next)
 {
   MeloPlayerPrivate *priv = player->priv;
+  MeloPlayerStatus *status;
 
   /* Update playlist */
-  g_mutex_lock (&priv->mutex);
-  priv->status->has_prev = has_prev;
-  priv->status->has_next = has_next;
-  g_mutex_unlock (&priv->mutex);
+  status = melo_player_status_edit (priv);
+  if (!status)
+    return;
+  status->has_prev = has_prev;
+  status->has_next = has_next;
+  melo_player_status_publish (priv, status);
 
   /* Send 'player playlist' event */
   melo_event_player_playlist (priv->id, has_prev, has_next);
-  melo_player_updated (priv);
 }
 
 /**
@@ -1046,15 +1331,17 @@ void
 melo_player_set_status_volume (MeloPlayer *player, gdouble volume)
 {
   MeloPlayerPrivate *priv = player->priv;
+  MeloPlayerStatus *status;
 
   /* Update volume */
-  g_mutex_lock (&priv->mutex);
-  priv->status->volume = volume;
-  g_mutex_unlock (&priv->mutex);
+  status = melo_player_status_edit (priv);
+  if (!status)
+    return;
+  status->volume = volume;
+  melo_player_status_publish (priv, status);
 
   /* Send 'player volume' event */
   melo_event_player_volume (priv->id, volume);
-  melo_player_updated (priv);
 }
 
 /**
@@ -1069,15 +1356,17 @@ void
 melo_player_set_status_mute (MeloPlayer *player, gboolean mute)
 {
   MeloPlayerPrivate *priv = player->priv;
+  MeloPlayerStatus *status;
 
   /* Update mute */
-  g_mutex_lock (&priv->mutex);
-  priv->status->mute = mute;
-  g_mutex_unlock (&priv->mutex);
+  status = melo_player_status_edit (priv);
+  if (!status)
+    return;
+  status->mute = mute;
+  melo_player_status_publish (priv, status);
 
   /* Send 'player mute' event */
   melo_event_player_mute (priv->id, mute);
-  melo_player_updated (priv);
 }
 
 static void
@@ -1108,15 +1397,17 @@ void
 melo_player_set_status_name (MeloPlayer *player, const gchar *name)
 {
   MeloPlayerPrivate *priv = player->priv;
+  MeloPlayerStatus *status;
 
   /* Update name */
-  g_mutex_lock (&priv->mutex);
-  melo_player_status_set_name (priv->status, name);
-  g_mutex_unlock (&priv->mutex);
+  status = melo_player_status_edit (priv);
+  if (!status)
+    return;
+  melo_player_status_set_name (status, name);
+  melo_player_status_publish (priv, status);
 
   /* Send 'player name' event */
   melo_event_player_name (priv->id, name);
-  melo_player_updated (priv);
 }
 
 static void
@@ -1149,15 +1440,21 @@ void
 melo_player_set_status_error (MeloPlayer *player, const gchar *error)
 {
   MeloPlayerPrivate *priv = player->priv;
+  MeloPlayerStatus *status;
 
   /* Update error */
-  g_mutex_lock (&priv->mutex);
-  melo_player_status_set_error (priv->status, error);
-  g_mutex_unlock (&priv->mutex);
+  status = melo_player_status_edit (priv);
+  if (!status)
+    return;
+  melo_player_status_set_error (status, error);
+  melo_player_status_publish (priv, status);
+
+  /* Stop position clock */
+  if (error)
+    melo_player_clock_reset (priv, MELO_PLAYER_STATE_ERROR);
 
   /* Send 'player error' event */
   melo_event_player_error (priv->id, error);
-  melo_player_updated (priv);
 }
 
 static void
@@ -1195,15 +1492,20 @@ void
 melo_player_take_status_tags (MeloPlayer *player, MeloTags *tags)
 {
   MeloPlayerPrivate *priv = player->priv;
+  MeloPlayerStatus *status;
 
   /* Set new tags */
-  g_mutex_lock (&priv->mutex);
-  melo_player_status_take_tags (priv->status, tags);
-  g_mutex_unlock (&priv->mutex);
+  status = melo_player_status_edit (priv);
+  if (!status) {
+    if (tags)
+      melo_tags_unref (tags);
+    return;
+  }
+  melo_player_status_take_tags (status, tags);
+  melo_player_status_publish (priv, status);
 
   /* Send 'player tags' event */
   melo_event_player_tags (priv->id, tags);
-  melo_player_updated (priv);
 }
 
 /**
@@ -1236,7 +1538,7 @@ melo_player_set_status_tags (MeloPlayer *player, MeloTags *tags)
 MeloPlayerStatus *
 melo_player_status_ref (MeloPlayerStatus *status)
 {
-  status->priv->ref_count++;
+  g_atomic_int_inc (&status->priv->ref_count);
   return status;
 }
 
@@ -1250,8 +1552,7 @@ melo_player_status_ref (MeloPlayerStatus *status)
 void
 melo_player_status_unref (MeloPlayerStatus *status)
 {
-  status->priv->ref_count--;
-  if (status->priv->ref_count)
+  if (!g_atomic_int_dec_and_test (&status->priv->ref_count))
     return;
 
   /* Free status */
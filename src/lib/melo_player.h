@@ -29,6 +29,14 @@
 
 G_BEGIN_DECLS
 
+/**
+ * MELO_PLAYER_POS_SYNC_INTERVAL_DEFAULT:
+ *
+ * Default interval (in ms) between two real position queries, see
+ * melo_player_set_pos_sync_interval().
+ */
+#define MELO_PLAYER_POS_SYNC_INTERVAL_DEFAULT 1000
+
 #define MELO_TYPE_PLAYER             (melo_player_get_type ())
 #define MELO_PLAYER(obj)             (G_TYPE_CHECK_INSTANCE_CAST ((obj), MELO_TYPE_PLAYER, MeloPlayer))
 #define MELO_IS_PLAYER(obj)          (G_TYPE_CHECK_INSTANCE_TYPE ((obj), MELO_TYPE_PLAYER))
@@ -219,6 +227,8 @@ gboolean melo_player_set_mute (MeloPlayer *player, gboolean mute);
 /* Player status */
 MeloPlayerStatus *melo_player_get_status (MeloPlayer *player,
                                           gint64 *timestamp);
+MeloPlayerStatus *melo_player_get_status_snapshot (MeloPlayer *player,
+                                                   gint64 *timestamp);
 MeloPlayerState melo_player_get_state (MeloPlayer *player);
 gchar *melo_player_get_media_name (MeloPlayer *player);
 gint melo_player_get_pos (MeloPlayer *player);
@@ -226,6 +236,9 @@ gdouble melo_player_get_volume (MeloPlayer *player);
 gboolean melo_player_get_mute (MeloPlayer *player);
 MeloTags *melo_player_get_tags (MeloPlayer *player);
 
+/* Player position interpolation */
+void melo_player_set_pos_sync_interval (guint interval);
+
 /* Protected functions for Player status update */
 gboolean melo_player_reset_status (MeloPlayer *player, MeloPlayerState state,
                                    const gchar *name, MeloTags *tags);
@@ -242,6 +255,7 @@ void melo_player_set_status_name (MeloPlayer *player, const gchar *name);
 void melo_player_set_status_error (MeloPlayer *player, const gchar *error);
 void melo_player_set_status_tags (MeloPlayer *player, MeloTags *tags);
 void melo_player_take_status_tags (MeloPlayer *player, MeloTags *tags);
+void melo_player_resync_pos (MeloPlayer *player);
 
 /* MeloPlayerStatus functions */
 MeloPlayerStatus *melo_player_status_ref (MeloPlayerStatus *status);
@@ -30,13 +30,11 @@
  */
 
 static MeloPlayer *
-melo_player_jsonrpc_get_player (JsonObject *obj, JsonNode **error)
+melo_player_jsonrpc_get_player_by_id (const gchar *id, JsonNode **error)
 {
   MeloPlayer *play;
-  const gchar *id;
 
   /* Get player by id */
-  id = json_object_get_string_member (obj, "id");
   play = melo_player_get_player_by_id (id);
   if (play)
     return play;
@@ -47,6 +45,13 @@ melo_player_jsonrpc_get_player (JsonObject *obj, JsonNode **error)
   return NULL;
 }
 
+static MeloPlayer *
+melo_player_jsonrpc_get_player (JsonObject *obj, JsonNode **error)
+{
+  return melo_player_jsonrpc_get_player_by_id (
+                              json_object_get_string_member (obj, "id"), error);
+}
+
 /**
  * melo_player_jsonrpc_get_info_fields:
  * @obj: the #JsonObject to parse
@@ -141,19 +146,13 @@ melo_player_jsonrpc_info_to_object (const gchar *id,
 }
 
 static MeloPlayerJSONRPCStatusFields
-melo_player_jsonrpc_get_status_fields (JsonObject *obj, const char *name)
+melo_player_jsonrpc_get_status_fields_from_array (JsonArray *array)
 {
   MeloPlayerJSONRPCStatusFields fields = MELO_PLAYER_JSONRPC_STATUS_FIELDS_NONE;
   const gchar *field;
-  JsonArray *array;
   guint count, i;
 
-  /* Check if fields is available */
-  if (!json_object_has_member (obj, name))
-    return MELO_PLAYER_JSONRPC_STATUS_FIELDS_NONE;
-
-  /* Get fields array */
-  array = json_object_get_array_member (obj, name);
+  /* No fields array */
   if (!array)
     return MELO_PLAYER_JSONRPC_STATUS_FIELDS_NONE;
 
@@ -190,6 +189,38 @@ melo_player_jsonrpc_get_status_fields (JsonObject *obj, const char *name)
   return fields;
 }
 
+static MeloPlayerJSONRPCStatusFields
+melo_player_jsonrpc_get_status_fields (JsonObject *obj, const char *name)
+{
+  /* Check if fields is available */
+  if (!json_object_has_member (obj, name))
+    return MELO_PLAYER_JSONRPC_STATUS_FIELDS_NONE;
+
+  /* Get fields array */
+  return melo_player_jsonrpc_get_status_fields_from_array (
+                                      json_object_get_array_member (obj, name));
+}
+
+/* Tags to add in a status: %TRUE is returned with @tags set to %NULL when the
+ * status has no tags, and %FALSE when the tags are not updated since
+ * @tags_timestamp.
+ */
+static gboolean
+melo_player_jsonrpc_status_get_tags (const MeloPlayerStatus *status,
+                                     gint64 tags_timestamp, MeloTags **tags)
+{
+  /* Get tags from status */
+  *tags = melo_player_status_get_tags (status);
+  if (!*tags || tags_timestamp <= 0 ||
+      melo_tags_updated (*tags, tags_timestamp))
+    return TRUE;
+
+  /* Tags not updated */
+  melo_tags_unref (*tags);
+  *tags = NULL;
+  return FALSE;
+}
+
 /**
  * melo_player_jsonrpc_status_to_object:
  * @status: the #MeloPlayerStatus associated to the #MeloPlayer
@@ -209,8 +240,42 @@ melo_player_jsonrpc_status_to_object (const MeloPlayerStatus *status,
                                       MeloPlayerJSONRPCStatusFields fields,
                                       MeloTagsFields tags_fields,
                                       gint64 tags_timestamp)
+{
+  return melo_player_jsonrpc_status_to_object_with_pos (status, status->pos,
+                                                        fields, tags_fields,
+                                                        tags_timestamp);
+}
+
+/**
+ * melo_player_jsonrpc_status_to_object_with_pos:
+ * @status: the #MeloPlayerStatus associated to the #MeloPlayer
+ * @pos: the position to use in place of the one saved in @status (in ms)
+ * @fields: the fields to fill in the #JsonObject from the @status
+ * @tags_fields: the fields to copy from the #MeloTags included in the
+ *    #MeloPlayerStatus
+ * @tags_timestamp: the timestamp from #MeloTags
+ *
+ * Same as melo_player_jsonrpc_status_to_object() with the position provided
+ * by @pos, which avoids a copy of a shared #MeloPlayerStatus returned by
+ * melo_player_get_status_snapshot() to update its position.
+ *
+ * Returns: (transfer full): a new #JsonObject containing request status or
+ * %NULL if an error occurred.
+ */
+JsonObject *
+melo_player_jsonrpc_status_to_object_with_pos (
+                                           const MeloPlayerStatus *status,
+                                           gint pos,
+                                           MeloPlayerJSONRPCStatusFields fields,
+                                           MeloTagsFields tags_fields,
+                                           gint64 tags_timestamp)
 {
   JsonObject *obj = json_object_new ();
+
+  /* The members must be kept in sync with
+   * melo_player_jsonrpc_status_to_writer(), used by the methods to write the
+   * status directly in the response.
+   */
   if (fields & MELO_PLAYER_JSONRPC_STATUS_FIELDS_STATE) {
     json_object_set_string_member (obj, "state",
                                    melo_player_state_to_string (status->state));
@@ -229,7 +294,7 @@ melo_player_jsonrpc_status_to_object (const MeloPlayerStatus *status,
     melo_player_status_unlock (status);
   }
   if (fields & MELO_PLAYER_JSONRPC_STATUS_FIELDS_POS)
-    json_object_set_int_member (obj, "pos", status->pos);
+    json_object_set_int_member (obj, "pos", pos);
   if (fields & MELO_PLAYER_JSONRPC_STATUS_FIELDS_DURATION)
     json_object_set_int_member (obj, "duration", status->duration);
   if (fields & MELO_PLAYER_JSONRPC_STATUS_FIELDS_PLAYLIST) {
@@ -243,20 +308,91 @@ melo_player_jsonrpc_status_to_object (const MeloPlayerStatus *status,
   if (fields & MELO_PLAYER_JSONRPC_STATUS_FIELDS_TAGS) {
     MeloTags *tags;
 
-    /* Get tags from status */
-    tags = melo_player_status_get_tags (status);
-    if (tags) {
-      if (tags_timestamp <= 0 || melo_tags_updated (tags, tags_timestamp))
+    /* Add tags if updated */
+    if (melo_player_jsonrpc_status_get_tags (status, tags_timestamp, &tags)) {
+      if (tags) {
         json_object_set_object_member (obj, "tags",
                                        melo_tags_to_json_object (tags,
                                                                  tags_fields));
-      melo_tags_unref (tags);
-    } else
-      json_object_set_null_member (obj, "tags");
+        melo_tags_unref (tags);
+      } else
+        json_object_set_null_member (obj, "tags");
+    }
   }
   return obj;
 }
 
+static void
+melo_player_jsonrpc_status_to_writer (const MeloPlayerStatus *status,
+                                      gint pos,
+                                      MeloPlayerJSONRPCStatusFields fields,
+                                      MeloTagsFields tags_fields,
+                                      gint64 tags_timestamp,
+                                      MeloJSONRPCWriter *w)
+{
+  /* Same members as melo_player_jsonrpc_status_to_object_with_pos(), which
+   * must be updated with this function.
+   */
+  melo_jsonrpc_writer_begin_object (w);
+  if (fields & MELO_PLAYER_JSONRPC_STATUS_FIELDS_STATE) {
+    melo_jsonrpc_writer_set_member_name (w, "state");
+    melo_jsonrpc_writer_add_string_value (w,
+                                  melo_player_state_to_string (status->state));
+    if (status->state == MELO_PLAYER_STATE_ERROR) {
+      melo_player_status_lock (status);
+      melo_jsonrpc_writer_set_member_name (w, "error");
+      melo_jsonrpc_writer_add_string_value (w,
+                                    melo_player_status_lock_get_error (status));
+      melo_player_status_unlock (status);
+    }
+    melo_jsonrpc_writer_set_member_name (w, "buffer");
+    melo_jsonrpc_writer_add_int_value (w, status->buffer_percent);
+  }
+  if (fields & MELO_PLAYER_JSONRPC_STATUS_FIELDS_NAME) {
+    melo_player_status_lock (status);
+    melo_jsonrpc_writer_set_member_name (w, "name");
+    melo_jsonrpc_writer_add_string_value (w,
+                                     melo_player_status_lock_get_name (status));
+    melo_player_status_unlock (status);
+  }
+  if (fields & MELO_PLAYER_JSONRPC_STATUS_FIELDS_POS) {
+    melo_jsonrpc_writer_set_member_name (w, "pos");
+    melo_jsonrpc_writer_add_int_value (w, pos);
+  }
+  if (fields & MELO_PLAYER_JSONRPC_STATUS_FIELDS_DURATION) {
+    melo_jsonrpc_writer_set_member_name (w, "duration");
+    melo_jsonrpc_writer_add_int_value (w, status->duration);
+  }
+  if (fields & MELO_PLAYER_JSONRPC_STATUS_FIELDS_PLAYLIST) {
+    melo_jsonrpc_writer_set_member_name (w, "has_prev");
+    melo_jsonrpc_writer_add_boolean_value (w, status->has_prev);
+    melo_jsonrpc_writer_set_member_name (w, "has_next");
+    melo_jsonrpc_writer_add_boolean_value (w, status->has_next);
+  }
+  if (fields & MELO_PLAYER_JSONRPC_STATUS_FIELDS_VOLUME) {
+    melo_jsonrpc_writer_set_member_name (w, "volume");
+    melo_jsonrpc_writer_add_double_value (w, status->volume);
+  }
+  if (fields & MELO_PLAYER_JSONRPC_STATUS_FIELDS_MUTE) {
+    melo_jsonrpc_writer_set_member_name (w, "mute");
+    melo_jsonrpc_writer_add_boolean_value (w, status->mute);
+  }
+  if (fields & MELO_PLAYER_JSONRPC_STATUS_FIELDS_TAGS) {
+    MeloTags *tags;
+
+    /* Add tags if updated */
+    if (melo_player_jsonrpc_status_get_tags (status, tags_timestamp, &tags)) {
+      melo_jsonrpc_writer_set_member_name (w, "tags");
+      if (tags) {
+        melo_tags_to_jsonrpc_writer (tags, w, tags_fields);
+        melo_tags_unref (tags);
+      } else
+        melo_jsonrpc_writer_add_null_value (w);
+    }
+  }
+  melo_jsonrpc_writer_end_object (w);
+}
+
 static JsonArray *
 melo_player_jsonrpc_list_to_array (GList *list,
                                    MeloPlayerJSONRPCInfoFields fields,
@@ -292,11 +428,13 @@ melo_player_jsonrpc_list_to_array (GList *list,
       JsonObject *o;
 
       /* Get status */
-      status = melo_player_get_status (play, NULL);
+      status = melo_player_get_status_snapshot (play, NULL);
       if (status) {
         /* Generate status */
-        o = melo_player_jsonrpc_status_to_object (status, sfields, tags_fields,
-                                                  tags_timestamp);
+        o = melo_player_jsonrpc_status_to_object_with_pos (status,
+                                                    melo_player_get_pos (play),
+                                                    sfields, tags_fields,
+                                                    tags_timestamp);
         melo_player_status_unref (status);
 
         /* Add status */
@@ -561,58 +699,67 @@ melo_player_jsonrpc_set_mute (const gchar *method,
   json_node_take_object (*result, obj);
 }
 
+/* Parameters of get_status, in the order of the schema */
+typedef struct {
+  MeloJSONRPCValue id;
+  MeloJSONRPCValue fields;
+  MeloJSONRPCValue tags;
+  MeloJSONRPCValue tags_ts;
+} MeloPlayerJSONRPCGetStatusParams;
+
 static void
 melo_player_jsonrpc_get_status (const gchar *method,
                                 JsonArray *s_params, JsonNode *params,
                                 JsonNode **result, JsonNode **error,
                                 gpointer user_data)
 {
+  MeloPlayerJSONRPCGetStatusParams p = { { 0 } };
   MeloPlayerJSONRPCStatusFields fields = MELO_PLAYER_JSONRPC_STATUS_FIELDS_NONE;
   MeloTagsFields tags_fields = MELO_TAGS_FIELDS_NONE;
   MeloPlayerStatus *status = NULL;
+  MeloJSONRPCWriter *w;
   MeloPlayer *play;
-  JsonArray *array;
   JsonObject *obj;
-  gint64 tags_ts = 0;
+  gint pos;
 
   /* Get parameters */
-  obj = melo_jsonrpc_get_object (s_params, params, error);
-  if (!obj)
+  if (!melo_jsonrpc_get_params (s_params, params, &p, error))
     return;
 
   /* Get player from id */
-  play = melo_player_jsonrpc_get_player (obj, error);
-  if (!play) {
-    json_object_unref (obj);
+  play = melo_player_jsonrpc_get_player_by_id (p.id.s, error);
+  if (!play)
     return;
-  }
 
   /* Get fields */
-  fields = melo_player_jsonrpc_get_status_fields (obj, "fields");
+  fields = melo_player_jsonrpc_get_status_fields_from_array (p.fields.a);
 
   /* Get tags fields */
-  if (fields & MELO_PLAYER_JSONRPC_STATUS_FIELDS_TAGS &&
-      json_object_has_member (obj, "tags")) {
-    /* Get tags fields array */
-    array = json_object_get_array_member (obj, "tags");
-    if (array)
-      tags_fields = melo_tags_get_fields_from_json_array (array);
-
-    /* Get tags timestamp */
-    if (json_object_has_member (obj, "tags_ts"))
-      tags_ts = json_object_get_int_member (obj, "tags_ts");
-  }
-  json_object_unref (obj);
-
-  /* Get status */
-  status = melo_player_get_status (play, NULL);
+  if (fields & MELO_PLAYER_JSONRPC_STATUS_FIELDS_TAGS && p.tags.a)
+    tags_fields = melo_tags_get_fields_from_json_array (p.tags.a);
+  else
+    p.tags_ts.i = 0;
+
+  /* Get status and current position */
+  status = melo_player_get_status_snapshot (play, NULL);
+  pos = melo_player_get_pos (play);
   g_object_unref (play);
   if (!status)
     return;
 
+  /* Write status directly when possible */
+  w = melo_jsonrpc_get_result_writer ();
+  if (w) {
+    melo_player_jsonrpc_status_to_writer (status, pos, fields, tags_fields,
+                                          p.tags_ts.i, w);
+    melo_player_status_unref (status);
+    return;
+  }
+
   /* Generate status */
-  obj = melo_player_jsonrpc_status_to_object (status, fields,
-                                              tags_fields, tags_ts);
+  obj = melo_player_jsonrpc_status_to_object_with_pos (status, pos, fields,
+                                                       tags_fields,
+                                                       p.tags_ts.i);
   melo_player_status_unref (status);
 
   /* Return result */
@@ -682,6 +829,7 @@ static MeloJSONRPCMethod melo_player_jsonrpc_methods[] = {
     .result = "{\"type\":\"array\"}",
     .callback = melo_player_jsonrpc_get_list,
     .user_data = NULL,
+    .flags = MELO_JSONRPC_FLAG_CONCURRENT,
   },
   {
     .method = "get_info",
@@ -695,6 +843,7 @@ static MeloJSONRPCMethod melo_player_jsonrpc_methods[] = {
     .result = "{\"type\":\"object\"}",
     .callback = melo_player_jsonrpc_get_info,
     .user_data = NULL,
+    .flags = MELO_JSONRPC_FLAG_CONCURRENT,
   },
   {
     .method = "set_state",
@@ -705,6 +854,7 @@ static MeloJSONRPCMethod melo_player_jsonrpc_methods[] = {
     .result = "{\"type\":\"object\"}",
     .callback = melo_player_jsonrpc_set_state,
     .user_data = NULL,
+    .priority = MELO_JSONRPC_PRIORITY_CONTROL,
   },
   {
     .method = "set_pos",
@@ -715,6 +865,7 @@ static MeloJSONRPCMethod melo_player_jsonrpc_methods[] = {
     .result = "{\"type\":\"object\"}",
     .callback = melo_player_jsonrpc_set_pos,
     .user_data = NULL,
+    .priority = MELO_JSONRPC_PRIORITY_CONTROL,
   },
   {
     .method = "set_volume",
@@ -725,6 +876,7 @@ static MeloJSONRPCMethod melo_player_jsonrpc_methods[] = {
     .result = "{\"type\":\"object\"}",
     .callback = melo_player_jsonrpc_set_volume,
     .user_data = NULL,
+    .priority = MELO_JSONRPC_PRIORITY_CONTROL,
   },
   {
     .method = "set_mute",
@@ -735,6 +887,7 @@ static MeloJSONRPCMethod melo_player_jsonrpc_methods[] = {
     .result = "{\"type\":\"object\"}",
     .callback = melo_player_jsonrpc_set_mute,
     .user_data = NULL,
+    .priority = MELO_JSONRPC_PRIORITY_CONTROL,
   },
   {
     .method = "get_status",
@@ -756,6 +909,7 @@ static MeloJSONRPCMethod melo_player_jsonrpc_methods[] = {
     .result = "{\"type\":\"object\"}",
     .callback = melo_player_jsonrpc_get_status,
     .user_data = NULL,
+    .flags = MELO_JSONRPC_FLAG_CONCURRENT,
   },
   {
     .method = "prev",
@@ -765,6 +919,7 @@ static MeloJSONRPCMethod melo_player_jsonrpc_methods[] = {
     .result = "{\"type\":\"object\"}",
     .callback = melo_player_jsonrpc_action,
     .user_data = NULL,
+    .priority = MELO_JSONRPC_PRIORITY_CONTROL,
   },
   {
     .method = "next",
@@ -774,6 +929,7 @@ static MeloJSONRPCMethod melo_player_jsonrpc_methods[] = {
     .result = "{\"type\":\"object\"}",
     .callback = melo_player_jsonrpc_action,
     .user_data = NULL,
+    .priority = MELO_JSONRPC_PRIORITY_CONTROL,
   },
 };
 
@@ -90,6 +90,12 @@ JsonObject * melo_player_jsonrpc_status_to_object (
                                            MeloPlayerJSONRPCStatusFields fields,
                                            MeloTagsFields tags_fields,
                                            gint64 tags_timestamp);
+JsonObject * melo_player_jsonrpc_status_to_object_with_pos (
+                                           const MeloPlayerStatus *status,
+                                           gint pos,
+                                           MeloPlayerJSONRPCStatusFields fields,
+                                           MeloTagsFields tags_fields,
+                                           gint64 tags_timestamp);
 /* JSON-RPC methods */
 void melo_player_jsonrpc_register_methods (void);
 void melo_player_jsonrpc_unregister_methods (void);
@@ -114,6 +114,8 @@ struct _MeloPlaylistClass {
  * MeloPlaylistList:
  * @current: the media ID of the current playing media
  * @items: a #GList of #MeloPlaylistItem
+ * @version: the version of the playlist, incremented on each change (it is
+ *    sent in #MeloEventPlaylist events), or 0 if not supported
  *
  * A #MeloPlaylistList contains the current media list of a #MeloPlaylist
  * presented with a #GList of #MeloPlaylistItem and the current media playing
@@ -122,6 +124,7 @@ struct _MeloPlaylistClass {
 struct _MeloPlaylistList {
   gchar *current;
   GList *items;
+  guint version;
 };
 
 /**
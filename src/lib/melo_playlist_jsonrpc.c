@@ -99,6 +99,51 @@ melo_playlist_jsonrpc_get_list_fields (JsonObject *obj)
   return fields;
 }
 
+static JsonObject *
+melo_playlist_jsonrpc_item_to_object_fields (const MeloPlaylistItem *item,
+                                          MeloPlaylistJSONRPCListFields fields,
+                                          MeloTagsFields tags_fields)
+{
+  JsonObject *obj = json_object_new ();
+
+  if (fields & MELO_PLAYLIST_JSONRPC_LIST_FIELDS_ID)
+    json_object_set_string_member (obj, "id", item->id);
+  if (fields & MELO_PLAYLIST_JSONRPC_LIST_FIELDS_NAME)
+    json_object_set_string_member (obj, "name", item->name);
+  if (fields & MELO_PLAYLIST_JSONRPC_LIST_FIELDS_CMDS) {
+    json_object_set_boolean_member (obj, "can_play", item->can_play);
+    json_object_set_boolean_member (obj, "can_remove", item->can_remove);
+  }
+  if (fields & MELO_PLAYLIST_JSONRPC_LIST_FIELDS_TAGS) {
+    if (item->tags) {
+      JsonObject *tags = melo_tags_to_json_object (item->tags, tags_fields);
+      json_object_set_object_member (obj, "tags", tags);
+    } else
+      json_object_set_null_member (obj, "tags");
+  }
+
+  return obj;
+}
+
+/**
+ * melo_playlist_jsonrpc_item_to_object:
+ * @item: the #MeloPlaylistItem to convert
+ * @tags_fields: the #MeloTagsFields to add for the media tags
+ *
+ * Convert a #MeloPlaylistItem to a #JsonObject with all its fields, as in the
+ * list returned by the "playlist.get_list" method.
+ *
+ * Returns: (transfer full): a new #JsonObject with the item details.
+ */
+JsonObject *
+melo_playlist_jsonrpc_item_to_object (const MeloPlaylistItem *item,
+                                      MeloTagsFields tags_fields)
+{
+  return melo_playlist_jsonrpc_item_to_object_fields (item,
+                                         MELO_PLAYLIST_JSONRPC_LIST_FIELDS_FULL,
+                                         tags_fields);
+}
+
 JsonArray *
 melo_playlist_jsonrpc_list_to_array (const GList *list,
                                      MeloPlaylistJSONRPCListFields fields,
@@ -111,22 +156,8 @@ melo_playlist_jsonrpc_list_to_array (const GList *list,
   array = json_array_new ();
   for (l = list; l != NULL; l = l->next) {
     MeloPlaylistItem *item = (MeloPlaylistItem *) l->data;
-    JsonObject *obj = json_object_new ();
-    if (fields & MELO_PLAYLIST_JSONRPC_LIST_FIELDS_ID)
-      json_object_set_string_member (obj, "id", item->id);
-    if (fields & MELO_PLAYLIST_JSONRPC_LIST_FIELDS_NAME)
-      json_object_set_string_member (obj, "name", item->name);
-    if (fields & MELO_PLAYLIST_JSONRPC_LIST_FIELDS_CMDS) {
-      json_object_set_boolean_member (obj, "can_play", item->can_play);
-      json_object_set_boolean_member (obj, "can_remove", item->can_remove);
-    }
-    if (fields & MELO_PLAYLIST_JSONRPC_LIST_FIELDS_TAGS) {
-      if (item->tags) {
-        JsonObject *tags = melo_tags_to_json_object (item->tags, tags_fields);
-        json_object_set_object_member (obj, "tags", tags);
-      } else
-        json_object_set_null_member (obj, "tags");
-    }
+    JsonObject *obj = melo_playlist_jsonrpc_item_to_object_fields (item, fields,
+                                                                tags_fields);
     json_array_add_object_element (array, obj);
   }
 
@@ -185,6 +216,7 @@ melo_playlist_jsonrpc_get_list (const gchar *method,
   /* Create a new object */
   obj = json_object_new ();
   json_object_set_string_member (obj, "current", list->current);
+  json_object_set_int_member (obj, "version", list->version);
 
   /* Create array from list */
   array = melo_playlist_jsonrpc_list_to_array (list->items, fields,
@@ -452,6 +484,7 @@ static MeloJSONRPCMethod melo_playlist_jsonrpc_methods[] = {
     .result = "{\"type\":\"object\"}",
     .callback = melo_playlist_jsonrpc_get_list,
     .user_data = NULL,
+    .flags = MELO_JSONRPC_FLAG_READ_ONLY | MELO_JSONRPC_FLAG_CONCURRENT,
   },
   {
     .method = "get_tags",
@@ -466,6 +499,7 @@ static MeloJSONRPCMethod melo_playlist_jsonrpc_methods[] = {
     .result = "{\"type\":\"object\"}",
     .callback = melo_playlist_jsonrpc_get_tags,
     .user_data = NULL,
+    .flags = MELO_JSONRPC_FLAG_READ_ONLY | MELO_JSONRPC_FLAG_CONCURRENT,
   },
   {
     .method = "play",
@@ -476,6 +510,7 @@ static MeloJSONRPCMethod melo_playlist_jsonrpc_methods[] = {
     .result = "{\"type\":\"object\"}",
     .callback = melo_playlist_jsonrpc_item_action,
     .user_data = NULL,
+    .priority = MELO_JSONRPC_PRIORITY_CONTROL,
   },
   {
     .method = "sort",
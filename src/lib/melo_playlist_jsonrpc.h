@@ -25,6 +25,9 @@
 #include "melo_playlist.h"
 #include "melo_jsonrpc.h"
 
+JsonObject *melo_playlist_jsonrpc_item_to_object (const MeloPlaylistItem *item,
+                                                  MeloTagsFields tags_fields);
+
 /* JSON-RPC methods */
 void melo_playlist_jsonrpc_register_methods (void);
 void melo_playlist_jsonrpc_unregister_methods (void);
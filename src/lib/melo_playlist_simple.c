@@ -21,6 +21,7 @@
 
 #include <string.h>
 
+#include "melo_event.h"
 #include "melo_player.h"
 #include "melo_playlist_simple.h"
 
@@ -38,6 +39,10 @@
  * #MeloPlaylistSimple:removable which respectively indicates if a media can be
  * played (with the associated #MeloPlayer) or if a media can be removed from
  * the playlist.
+ *
+ * Each change on the playlist is sent with a #MeloEventPlaylist event which
+ * describes only the change, so a client can keep its copy of the playlist
+ * up to date without fetching the full list again.
  */
 
 #define MELO_PLAYLIST_SIMPLE_ID_EXT_SIZE 10
@@ -93,6 +98,7 @@ struct _MeloPlaylistSimplePrivate {
   GList *playlist;
   GHashTable *ids;
   GList *current;
+  guint version;
   gboolean playable;
   gboolean removable;
 };
@@ -246,6 +252,7 @@ melo_playlist_simple_get_list (MeloPlaylist *playlist,
                                   (GCopyFunc) melo_playlist_item_ref, NULL);
   if (priv->current)
     list->current = g_strdup (((MeloPlaylistItem *) priv->current->data)->id);
+  list->version = priv->version;
 
   /* Unlock playlist */
   g_mutex_unlock (&priv->mutex);
@@ -294,6 +301,24 @@ melo_playlist_simple_update_player_status (MeloPlaylistSimple *plsimple)
                                      priv->current && priv->current->prev);
 }
 
+static inline const gchar *
+melo_playlist_simple_get_item_id (GList *element)
+{
+  return element ? ((MeloPlaylistItem *) element->data)->id : NULL;
+}
+
+static inline void
+melo_playlist_simple_set_current (MeloPlaylistSimple *plsimple, GList *current)
+{
+  MeloPlaylistSimplePrivate *priv = plsimple->priv;
+
+  /* Set current and send 'playlist current' event */
+  priv->current = current;
+  melo_event_playlist_current (melo_playlist_get_id (MELO_PLAYLIST (plsimple)),
+                               ++priv->version,
+                               melo_playlist_simple_get_item_id (current));
+}
+
 static gboolean
 melo_playlist_simple_add (MeloPlaylist *playlist, const gchar *path,
                           const gchar *name, MeloTags *tags,
@@ -331,9 +356,13 @@ melo_playlist_simple_add (MeloPlaylist *playlist, const gchar *path,
   priv->playlist = g_list_prepend (priv->playlist, item);
   g_hash_table_insert (priv->ids, id, priv->playlist);
 
+  /* Send 'playlist add' event */
+  melo_event_playlist_add (melo_playlist_get_id (playlist), ++priv->version, 0,
+                           item);
+
   /* Set as current */
   if (is_current)
-    priv->current = priv->playlist;
+    melo_playlist_simple_set_current (plsimple, priv->playlist);
 
   /* Update player status */
   melo_playlist_simple_update_player_status (plsimple);
@@ -365,7 +394,7 @@ melo_playlist_simple_get_prev (MeloPlaylist *playlist, gchar **id,
     if (tags && item->tags)
       *tags = melo_tags_ref (item->tags);
     if (set) {
-      priv->current = priv->current->next;
+      melo_playlist_simple_set_current (plsimple, priv->current->next);
       melo_playlist_simple_update_player_status (plsimple);
     }
   }
@@ -397,7 +426,7 @@ melo_playlist_simple_get_next (MeloPlaylist *playlist, gchar **id,
     if (tags && item->tags)
       *tags = melo_tags_ref (item->tags);
     if (set) {
-      priv->current = priv->current->prev;
+      melo_playlist_simple_set_current (plsimple, priv->current->prev);
       melo_playlist_simple_update_player_status (plsimple);
     }
   }
@@ -466,7 +495,7 @@ melo_playlist_simple_play (MeloPlaylist *playlist, const gchar *id)
   if (element) {
     item = (MeloPlaylistItem *) element->data;
     melo_playlist_item_ref (item);
-    priv->current = element;
+    melo_playlist_simple_set_current (plsimple, element);
   }
 
   /* Update player status */
@@ -495,6 +524,7 @@ melo_playlist_simple_sort (MeloPlaylist *playlist, const gchar *id, guint count,
   MeloPlaylistSimple *plsimple = MELO_PLAYLIST_SIMPLE (playlist);
   MeloPlaylistSimplePrivate *priv = plsimple->priv;
   GList *head, *tail, *list;
+  GPtrArray *ids;
 
   /* Lock playlist (current by default) */
   g_mutex_lock (&priv->mutex);
@@ -540,6 +570,15 @@ melo_playlist_simple_sort (MeloPlaylist *playlist, const gchar *id, guint count,
   }
   priv->playlist = head ? head : list;
 
+  /* Send 'playlist sort' event with new order of sorted medias */
+  ids = g_ptr_array_new ();
+  for (; list != tail; list = list->next)
+    g_ptr_array_add (ids, g_strdup (melo_playlist_simple_get_item_id (list)));
+  g_ptr_array_add (ids, NULL);
+  melo_event_playlist_sort (melo_playlist_get_id (playlist), ++priv->version,
+                            melo_playlist_simple_get_item_id (head),
+                            (gchar **) g_ptr_array_free (ids, FALSE));
+
 done:
   /* Unlock playlist */
   g_mutex_unlock (&priv->mutex);
@@ -622,6 +661,11 @@ melo_playlist_simple_move (MeloPlaylist *playlist, const gchar *id, gint up,
   priv->playlist = melo_playlist_simple_move_list (priv->playlist, start, end,
                                                    after);
 
+  /* Send 'playlist move' event */
+  melo_event_playlist_move (melo_playlist_get_id (playlist), ++priv->version,
+                            melo_playlist_simple_get_item_id (start), count + 1,
+                            melo_playlist_simple_get_item_id (after));
+
   /* Unlock playlist */
   g_mutex_unlock (&priv->mutex);
 
@@ -669,6 +713,11 @@ melo_playlist_simple_move_to (MeloPlaylist *playlist, const gchar *id,
   priv->playlist = melo_playlist_simple_move_list (priv->playlist, start, end,
                                                    after);
 
+  /* Send 'playlist move' event */
+  melo_event_playlist_move (melo_playlist_get_id (playlist), ++priv->version,
+                            melo_playlist_simple_get_item_id (start), count + 1,
+                            melo_playlist_simple_get_item_id (after));
+
   /* Unlock playlist */
   g_mutex_unlock (&priv->mutex);
 
@@ -706,9 +755,13 @@ melo_playlist_simple_remove (MeloPlaylist *playlist, const gchar *id)
   if (element == priv->current) {
     if (playlist->player)
       melo_player_set_state (playlist->player, MELO_PLAYER_STATE_NONE);
-    priv->current = NULL;
+    melo_playlist_simple_set_current (plsimple, NULL);
   }
 
+  /* Send 'playlist remove' event */
+  melo_event_playlist_remove (melo_playlist_get_id (playlist), ++priv->version,
+                              item->id);
+
   /* Remove from list and hash table */
   priv->playlist = g_list_remove (priv->playlist, item);
   g_hash_table_remove (priv->ids, id);
@@ -744,6 +797,9 @@ melo_playlist_simple_empty (MeloPlaylist *playlist)
   g_hash_table_remove_all (priv->ids);
   priv->playlist = NULL;
 
+  /* Send 'playlist empty' event */
+  melo_event_playlist_empty (melo_playlist_get_id (playlist), ++priv->version);
+
   /* Update player status */
   melo_playlist_simple_update_player_status (plsimple);
 
@@ -19,6 +19,9 @@
  * Boston, MA  02110-1301, USA.
  */
 
+#include <gst/app/gstappsink.h>
+#include <gst/app/gstappsrc.h>
+
 #include "melo_sink.h"
 
 /**
@@ -41,7 +44,12 @@
  *
  * The function melo_sink_get_gst_sink() is intended to provide a sink
  * compatible #GstElement to be embedded in a full audio pipeline. The audio
- * mixing and control is then hided by the #MeloSink implementation.
+ * mixing and control is then hided by the #MeloSink implementation: the
+ * samples are converted to the main output format and pushed to a single
+ * long-lived mixer pipeline which holds the sound card. The clock of this main
+ * pipeline is provided to all player pipelines. The sound card can be changed
+ * at any time with melo_sink_set_main_device(), without any action on the
+ * player pipelines.
  *
  * In addition to provide a common interface for all audio sinks, the #MeloSink
  * embed a mechanism to save and restore each individual volume / mute settings
@@ -54,8 +62,37 @@
  * melo_sink_main_release() should be called.
  */
 
+/* Latency profiles of the sound card and main mixer */
+typedef struct {
+  const gchar *name;
+  gint64 buffer_time;
+  gint64 latency_time;
+  guint64 mixer_latency;
+} MeloSinkProfile;
+
+/* Duration of fade out / in when the sound card is changed (in ms) */
+#define MELO_SINK_FADE_TIME 50
+#define MELO_SINK_FADE_STEPS 10
+#define MELO_SINK_FADE_INTERVAL (MELO_SINK_FADE_TIME / MELO_SINK_FADE_STEPS)
+
+static const MeloSinkProfile melo_sink_profiles[] = {
+  { "low", 20000, 5000, 10 * GST_MSECOND },
+  { "balanced", 200000, 10000, 50 * GST_MSECOND },
+  { "power-save", 1000000, 50000, 200 * GST_MSECOND },
+};
+
 /* Main audio mixer pipeline */
 G_LOCK_DEFINE_STATIC (melo_sink_mutex);
+static GstElement *melo_sink_pipeline;
+static GstElement *melo_sink_mixer;
+static GstElement *melo_sink_src_filter;
+static GstElement *melo_sink_filter;
+static GstElement *melo_sink_fade;
+static GstElement *melo_sink_audiosink;
+static gchar *melo_sink_device;
+static gchar *melo_sink_format;
+static const gchar *melo_sink_native_format;
+static const MeloSinkProfile *melo_sink_profile = &melo_sink_profiles[1];
 static gdouble melo_sink_volume = 1.0;
 static gboolean melo_sink_mute;
 static GstCaps *melo_sink_caps;
@@ -65,6 +102,11 @@ static GKeyFile *melo_sink_store;
 static gchar *melo_sink_store_file;
 static guint melo_sink_store_timer;
 
+/* Sound card change in progress (protected by melo_sink_mutex) */
+static GstElement *melo_sink_next_audiosink;
+static guint melo_sink_fade_timer;
+static guint melo_sink_fade_step;
+
 struct _MeloSinkPrivate {
   /* Associated player */
   MeloPlayer *player;
@@ -76,7 +118,15 @@ struct _MeloSinkPrivate {
   GstElement *convert;
   GstElement *resample;
   GstElement *filter;
-  GstElement *audiosink;
+  GstElement *appsink;
+
+  /* Main mixer input */
+  GstElement *appsrc;
+  GstPad *mixer_pad;
+
+  /* Underrun detection */
+  gboolean late;
+  gint underruns;
 
   /* Volume control */
   GstElement *volume;
@@ -86,6 +136,44 @@ struct _MeloSinkPrivate {
 
 G_DEFINE_TYPE_WITH_PRIVATE (MeloSink, melo_sink, G_TYPE_OBJECT)
 
+/* Sink bin provided to players: it provides the main pipeline clock */
+typedef GstBin MeloSinkBin;
+typedef GstBinClass MeloSinkBinClass;
+
+GType melo_sink_bin_get_type (void);
+
+G_DEFINE_TYPE (MeloSinkBin, melo_sink_bin, GST_TYPE_BIN)
+
+static GstClock *
+melo_sink_bin_provide_clock (GstElement *element)
+{
+  GstClock *clock = NULL;
+
+  /* Use clock of main pipeline */
+  G_LOCK (melo_sink_mutex);
+  if (melo_sink_pipeline)
+    clock = gst_pipeline_get_clock (GST_PIPELINE (melo_sink_pipeline));
+  G_UNLOCK (melo_sink_mutex);
+
+  return clock;
+}
+
+static void
+melo_sink_bin_class_init (MeloSinkBinClass *klass)
+{
+  GstElementClass *element_class = GST_ELEMENT_CLASS (klass);
+
+  /* Override clock provider */
+  element_class->provide_clock = melo_sink_bin_provide_clock;
+}
+
+static void
+melo_sink_bin_init (MeloSinkBin *self)
+{
+  /* Select this bin as clock provider of the player pipeline */
+  GST_OBJECT_FLAG_SET (self, GST_ELEMENT_FLAG_PROVIDE_CLOCK);
+}
+
 static void
 melo_sink_finalize (GObject *gobject)
 {
@@ -98,6 +186,12 @@ melo_sink_finalize (GObject *gobject)
   /* Release sink */
   gst_object_unref (priv->sink);
 
+  /* Remove input from main mixer */
+  gst_element_set_state (priv->appsrc, GST_STATE_NULL);
+  gst_element_release_request_pad (melo_sink_mixer, priv->mixer_pad);
+  gst_object_unref (priv->mixer_pad);
+  gst_bin_remove (GST_BIN (melo_sink_pipeline), priv->appsrc);
+
   /* Remove sink from main list */
   melo_sink_list = g_list_remove (melo_sink_list, sink);
   g_hash_table_remove (melo_sink_hash, priv->id);
@@ -136,6 +230,55 @@ melo_sink_is_initialized (void)
   return melo_sink_hash ? TRUE : FALSE;
 }
 
+static GstFlowReturn
+melo_sink_new_sample (GstAppSink *appsink, gpointer user_data)
+{
+  MeloSinkPrivate *priv = user_data;
+  GstClockTime now, time;
+  GstSample *sample;
+  GstBuffer *buffer;
+  GstClock *clock;
+
+  /* Get converted samples */
+  sample = gst_app_sink_pull_sample (appsink);
+  if (!sample)
+    return GST_FLOW_OK;
+
+  /* Samples are later than the mixer latency: count an underrun */
+  buffer = gst_sample_get_buffer (sample);
+  time = gst_segment_to_running_time (gst_sample_get_segment (sample),
+                                      GST_FORMAT_TIME,
+                                      GST_BUFFER_PTS (buffer));
+  clock = gst_element_get_clock (GST_ELEMENT (appsink));
+  if (clock && GST_CLOCK_TIME_IS_VALID (time)) {
+    now = gst_clock_get_time (clock) -
+          gst_element_get_base_time (GST_ELEMENT (appsink));
+    if (now > time + melo_sink_profile->mixer_latency) {
+      if (!priv->late)
+        g_atomic_int_inc (&priv->underruns);
+      priv->late = TRUE;
+    } else
+      priv->late = FALSE;
+  }
+  if (clock)
+    gst_object_unref (clock);
+
+  /* Remove timestamps: they are set from the main pipeline running time */
+  buffer = gst_buffer_copy (buffer);
+  GST_BUFFER_PTS (buffer) = GST_CLOCK_TIME_NONE;
+  GST_BUFFER_DTS (buffer) = GST_CLOCK_TIME_NONE;
+  gst_sample_unref (sample);
+
+  /* Push to main mixer: the player never waits for the main pipeline */
+  gst_app_src_push_buffer (GST_APP_SRC (priv->appsrc), buffer);
+
+  return GST_FLOW_OK;
+}
+
+static GstAppSinkCallbacks melo_sink_callbacks = {
+  .new_sample = melo_sink_new_sample,
+};
+
 /**
  * melo_sink_new:
  * @player: a #MeloPlayer on which to attach
@@ -182,21 +325,23 @@ melo_sink_new (MeloPlayer *player, const gchar *id, const gchar *name)
   priv->id = g_strdup (id);
   priv->name = g_strdup (name);
 
-  /* Create sink bin and conversion, volume and audiosink elements */
-  priv->sink = gst_bin_new (id);
+  /* Create sink bin and conversion, volume and appsink elements */
+  priv->sink = g_object_new (melo_sink_bin_get_type (), "name", id, NULL);
   priv->convert = gst_element_factory_make ("audioconvert", NULL);
   priv->resample = gst_element_factory_make ("audioresample", NULL);
   priv->volume = gst_element_factory_make ("volume", NULL);
   priv->filter = gst_element_factory_make ("capsfilter", NULL);
-  priv->audiosink = gst_element_factory_make ("autoaudiosink", NULL);
+  priv->appsink = gst_element_factory_make ("appsink", NULL);
+  priv->appsrc = gst_element_factory_make ("appsrc", id);
   if (!priv->sink || !priv->convert || !priv->resample || !priv->volume ||
-      !priv->filter || !priv->audiosink) {
+      !priv->filter || !priv->appsink || !priv->appsrc) {
     gst_object_unref (priv->sink);
     gst_object_unref (priv->convert);
     gst_object_unref (priv->resample);
     gst_object_unref (priv->volume);
     gst_object_unref (priv->filter);
-    gst_object_unref (priv->audiosink);
+    gst_object_unref (priv->appsink);
+    gst_object_unref (priv->appsrc);
     g_object_unref (sink);
     goto failed;
   }
@@ -204,6 +349,14 @@ melo_sink_new (MeloPlayer *player, const gchar *id, const gchar *name)
   /* Setup caps for audio sink */
   g_object_set (priv->filter, "caps", melo_sink_caps, NULL);
 
+  /* Forward samples to main mixer */
+  gst_app_sink_set_callbacks (GST_APP_SINK (priv->appsink),
+                              &melo_sink_callbacks, priv, NULL);
+
+  /* Setup main mixer input: it is live and timestamped on arrival */
+  g_object_set (priv->appsrc, "caps", melo_sink_caps, "is-live", TRUE,
+                "format", GST_FORMAT_TIME, "do-timestamp", TRUE, NULL);
+
   /* Restore volume and mute from storage file */
   if (melo_sink_store) {
     GError *err = NULL;
@@ -233,11 +386,11 @@ melo_sink_new (MeloPlayer *player, const gchar *id, const gchar *name)
   g_object_set (priv->volume, "volume", priv->vol * melo_sink_volume, "mute",
                 priv->mute || melo_sink_mute, NULL);
 
-  /* Add and connect convert -> resample -> volume -> audiosink to sink bin */
+  /* Add and connect convert -> resample -> volume -> appsink to sink bin */
   gst_bin_add_many (GST_BIN (priv->sink), priv->convert, priv->resample,
-                    priv->volume, priv->filter, priv->audiosink, NULL);
+                    priv->volume, priv->filter, priv->appsink, NULL);
   gst_element_link_many (priv->convert, priv->resample, priv->volume,
-                         priv->filter, priv->audiosink, NULL);
+                         priv->filter, priv->appsink, NULL);
 
   /* Create sink pad on bin and connect to sink pad of audioconver */
   pad = gst_element_get_static_pad (priv->convert, "sink");
@@ -245,6 +398,14 @@ melo_sink_new (MeloPlayer *player, const gchar *id, const gchar *name)
   gst_element_add_pad (priv->sink, gpad);
   gst_object_unref (pad);
 
+  /* Add input to main mixer */
+  gst_bin_add (GST_BIN (melo_sink_pipeline), priv->appsrc);
+  priv->mixer_pad = gst_element_get_request_pad (melo_sink_mixer, "sink_%u");
+  pad = gst_element_get_static_pad (priv->appsrc, "src");
+  gst_pad_link (pad, priv->mixer_pad);
+  gst_object_unref (pad);
+  gst_element_sync_state_with_parent (priv->appsrc);
+
   /* Add sink to global sink list */
   melo_sink_list = g_list_prepend (melo_sink_list, sink);
   g_hash_table_insert (melo_sink_hash, priv->id, sink);
@@ -318,7 +479,7 @@ melo_sink_get_sync (MeloSink *sink)
   gboolean enable;
 
   /* Get sync */
-  g_object_get (G_OBJECT (sink->priv->audiosink), "sync", &enable, NULL);
+  g_object_get (G_OBJECT (sink->priv->appsink), "sync", &enable, NULL);
 
   return enable;
 }
@@ -329,13 +490,14 @@ melo_sink_get_sync (MeloSink *sink)
  * @enable: set %TRUE to enable clock synchronization
  *
  * Set the sync flag status of the audio sink. If @enable is set to %TRUE, the
- * sink will synchronize its clock with the sound card clock.
+ * sink will synchronize its clock with the sound card clock. Otherwise, the
+ * samples are pushed to the main mixer as soon as they are decoded.
  */
 void
 melo_sink_set_sync (MeloSink *sink, gboolean enable)
 {
   /* Set sync */
-  g_object_set (G_OBJECT (sink->priv->audiosink), "sync", enable, NULL);
+  g_object_set (G_OBJECT (sink->priv->appsink), "sync", enable, NULL);
 }
 
 /**
@@ -465,16 +627,139 @@ melo_sink_set_mute (MeloSink *sink, gboolean mute)
 }
 
 /* Main pipeline control */
+static void
+melo_sink_apply_profile_func (const GValue *item, gpointer user_data)
+{
+  GObject *element = g_value_get_object (item);
+
+  /* Set buffer sizes on audio sink */
+  if (g_object_class_find_property (G_OBJECT_GET_CLASS (element),
+                                    "buffer-time"))
+    g_object_set (element,
+                  "buffer-time", melo_sink_profile->buffer_time,
+                  "latency-time", melo_sink_profile->latency_time, NULL);
+}
+
+static void
+melo_sink_apply_profile (void)
+{
+  GstIterator *it;
+
+  /* Set buffer sizes on sound card: they are applied when it is started */
+  it = gst_bin_iterate_recurse (GST_BIN (melo_sink_audiosink));
+  gst_iterator_foreach (it, melo_sink_apply_profile_func, NULL);
+  gst_iterator_free (it);
+
+  /* Set mixer latency */
+  g_object_set (melo_sink_mixer, "latency", melo_sink_profile->mixer_latency,
+                NULL);
+}
+
+static const gchar *melo_sink_formats[] = {
+  "S16LE",
+  "S32LE",
+  "F32LE",
+};
+
+static const gchar *
+melo_sink_find_format (const gchar *format)
+{
+  guint i;
+
+  /* Find a supported sample format */
+  for (i = 0; i < G_N_ELEMENTS (melo_sink_formats); i++)
+    if (!g_strcmp0 (format, melo_sink_formats[i]))
+      return melo_sink_formats[i];
+
+  return NULL;
+}
+
+static const gchar *
+melo_sink_find_native_format (void)
+{
+  const gchar *format = NULL;
+  GstCaps *caps;
+  GstPad *pad;
+  guint i, j;
+
+  /* Get formats supported by sound card (main pipeline must be ready) */
+  pad = gst_element_get_static_pad (melo_sink_audiosink, "sink");
+  caps = gst_pad_query_caps (pad, NULL);
+  gst_object_unref (pad);
+
+  /* Use first supported format in order of preference of the sound card */
+  for (i = 0; !format && i < gst_caps_get_size (caps); i++) {
+    GstStructure *str = gst_caps_get_structure (caps, i);
+    const GValue *value = gst_structure_get_value (str, "format");
+
+    if (!value)
+      continue;
+    if (G_VALUE_HOLDS_STRING (value))
+      format = melo_sink_find_format (g_value_get_string (value));
+    else if (GST_VALUE_HOLDS_LIST (value))
+      for (j = 0; !format && j < gst_value_list_get_size (value); j++)
+        format = melo_sink_find_format (
+                 g_value_get_string (gst_value_list_get_value (value, j)));
+  }
+  gst_caps_unref (caps);
+
+  return format;
+}
+
 static GstCaps *
 melo_sink_gen_caps (gint rate, gint channels)
 {
+  const gchar *format;
+
+  /* Get sample format: native format of the sound card, or S32LE */
+  if (!g_strcmp0 (melo_sink_format, "native"))
+    format = melo_sink_native_format;
+  else
+    format = melo_sink_find_format (melo_sink_format);
+  if (!format)
+    format = "S32LE";
+
   return gst_caps_new_simple ("audio/x-raw",
-                              "format", G_TYPE_STRING, "S32LE",
+                              "format", G_TYPE_STRING, format,
                               "layout", G_TYPE_STRING, "interleaved",
                               "rate", G_TYPE_INT, rate,
                               "channels", G_TYPE_INT, channels, NULL);
 }
 
+static GstElement *
+melo_sink_create_device (const gchar *device)
+{
+  /* Default sound card */
+  if (!device || !g_strcmp0 (device, "auto"))
+    return gst_element_factory_make ("autoaudiosink", NULL);
+
+  /* Sound card from description (ex: "alsasink device=hw:1") */
+  return gst_parse_bin_from_description (device, TRUE, NULL);
+}
+
+/* Check the GStreamer elements needed by the mixer and the sinks */
+static gboolean
+melo_sink_check_elements (void)
+{
+  static const gchar *names[] = { "audiomixer", "appsink", "appsrc" };
+  GstElementFactory *factory;
+  gboolean ret = TRUE;
+  guint i;
+
+  for (i = 0; i < G_N_ELEMENTS (names); i++) {
+    factory = gst_element_factory_find (names[i]);
+    if (!factory) {
+      g_warning ("failed to find GStreamer element '%s': gst-plugins-base "
+                 ">= 1.14 is required", names[i]);
+      ret = FALSE;
+      continue;
+    }
+    gst_object_unref (factory);
+  }
+
+  return ret;
+}
+
 /**
  * melo_sink_main_init:
  * @rate: the sample rate to use for the sound card
@@ -490,6 +775,8 @@ melo_sink_gen_caps (gint rate, gint channels)
 gboolean
 melo_sink_main_init (gint rate, gint channels)
 {
+  GstClock *clock;
+  GstElement *src;
   gchar *path;
 
   /* Lock main context access */
@@ -499,9 +786,67 @@ melo_sink_main_init (gint rate, gint channels)
   if (melo_sink_is_initialized ())
     goto failed;
 
+  /* Mixer and sink elements are not available */
+  if (!melo_sink_check_elements ())
+    goto failed;
+
+  /* Create main pipeline: all player sinks are mixed into the sound card,
+   * which is opened only once. A silent live source keeps the mixer and the
+   * clock running when no player is playing.
+   */
+  melo_sink_pipeline = gst_pipeline_new ("melo_sink_main");
+  src = gst_element_factory_make ("audiotestsrc", NULL);
+  melo_sink_src_filter = gst_element_factory_make ("capsfilter", NULL);
+  melo_sink_mixer = gst_element_factory_make ("audiomixer", NULL);
+  melo_sink_filter = gst_element_factory_make ("capsfilter", NULL);
+  melo_sink_fade = gst_element_factory_make ("volume", NULL);
+  melo_sink_audiosink = melo_sink_create_device (melo_sink_device);
+  if (!melo_sink_pipeline || !src || !melo_sink_src_filter ||
+      !melo_sink_mixer || !melo_sink_filter || !melo_sink_fade ||
+      !melo_sink_audiosink) {
+    gst_object_unref (melo_sink_pipeline);
+    gst_object_unref (src);
+    gst_object_unref (melo_sink_src_filter);
+    gst_object_unref (melo_sink_mixer);
+    gst_object_unref (melo_sink_filter);
+    gst_object_unref (melo_sink_fade);
+    gst_object_unref (melo_sink_audiosink);
+    melo_sink_pipeline = NULL;
+    goto failed;
+  }
+
+  /* Use system clock: the sound card can be replaced while players are
+   * synchronized on the main clock, and it is slaved to this clock.
+   */
+  clock = gst_system_clock_obtain ();
+  gst_pipeline_use_clock (GST_PIPELINE (melo_sink_pipeline), clock);
+  gst_object_unref (clock);
+
+  /* Add and connect src -> mixer -> fade -> audiosink to main pipeline */
+  gst_bin_add_many (GST_BIN (melo_sink_pipeline), src, melo_sink_src_filter,
+                    melo_sink_mixer, melo_sink_filter, melo_sink_fade,
+                    melo_sink_audiosink, NULL);
+  gst_element_link_many (src, melo_sink_src_filter, melo_sink_mixer,
+                         melo_sink_filter, melo_sink_fade, melo_sink_audiosink,
+                         NULL);
+
+  /* Open sound card and get its native sample format */
+  gst_element_set_state (melo_sink_pipeline, GST_STATE_READY);
+  melo_sink_native_format = melo_sink_find_native_format ();
+
   /* Generate audio sink caps */
   melo_sink_caps = melo_sink_gen_caps (rate, channels);
 
+  /* Setup main pipeline */
+  g_object_set (src, "is-live", TRUE, NULL);
+  gst_util_set_object_arg (G_OBJECT (src), "wave", "silence");
+  g_object_set (melo_sink_src_filter, "caps", melo_sink_caps, NULL);
+  g_object_set (melo_sink_filter, "caps", melo_sink_caps, NULL);
+  melo_sink_apply_profile ();
+
+  /* Start main pipeline */
+  gst_element_set_state (melo_sink_pipeline, GST_STATE_PLAYING);
+
   /* Create hash table */
   melo_sink_hash = g_hash_table_new (g_str_hash, g_str_equal);
 
@@ -546,6 +891,23 @@ failed:
   return FALSE;
 }
 
+static void
+melo_sink_cancel_device (void)
+{
+  /* Stop fade or sound card change */
+  if (melo_sink_fade_timer)
+    g_source_remove (melo_sink_fade_timer);
+  melo_sink_fade_timer = 0;
+  melo_sink_fade_step = 0;
+
+  /* Release sound card not yet used */
+  if (melo_sink_next_audiosink) {
+    gst_element_set_state (melo_sink_next_audiosink, GST_STATE_NULL);
+    gst_object_unref (melo_sink_next_audiosink);
+    melo_sink_next_audiosink = NULL;
+  }
+}
+
 /**
  * melo_sink_main_release:
  *
@@ -566,6 +928,19 @@ melo_sink_main_release ()
     return FALSE;
   }
 
+  /* Stop sound card change */
+  melo_sink_cancel_device ();
+
+  /* Stop and free main pipeline */
+  gst_element_set_state (melo_sink_pipeline, GST_STATE_NULL);
+  gst_object_unref (melo_sink_pipeline);
+  melo_sink_pipeline = NULL;
+  melo_sink_mixer = NULL;
+  melo_sink_src_filter = NULL;
+  melo_sink_filter = NULL;
+  melo_sink_fade = NULL;
+  melo_sink_audiosink = NULL;
+
   /* Free caps */
   gst_caps_unref (melo_sink_caps);
   melo_sink_caps = NULL;
@@ -594,14 +969,32 @@ melo_sink_main_release ()
   return TRUE;
 }
 
+static void
+melo_sink_update_caps (void)
+{
+  GList *list;
+
+  /* Update main pipeline caps */
+  g_object_set (melo_sink_src_filter, "caps", melo_sink_caps, NULL);
+  g_object_set (melo_sink_filter, "caps", melo_sink_caps, NULL);
+
+  /* Update sink caps */
+  for (list = melo_sink_list; list != NULL; list = list->next) {
+    MeloSink *sink = (MeloSink *) list->data;
+    g_object_set (sink->priv->filter, "caps", melo_sink_caps, NULL);
+    g_object_set (sink->priv->appsrc, "caps", melo_sink_caps, NULL);
+  }
+}
+
 /**
  * melo_sink_set_main_config:
  * @rate: the sample rate to use for the sound card
  * @channels: the channel count to use for the sound card
  *
  * Set a new configuration on the sound card. An incremental update will be
- * done on all #MeloSink instances and then Gstreamer pipeline using the
- * #GstElement objects provided by melo_sink_get_gst_sink().
+ * done on the main mixer pipeline, on all #MeloSink instances and then
+ * Gstreamer pipeline using the #GstElement objects provided by
+ * melo_sink_get_gst_sink().
  *
  * Returns: %TRUE if new configuration has been applied with success, %FALSE
  * otherwise.
@@ -610,7 +1003,6 @@ gboolean
 melo_sink_set_main_config (gint rate, gint channels)
 {
   gboolean ret = FALSE;
-  GList *list;
 
   /* Lock main context access */
   G_LOCK (melo_sink_mutex);
@@ -619,13 +1011,8 @@ melo_sink_set_main_config (gint rate, gint channels)
   if (melo_sink_caps) {
     gst_caps_unref (melo_sink_caps);
     melo_sink_caps = melo_sink_gen_caps (rate, channels);
+    melo_sink_update_caps ();
     ret = TRUE;
-
-    /* Update sink caps */
-    for (list = melo_sink_list; list != NULL; list = list->next) {
-      MeloSink *sink = (MeloSink *) list->data;
-      g_object_set (sink->priv->filter, "caps", melo_sink_caps, NULL);
-    }
   }
 
   /* Unlock main context access */
@@ -667,6 +1054,351 @@ melo_sink_get_main_config (gint *rate, gint *channels)
   return ret;
 }
 
+/**
+ * melo_sink_set_main_format:
+ * @format: the sample format to use for the sound card
+ *
+ * Set the sample format used by the sound card and the internal mixer. The
+ * supported formats are "S16LE", "S32LE" and "F32LE". With "native", the
+ * first of these formats supported by the sound card is used. When the format
+ * of a decoded stream already matches, the conversion elements of its
+ * #MeloSink are in passthrough mode, so a 16-bit media played on a "S16LE"
+ * output is never converted.
+ *
+ * This function can be called before melo_sink_main_init(). The default
+ * format is "S32LE".
+ *
+ * Returns: %TRUE if the format is supported, %FALSE otherwise.
+ */
+gboolean
+melo_sink_set_main_format (const gchar *format)
+{
+  GstStructure *str;
+  gint rate, channels;
+
+  /* Check format */
+  if (g_strcmp0 (format, "native") && !melo_sink_find_format (format))
+    return FALSE;
+
+  /* Lock main context access */
+  G_LOCK (melo_sink_mutex);
+
+  /* Set new format */
+  g_free (melo_sink_format);
+  melo_sink_format = g_strdup (format);
+
+  /* Update caps */
+  if (melo_sink_caps) {
+    str = gst_caps_get_structure (melo_sink_caps, 0);
+    if (gst_structure_get_int (str, "rate", &rate) &&
+        gst_structure_get_int (str, "channels", &channels)) {
+      gst_caps_unref (melo_sink_caps);
+      melo_sink_caps = melo_sink_gen_caps (rate, channels);
+      melo_sink_update_caps ();
+    }
+  }
+
+  /* Unlock main context access */
+  G_UNLOCK (melo_sink_mutex);
+
+  return TRUE;
+}
+
+/**
+ * melo_sink_set_main_profile:
+ * @profile: the name of the latency profile
+ *
+ * Set the latency profile of the sound card and the internal mixer:
+ *  - "low": small buffers for a low latency (needed by synchronized outputs
+ *    like AirPlay), at the cost of more wakeups and a higher underrun risk,
+ *  - "balanced": default buffers of GStreamer,
+ *  - "power-save": large buffers and fewer wakeups.
+ *
+ * The sound card must be restarted to apply new buffer sizes, so a short
+ * silence is heard when the profile is changed after melo_sink_main_init().
+ *
+ * Returns: %TRUE if the profile exists, %FALSE otherwise.
+ */
+gboolean
+melo_sink_set_main_profile (const gchar *profile)
+{
+  guint i;
+
+  /* Find profile */
+  for (i = 0; i < G_N_ELEMENTS (melo_sink_profiles); i++)
+    if (!g_strcmp0 (profile, melo_sink_profiles[i].name))
+      break;
+  if (i == G_N_ELEMENTS (melo_sink_profiles))
+    return FALSE;
+
+  /* Lock main context access */
+  G_LOCK (melo_sink_mutex);
+
+  /* Set new profile */
+  melo_sink_profile = &melo_sink_profiles[i];
+
+  /* Restart sound card with new profile */
+  if (melo_sink_pipeline) {
+    gst_element_set_state (melo_sink_pipeline, GST_STATE_READY);
+    melo_sink_apply_profile ();
+    gst_element_set_state (melo_sink_pipeline, GST_STATE_PLAYING);
+  }
+
+  /* Unlock main context access */
+  G_UNLOCK (melo_sink_mutex);
+
+  return TRUE;
+}
+
+static GstPadProbeReturn
+melo_sink_block_probe (GstPad *pad, GstPadProbeInfo *info, gpointer user_data)
+{
+  /* Keep output blocked during sound card change */
+  return GST_PAD_PROBE_OK;
+}
+
+static gboolean melo_sink_switch_device (gpointer user_data);
+
+static gboolean
+melo_sink_fade_volume (gpointer user_data)
+{
+  gboolean fade_in = GPOINTER_TO_INT (user_data);
+  gdouble volume;
+
+  /* Lock main context access */
+  G_LOCK (melo_sink_mutex);
+
+  /* Fade has been cancelled while waiting for the lock */
+  if (g_source_is_destroyed (g_main_current_source ())) {
+    G_UNLOCK (melo_sink_mutex);
+    return G_SOURCE_REMOVE;
+  }
+
+  /* Ramp volume of sound card output */
+  volume = (gdouble) ++melo_sink_fade_step / MELO_SINK_FADE_STEPS;
+  g_object_set (melo_sink_fade, "volume", fade_in ? volume : 1.0 - volume,
+                NULL);
+  if (melo_sink_fade_step < MELO_SINK_FADE_STEPS) {
+    G_UNLOCK (melo_sink_mutex);
+    return G_SOURCE_CONTINUE;
+  }
+  melo_sink_fade_step = 0;
+
+  /* Fade out done: the buffer of the sound card still holds the samples
+   * played before the fade, so the sound card is replaced only when its
+   * buffer has been played.
+   */
+  if (fade_in)
+    melo_sink_fade_timer = 0;
+  else
+    melo_sink_fade_timer = g_timeout_add (melo_sink_profile->buffer_time /
+                                          1000 + 1, melo_sink_switch_device,
+                                          NULL);
+
+  /* Unlock main context access */
+  G_UNLOCK (melo_sink_mutex);
+
+  return G_SOURCE_REMOVE;
+}
+
+static gboolean
+melo_sink_switch_device (gpointer user_data)
+{
+  GstElement *audiosink;
+  GstStructure *str;
+  gint rate, channels;
+  GstPad *pad;
+  gulong id;
+
+  /* Lock main context access */
+  G_LOCK (melo_sink_mutex);
+
+  /* Change has been cancelled while waiting for the lock */
+  if (g_source_is_destroyed (g_main_current_source ())) {
+    G_UNLOCK (melo_sink_mutex);
+    return G_SOURCE_REMOVE;
+  }
+  audiosink = melo_sink_next_audiosink;
+  melo_sink_next_audiosink = NULL;
+
+  /* Block mixer output */
+  pad = gst_element_get_static_pad (melo_sink_fade, "src");
+  id = gst_pad_add_probe (pad, GST_PAD_PROBE_TYPE_BLOCK_DOWNSTREAM,
+                          melo_sink_block_probe, NULL, NULL);
+
+  /* Remove current sound card */
+  gst_element_unlink (melo_sink_fade, melo_sink_audiosink);
+  gst_element_set_state (melo_sink_audiosink, GST_STATE_NULL);
+  gst_bin_remove (GST_BIN (melo_sink_pipeline), melo_sink_audiosink);
+
+  /* Add new sound card */
+  melo_sink_audiosink = audiosink;
+  gst_bin_add (GST_BIN (melo_sink_pipeline), audiosink);
+  melo_sink_apply_profile ();
+
+  /* Update native format */
+  melo_sink_native_format = melo_sink_find_native_format ();
+  str = gst_caps_get_structure (melo_sink_caps, 0);
+  if (!g_strcmp0 (melo_sink_format, "native") &&
+      gst_structure_get_int (str, "rate", &rate) &&
+      gst_structure_get_int (str, "channels", &channels)) {
+    gst_caps_unref (melo_sink_caps);
+    melo_sink_caps = melo_sink_gen_caps (rate, channels);
+    melo_sink_update_caps ();
+  }
+
+  /* Start new sound card and unblock mixer output */
+  gst_element_link (melo_sink_fade, audiosink);
+  gst_element_sync_state_with_parent (audiosink);
+  gst_pad_remove_probe (pad, id);
+  gst_object_unref (pad);
+
+  /* Fade in new sound card */
+  melo_sink_fade_timer = g_timeout_add (MELO_SINK_FADE_INTERVAL,
+                                        melo_sink_fade_volume,
+                                        GINT_TO_POINTER (TRUE));
+
+  /* Unlock main context access */
+  G_UNLOCK (melo_sink_mutex);
+
+  return G_SOURCE_REMOVE;
+}
+
+/**
+ * melo_sink_set_main_device:
+ * @device: the sound card to use, "auto" or %NULL for the default one
+ *
+ * Replace the sound card used by the internal mixer. The @device is a
+ * GStreamer sink description, like "alsasink device=hw:1". Only the device
+ * element is replaced: the output is faded out, the mixer output is blocked
+ * while the new sound card is started (the samples of the players are kept in
+ * the mixer inputs), and the output is faded in. The player pipelines are not
+ * stopped.
+ *
+ * The new sound card is opened by this function, then the change is done
+ * asynchronously from the default main context: the current sound card is
+ * removed once the samples in its buffer have been played after the fade out.
+ * If a change is already in progress, the new sound card replaces the one
+ * which was not yet started.
+ *
+ * This function can be called before melo_sink_main_init().
+ *
+ * Returns: %TRUE if the sound card change has been started, %FALSE otherwise.
+ */
+gboolean
+melo_sink_set_main_device (const gchar *device)
+{
+  GstElement *audiosink;
+
+  /* Save device for initialization */
+  G_LOCK (melo_sink_mutex);
+  g_free (melo_sink_device);
+  melo_sink_device = g_strdup (device);
+  if (!melo_sink_pipeline) {
+    G_UNLOCK (melo_sink_mutex);
+    return TRUE;
+  }
+  G_UNLOCK (melo_sink_mutex);
+
+  /* Create new sound card and open it */
+  audiosink = melo_sink_create_device (device);
+  if (!audiosink)
+    return FALSE;
+  if (gst_element_set_state (audiosink, GST_STATE_READY) ==
+      GST_STATE_CHANGE_FAILURE) {
+    gst_element_set_state (audiosink, GST_STATE_NULL);
+    gst_object_unref (audiosink);
+    return FALSE;
+  }
+
+  /* Lock main context access */
+  G_LOCK (melo_sink_mutex);
+
+  /* A change is in progress */
+  if (melo_sink_next_audiosink) {
+    /* Replace sound card not yet started */
+    gst_element_set_state (melo_sink_next_audiosink, GST_STATE_NULL);
+    gst_object_unref (melo_sink_next_audiosink);
+  } else if (melo_sink_fade_timer) {
+    /* Fade out from current volume of the fade in */
+    g_source_remove (melo_sink_fade_timer);
+    melo_sink_fade_step = MELO_SINK_FADE_STEPS - melo_sink_fade_step;
+    melo_sink_fade_timer = 0;
+  }
+  melo_sink_next_audiosink = audiosink;
+
+  /* Fade out current sound card */
+  if (!melo_sink_fade_timer)
+    melo_sink_fade_timer = g_timeout_add (MELO_SINK_FADE_INTERVAL,
+                                          melo_sink_fade_volume,
+                                          GINT_TO_POINTER (FALSE));
+
+  /* Unlock main context access */
+  G_UNLOCK (melo_sink_mutex);
+
+  return TRUE;
+}
+
+static GstClockTime
+melo_sink_query_latency (GstElement *element)
+{
+  GstClockTime min = 0;
+  GstQuery *query;
+  gboolean live;
+
+  /* Query latency */
+  query = gst_query_new_latency ();
+  if (gst_element_query (element, query))
+    gst_query_parse_latency (query, &live, &min, NULL);
+  gst_query_unref (query);
+
+  return GST_CLOCK_TIME_IS_VALID (min) ? min : 0;
+}
+
+/**
+ * melo_sink_get_latency:
+ * @sink: the sink, or %NULL for the sound card
+ *
+ * Get the latency negotiated between the sound card and the main mixer. For a
+ * #MeloSink, the latency of its player pipeline is added.
+ *
+ * Returns: the current latency in ms.
+ */
+gint
+melo_sink_get_latency (MeloSink *sink)
+{
+  GstClockTime latency = 0;
+
+  /* Get main pipeline latency */
+  G_LOCK (melo_sink_mutex);
+  if (melo_sink_pipeline)
+    latency = melo_sink_query_latency (melo_sink_pipeline);
+  G_UNLOCK (melo_sink_mutex);
+
+  /* Add player pipeline latency */
+  if (sink)
+    latency += melo_sink_query_latency (sink->priv->sink);
+
+  return latency / GST_MSECOND;
+}
+
+/**
+ * melo_sink_get_underruns:
+ * @sink: the sink
+ *
+ * Get the number of underruns of the sink: an underrun is counted each time
+ * the player delivers samples later than the main mixer latency, in which
+ * case the mixer outputs silence for this sink.
+ *
+ * Returns: the number of underruns since sink creation.
+ */
+guint
+melo_sink_get_underruns (MeloSink *sink)
+{
+  g_return_val_if_fail (sink, 0);
+  return g_atomic_int_get (&sink->priv->underruns);
+}
+
 /**
  * melo_sink_set_main_volume:
  *
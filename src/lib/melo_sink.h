@@ -89,6 +89,13 @@ gboolean melo_sink_main_release ();
 /* Main mixer output settings */
 gboolean melo_sink_set_main_config (gint rate, gint channels);
 gboolean melo_sink_get_main_config (gint *rate, gint *channels);
+gboolean melo_sink_set_main_format (const gchar *format);
+gboolean melo_sink_set_main_profile (const gchar *profile);
+gboolean melo_sink_set_main_device (const gchar *device);
+
+/* Latency and underruns reporting */
+gint melo_sink_get_latency (MeloSink *sink);
+guint melo_sink_get_underruns (MeloSink *sink);
 
 /* Main mixer volume / mute control */
 gdouble melo_sink_get_main_volume ();
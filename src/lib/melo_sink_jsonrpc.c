@@ -31,12 +31,14 @@
 
 typedef enum {
   MELO_SINK_JSONRPC_FIELDS_NONE = 0,
-  MELO_SINK_JSONRPC_FIELDS_ID,
-  MELO_SINK_JSONRPC_FIELDS_NAME,
-  MELO_SINK_JSONRPC_FIELDS_VOLUME,
-  MELO_SINK_JSONRPC_FIELDS_MUTE,
-  MELO_SINK_JSONRPC_FIELDS_SAMPLERATE,
-  MELO_SINK_JSONRPC_FIELDS_CHANNELS,
+  MELO_SINK_JSONRPC_FIELDS_ID = 1,
+  MELO_SINK_JSONRPC_FIELDS_NAME = 2,
+  MELO_SINK_JSONRPC_FIELDS_VOLUME = 4,
+  MELO_SINK_JSONRPC_FIELDS_MUTE = 8,
+  MELO_SINK_JSONRPC_FIELDS_SAMPLERATE = 16,
+  MELO_SINK_JSONRPC_FIELDS_CHANNELS = 32,
+  MELO_SINK_JSONRPC_FIELDS_LATENCY = 64,
+  MELO_SINK_JSONRPC_FIELDS_UNDERRUNS = 128,
 
   MELO_SINK_JSONRPC_FIELDS_FULL = ~0
 } MeloSinkJSONRPCFields;
@@ -101,6 +103,10 @@ melo_sink_jsonrpc_get_fields (JsonObject *obj, const gchar *name)
       fields |= MELO_SINK_JSONRPC_FIELDS_SAMPLERATE;
     else if (!g_strcmp0 (field, "channels"))
       fields |= MELO_SINK_JSONRPC_FIELDS_CHANNELS;
+    else if (!g_strcmp0 (field, "latency"))
+      fields |= MELO_SINK_JSONRPC_FIELDS_LATENCY;
+    else if (!g_strcmp0 (field, "underruns"))
+      fields |= MELO_SINK_JSONRPC_FIELDS_UNDERRUNS;
   }
 
   return fields;
@@ -129,6 +135,8 @@ melo_sink_jsonrpc_main_to_object (MeloSinkJSONRPCFields fields)
       json_object_set_int_member (obj, "samplerate", rate);
     if (fields & MELO_SINK_JSONRPC_FIELDS_CHANNELS)
       json_object_set_int_member (obj, "channels", channels);
+    if (fields & MELO_SINK_JSONRPC_FIELDS_LATENCY)
+      json_object_set_int_member (obj, "latency", melo_sink_get_latency (NULL));
   }
 
   return obj;
@@ -151,6 +159,11 @@ melo_sink_jsonrpc_sink_to_object (MeloSink *sink, MeloSinkJSONRPCFields fields)
                                      melo_sink_get_volume (sink));
     if (fields & MELO_SINK_JSONRPC_FIELDS_MUTE)
       json_object_set_boolean_member (obj, "mute", melo_sink_get_mute (sink));
+    if (fields & MELO_SINK_JSONRPC_FIELDS_LATENCY)
+      json_object_set_int_member (obj, "latency", melo_sink_get_latency (sink));
+    if (fields & MELO_SINK_JSONRPC_FIELDS_UNDERRUNS)
+      json_object_set_int_member (obj, "underruns",
+                                  melo_sink_get_underruns (sink));
   }
 
   return obj;
@@ -338,6 +351,7 @@ static MeloJSONRPCMethod melo_sink_jsonrpc_methods[] = {
     .result = "{\"type\":\"object\"}",
     .callback = melo_sink_jsonrpc_set,
     .user_data = NULL,
+    .priority = MELO_JSONRPC_PRIORITY_CONTROL,
   },
 };
 
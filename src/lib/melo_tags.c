@@ -952,6 +952,80 @@ melo_tags_to_json_object (MeloTags *tags, MeloTagsFields fields)
   return obj;
 }
 
+/**
+ * melo_tags_add_to_jsonrpc_writer:
+ * @tags: the tags
+ * @writer: a #MeloJSONRPCWriter with an object opened
+ * @fields: the tags to add to the @writer
+ *
+ * Same as melo_tags_add_to_json_object() but the members are written directly
+ * in the current object of @writer.
+ */
+void
+melo_tags_add_to_jsonrpc_writer (MeloTags *tags, MeloJSONRPCWriter *writer,
+                                 MeloTagsFields fields)
+{
+  /* Nothing to do */
+  if (!tags || fields == MELO_TAGS_FIELDS_NONE)
+    return;
+
+  /* Set timestamp in any case */
+  melo_jsonrpc_writer_set_member_name (writer, "timestamp");
+  melo_jsonrpc_writer_add_int_value (writer, tags->timestamp);
+
+  /* Fill object */
+  if (fields & MELO_TAGS_FIELDS_TITLE) {
+    melo_jsonrpc_writer_set_member_name (writer, "title");
+    melo_jsonrpc_writer_add_string_value (writer, tags->title);
+  }
+  if (fields & MELO_TAGS_FIELDS_ARTIST) {
+    melo_jsonrpc_writer_set_member_name (writer, "artist");
+    melo_jsonrpc_writer_add_string_value (writer, tags->artist);
+  }
+  if (fields & MELO_TAGS_FIELDS_ALBUM) {
+    melo_jsonrpc_writer_set_member_name (writer, "album");
+    melo_jsonrpc_writer_add_string_value (writer, tags->album);
+  }
+  if (fields & MELO_TAGS_FIELDS_GENRE) {
+    melo_jsonrpc_writer_set_member_name (writer, "genre");
+    melo_jsonrpc_writer_add_string_value (writer, tags->genre);
+  }
+  if (fields & MELO_TAGS_FIELDS_DATE) {
+    melo_jsonrpc_writer_set_member_name (writer, "date");
+    melo_jsonrpc_writer_add_int_value (writer, tags->date);
+  }
+  if (fields & MELO_TAGS_FIELDS_TRACK) {
+    melo_jsonrpc_writer_set_member_name (writer, "track");
+    melo_jsonrpc_writer_add_int_value (writer, tags->track);
+  }
+  if (fields & MELO_TAGS_FIELDS_TRACKS) {
+    melo_jsonrpc_writer_set_member_name (writer, "tracks");
+    melo_jsonrpc_writer_add_int_value (writer, tags->tracks);
+  }
+  if (fields & MELO_TAGS_FIELDS_COVER) {
+    melo_jsonrpc_writer_set_member_name (writer, "cover");
+    melo_jsonrpc_writer_add_string_value (writer, tags->cover);
+  }
+}
+
+/**
+ * melo_tags_to_jsonrpc_writer:
+ * @tags: the tags
+ * @writer: a #MeloJSONRPCWriter
+ * @fields: the tags to add to the @writer
+ *
+ * Same as melo_tags_to_json_object() but a new object is written directly in
+ * @writer.
+ */
+void
+melo_tags_to_jsonrpc_writer (MeloTags *tags, MeloJSONRPCWriter *writer,
+                             MeloTagsFields fields)
+{
+  melo_jsonrpc_writer_begin_object (writer);
+  melo_tags_add_to_jsonrpc_writer (tags, writer, fields);
+  melo_jsonrpc_writer_end_object (writer);
+}
+
 /**
  * melo_tags_unref:
  * @tags: the tags
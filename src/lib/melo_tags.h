@@ -26,6 +26,8 @@
 #include <gst/gst.h>
 #include <json-glib/json-glib.h>
 
+#include "melo_jsonrpc.h"
+
 typedef struct _MeloTags MeloTags;
 typedef enum _MeloTagsFields MeloTagsFields;
 typedef enum _MeloTagsCoverPersist MeloTagsCoverPersist;
@@ -150,5 +152,9 @@ MeloTagsFields melo_tags_get_fields_from_json_array (JsonArray *array);
 void melo_tags_add_to_json_object (MeloTags *tags, JsonObject *object,
                                    MeloTagsFields fields);
 JsonObject *melo_tags_to_json_object (MeloTags *tags, MeloTagsFields fields);
+void melo_tags_add_to_jsonrpc_writer (MeloTags *tags, MeloJSONRPCWriter *writer,
+                                      MeloTagsFields fields);
+void melo_tags_to_jsonrpc_writer (MeloTags *tags, MeloJSONRPCWriter *writer,
+                                  MeloTagsFields fields);
 
 #endif /* __MELO_TAGS_H__ */
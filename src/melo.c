@@ -31,6 +31,7 @@
 #include "melo.h"
 #include "melo_sink.h"
 #include "melo_event.h"
+#include "melo_player.h"
 #include "melo_plugin.h"
 #include "melo_config_main.h"
 
@@ -131,6 +132,9 @@ main (int argc, char *argv[])
   /* Melo context */
   MeloContext context;
   gboolean reg;
+  gint64 window;
+  gint64 interval;
+  gchar *format;
   /* Melo event client */
   MeloEventClient *event_client = NULL;
   /* Main loop */
@@ -183,6 +187,14 @@ main (int argc, char *argv[])
                                 &context.audio.channels))
     context.audio.channels = 2;
 
+  /* Set event coalescing window */
+  if (melo_config_get_integer (config, "general", "event_window", &window))
+    melo_event_set_coalesce_window (window);
+
+  /* Set player position sync interval */
+  if (melo_config_get_integer (config, "general", "pos_interval", &interval))
+    melo_player_set_pos_sync_interval (interval);
+
   /* Get HTTP server ports */
   if (!melo_config_get_integer (config, "http", "port", &context.port))
     context.port = 8080;
@@ -190,7 +202,24 @@ main (int argc, char *argv[])
     context.sport = 8443;
 
   /* Initialize main audio sink */
-  melo_sink_main_init (context.audio.rate, context.audio.channels);
+  if (melo_config_get_string (config, "audio", "format", &format)) {
+    melo_sink_set_main_format (format);
+    g_free (format);
+  }
+  if (melo_config_get_string (config, "audio", "latency", &format)) {
+    melo_sink_set_main_profile (format);
+    g_free (format);
+  }
+  if (melo_config_get_string (config, "audio", "device", &format)) {
+    melo_sink_set_main_device (format);
+    g_free (format);
+  }
+  if (!melo_sink_main_init (context.audio.rate, context.audio.channels)) {
+    g_printerr ("Failed to initialize main audio sink\n");
+    g_object_unref (config);
+    g_free (context.name);
+    return -1;
+  }
 
   /* Add discoverer */
   context.disco = melo_discover_new ();
@@ -203,6 +232,7 @@ main (int argc, char *argv[])
     event_client = melo_event_register (melo_event_callback, NULL);
 
   /* Register standard JSON-RPC methods */
+  melo_jsonrpc_register_rpc_methods ();
   melo_config_jsonrpc_register_methods ();
   melo_sink_jsonrpc_register_methods ();
   melo_module_jsonrpc_register_methods ();
@@ -339,6 +369,7 @@ end:
   melo_module_jsonrpc_unregister_methods ();
   melo_sink_jsonrpc_unregister_methods ();
   melo_config_jsonrpc_unregister_methods ();
+  melo_jsonrpc_unregister_rpc_methods ();
 
   /* Unregister event client */
   if (event_client)
@@ -21,6 +21,8 @@
 
 #include "melo.h"
 #include "melo_sink.h"
+#include "melo_event.h"
+#include "melo_player.h"
 #include "melo_config_main.h"
 
 static MeloConfigItem melo_config_general[] = {
@@ -38,6 +40,20 @@ static MeloConfigItem melo_config_general[] = {
     .element = MELO_CONFIG_ELEMENT_CHECKBOX,
     .def._boolean = TRUE,
   },
+  {
+    .id = "event_window",
+    .name = "Event coalescing window (ms)",
+    .type = MELO_CONFIG_TYPE_INTEGER,
+    .element = MELO_CONFIG_ELEMENT_NUMBER,
+    .def._integer = 100,
+  },
+  {
+    .id = "pos_interval",
+    .name = "Player position sync interval (ms)",
+    .type = MELO_CONFIG_TYPE_INTEGER,
+    .element = MELO_CONFIG_ELEMENT_NUMBER,
+    .def._integer = MELO_PLAYER_POS_SYNC_INTERVAL_DEFAULT,
+  },
 };
 
 static MeloConfigItem melo_config_audio[] = {
@@ -55,6 +71,27 @@ static MeloConfigItem melo_config_audio[] = {
     .element = MELO_CONFIG_ELEMENT_NUMBER,
     .def._integer = 44100,
   },
+  {
+    .id = "format",
+    .name = "Sample format (S16LE, S32LE, F32LE or native)",
+    .type = MELO_CONFIG_TYPE_STRING,
+    .element = MELO_CONFIG_ELEMENT_TEXT,
+    .def._string = "S32LE",
+  },
+  {
+    .id = "latency",
+    .name = "Latency profile (low, balanced or power-save)",
+    .type = MELO_CONFIG_TYPE_STRING,
+    .element = MELO_CONFIG_ELEMENT_TEXT,
+    .def._string = "balanced",
+  },
+  {
+    .id = "device",
+    .name = "Output device (auto or GStreamer sink, ex: alsasink device=hw:1)",
+    .type = MELO_CONFIG_TYPE_STRING,
+    .element = MELO_CONFIG_ELEMENT_TEXT,
+    .def._string = "auto",
+  },
 };
 
 static MeloConfigItem melo_config_http[] = {
@@ -149,6 +186,22 @@ gboolean
 melo_config_main_check_general (MeloConfigContext *context, gpointer user_data,
                                 gchar **error)
 {
+  gint64 value;
+
+  /* Check event coalescing window */
+  if (melo_config_get_updated_integer (context, "event_window", &value, NULL) &&
+      (value < 0 || value > 10000)) {
+    *error = g_strdup ("Event window must be between 0 and 10000 ms!");
+    return FALSE;
+  }
+
+  /* Check player position sync interval */
+  if (melo_config_get_updated_integer (context, "pos_interval", &value, NULL) &&
+      (value < 0 || value > 60000)) {
+    *error = g_strdup ("Position interval must be between 0 and 60000 ms!");
+    return FALSE;
+  }
+
   return TRUE;
 }
 
@@ -158,6 +211,7 @@ melo_config_main_update_general (MeloConfigContext *context, gpointer user_data)
   MeloContext *ctx = (MeloContext *) user_data;
   const gchar *old, *new;
   gboolean bold, bnew;
+  gint64 value;
 
   /* Update name */
   if (melo_config_get_updated_string (context, "name", &new, &old) &&
@@ -175,6 +229,14 @@ melo_config_main_update_general (MeloConfigContext *context, gpointer user_data)
     else if (bold)
       melo_discover_unregister_device (ctx->disco);
   }
+
+  /* Update event coalescing window */
+  if (melo_config_get_updated_integer (context, "event_window", &value, NULL))
+    melo_event_set_coalesce_window (value);
+
+  /* Update player position sync interval */
+  if (melo_config_get_updated_integer (context, "pos_interval", &value, NULL))
+    melo_player_set_pos_sync_interval (value);
 }
 
 /* Audio section */
@@ -182,6 +244,7 @@ gboolean
 melo_config_main_check_audio (MeloConfigContext *context, gpointer user_data,
                               gchar **error)
 {
+  const gchar *format, *profile, *device;
   gint64 value;
 
   /* Check channels */
@@ -198,18 +261,63 @@ melo_config_main_check_audio (MeloConfigContext *context, gpointer user_data,
     return FALSE;
   }
 
+  /* Check sample format */
+  if (melo_config_get_updated_string (context, "format", &format, NULL) &&
+      g_strcmp0 (format, "S16LE") && g_strcmp0 (format, "S32LE") &&
+      g_strcmp0 (format, "F32LE") && g_strcmp0 (format, "native")) {
+    *error = g_strdup ("Only S16LE, S32LE, F32LE and native are supported!");
+    return FALSE;
+  }
+
+  /* Check latency profile */
+  if (melo_config_get_updated_string (context, "latency", &profile, NULL) &&
+      g_strcmp0 (profile, "low") && g_strcmp0 (profile, "balanced") &&
+      g_strcmp0 (profile, "power-save")) {
+    *error = g_strdup ("Only low, balanced and power-save are supported!");
+    return FALSE;
+  }
+
+  /* Check output device */
+  if (melo_config_get_updated_string (context, "device", &device, NULL) &&
+      g_strcmp0 (device, "auto")) {
+    GstElement *bin;
+
+    bin = gst_parse_bin_from_description (device, TRUE, NULL);
+    if (!bin) {
+      *error = g_strdup ("Invalid output device!");
+      return FALSE;
+    }
+    gst_object_unref (bin);
+  }
+
   return TRUE;
 }
 
 void
 melo_config_main_update_audio (MeloConfigContext *context, gpointer user_data)
 {
+  const gchar *format, *profile, *device, *old;
   gint64 rate, channels;
 
   /* Get values */
   if (melo_config_get_updated_integer (context, "samplerate", &rate, NULL) &&
       melo_config_get_updated_integer (context, "channels", &channels, NULL))
     melo_sink_set_main_config (rate, channels);
+
+  /* Update sample format */
+  if (melo_config_get_updated_string (context, "format", &format, &old) &&
+      g_strcmp0 (format, old))
+    melo_sink_set_main_format (format);
+
+  /* Update latency profile */
+  if (melo_config_get_updated_string (context, "latency", &profile, &old) &&
+      g_strcmp0 (profile, old))
+    melo_sink_set_main_profile (profile);
+
+  /* Switch output device */
+  if (melo_config_get_updated_string (context, "device", &device, &old) &&
+      g_strcmp0 (device, old))
+    melo_sink_set_main_device (device);
 }
 
 /* HTTP server section */
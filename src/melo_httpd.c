@@ -26,10 +26,12 @@
 #include <glib.h>
 
 #include "melo_tags.h"
+#include "melo_jsonrpc.h"
 #include "melo_avahi.h"
 #include "melo_httpd.h"
 #include "melo_httpd_file.h"
 #include "melo_httpd_cover.h"
+#include "melo_httpd_events.h"
 #include "melo_httpd_jsonrpc.h"
 
 #ifdef HAVE_CONFIG_H
@@ -59,8 +61,11 @@ struct _MeloHTTPDPrivate {
   gchar *username;
   gchar *password;
 
-  /* Thread pools */
-  GThreadPool *jsonrpc_pool;
+  /* Event stream */
+  MeloHttpdEvents *events;
+
+  /* Thread pools: one JSON-RPC pool per priority class */
+  GThreadPool *jsonrpc_pools[MELO_JSONRPC_PRIORITY_COUNT];
   GThreadPool *cover_pool;
 };
 
@@ -76,11 +81,17 @@ melo_httpd_finalize (GObject *gobject)
   if (priv->avahi)
     g_object_unref (priv->avahi);
 
+  /* Free event stream */
+  melo_httpd_events_free (priv->events);
+
   /* Free HTTP server */
   g_object_unref (priv->server);
 
   /* Free thread pools */
-  g_thread_pool_free (priv->jsonrpc_pool, TRUE, FALSE);
+  g_thread_pool_free (priv->jsonrpc_pools[MELO_JSONRPC_PRIORITY_DEFAULT], TRUE,
+                      FALSE);
+  g_thread_pool_free (priv->jsonrpc_pools[MELO_JSONRPC_PRIORITY_CONTROL], TRUE,
+                      FALSE);
   g_thread_pool_free (priv->cover_pool, TRUE, FALSE);
 
   /* free authentication */
@@ -132,12 +143,21 @@ melo_httpd_init (MeloHTTPD *self)
                           NULL);
   priv->auth_enabled = FALSE;
 
-  /* Init thread pools */
-  priv->jsonrpc_pool = g_thread_pool_new (melo_httpd_jsonrpc_thread_handler,
-                                          priv->server, 10, FALSE, NULL);
+  /* Init thread pools: control requests have their own small pool in order
+   * to not wait behind slow browsing requests
+   */
+  priv->jsonrpc_pools[MELO_JSONRPC_PRIORITY_DEFAULT] =
+           g_thread_pool_new (melo_httpd_jsonrpc_thread_handler, priv->server,
+                              10, FALSE, NULL);
+  priv->jsonrpc_pools[MELO_JSONRPC_PRIORITY_CONTROL] =
+           g_thread_pool_new (melo_httpd_jsonrpc_thread_handler, priv->server,
+                              2, FALSE, NULL);
   priv->cover_pool = g_thread_pool_new (melo_httpd_cover_thread_handler,
                                         priv->server, 10, FALSE, NULL);
 
+  /* Create event stream */
+  priv->events = melo_httpd_events_new ();
+
   /* Create an avahi client */
   priv->avahi = melo_avahi_new ();
 }
@@ -237,7 +257,12 @@ melo_httpd_start (MeloHTTPD *httpd, guint port, guint sport, const gchar *name)
 
   /* Add an handler for JSON-RPC */
   soup_server_add_handler (server, "/rpc", melo_httpd_jsonrpc_handler,
-                           priv->jsonrpc_pool, NULL);
+                           priv->jsonrpc_pools, NULL);
+
+  /* Add an handler for event stream */
+  soup_server_add_websocket_handler (server, "/events", NULL, NULL,
+                                     melo_httpd_events_handler, priv->events,
+                                     NULL);
 
   /* Add an handler for covers */
   soup_server_add_handler (server, "/cover", melo_httpd_cover_handler,
@@ -0,0 +1,253 @@
+/*
+ * melo_httpd_events.c: Event stream handler for Melo HTTP server
+ *
+ * Copyright (C) 2017 Alexandre Dilly <dillya@sparod.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA  02110-1301, USA.
+ */
+
+#include "melo_event.h"
+#include "melo_event_jsonrpc.h"
+
+#include "melo_httpd_events.h"
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+/* Maximum number of pending events for a connection */
+#define MELO_HTTPD_EVENTS_QUEUE_SIZE 256
+
+/* Number of events kept for replay with "since=<seq>" */
+#define MELO_HTTPD_EVENTS_HISTORY_SIZE 32
+
+struct _MeloHttpdEvents {
+  GMainContext *context;
+
+  /* WebSocket connections (only used from context) */
+  GList *connections;
+};
+
+typedef struct {
+  MeloHttpdEvents *events;
+  SoupWebsocketConnection *connection;
+  MeloEventClient *client;
+} MeloHttpdEventsConnection;
+
+/**
+ * melo_httpd_events_new:
+ *
+ * Create a new event stream context to use with melo_httpd_events_handler().
+ * The WebSocket connections are handled in the thread-default main context of
+ * the caller, which must be the #SoupServer context. The event history is
+ * enabled to support replay of missed events.
+ *
+ * Returns: (transfer full): a new #MeloHttpdEvents, or %NULL if failed.
+ */
+MeloHttpdEvents *
+melo_httpd_events_new (void)
+{
+  MeloHttpdEvents *events;
+
+  /* Create new events context */
+  events = g_slice_new0 (MeloHttpdEvents);
+  if (!events)
+    return NULL;
+
+  /* Init events context */
+  events->context = g_main_context_ref_thread_default ();
+
+  /* Keep last events for replay */
+  melo_event_set_history_size (MELO_HTTPD_EVENTS_HISTORY_SIZE);
+
+  return events;
+}
+
+static void
+melo_httpd_events_connection_free (MeloHttpdEventsConnection *conn)
+{
+  /* Stop listening events */
+  melo_event_unregister (conn->client);
+
+  /* Release connection */
+  g_signal_handlers_disconnect_by_data (conn->connection, conn);
+  g_object_unref (conn->connection);
+  g_slice_free (MeloHttpdEventsConnection, conn);
+}
+
+static void
+melo_httpd_events_closed (SoupWebsocketConnection *connection,
+                          gpointer user_data)
+{
+  MeloHttpdEventsConnection *conn = user_data;
+  MeloHttpdEvents *events = conn->events;
+
+  /* Remove connection */
+  events->connections = g_list_remove (events->connections, conn);
+  melo_httpd_events_connection_free (conn);
+}
+
+/**
+ * melo_httpd_events_free:
+ * @events: the events context
+ *
+ * Close all WebSocket connections, stop listening events and release the
+ * events context.
+ */
+void
+melo_httpd_events_free (MeloHttpdEvents *events)
+{
+  /* Release all connections */
+  while (events->connections) {
+    MeloHttpdEventsConnection *conn = events->connections->data;
+
+    events->connections = g_list_delete_link (events->connections,
+                                              events->connections);
+    if (soup_websocket_connection_get_state (conn->connection) ==
+        SOUP_WEBSOCKET_STATE_OPEN)
+      soup_websocket_connection_close (conn->connection,
+                                       SOUP_WEBSOCKET_CLOSE_GOING_AWAY, NULL);
+    melo_httpd_events_connection_free (conn);
+  }
+
+  /* Free events context */
+  g_main_context_unref (events->context);
+  g_slice_free (MeloHttpdEvents, events);
+}
+
+static gboolean
+melo_httpd_events_callback (MeloEventClient *client, MeloEventType type,
+                            guint event, const gchar *id, gpointer data,
+                            gpointer user_data)
+{
+  MeloHttpdEventsConnection *conn = user_data;
+  GBytes *bytes;
+
+  /* Connection is closing */
+  if (soup_websocket_connection_get_state (conn->connection) !=
+      SOUP_WEBSOCKET_STATE_OPEN)
+    return FALSE;
+
+  /* Get serialized event (shared with other connections) */
+  bytes = melo_event_get_serialized (melo_event_jsonrpc_event_to_bytes);
+  if (!bytes)
+    return FALSE;
+
+  /* Send message */
+  soup_websocket_connection_send_text (conn->connection,
+                                       g_bytes_get_data (bytes, NULL));
+  g_bytes_unref (bytes);
+
+  return TRUE;
+}
+
+static void
+melo_httpd_events_parse_filters (GHashTable *query, guint32 *events)
+{
+  const gchar *value;
+  gchar **types;
+  guint i, j;
+
+  /* Subscribe to all events by default */
+  for (i = 0; i < MELO_EVENT_TYPE_COUNT; i++)
+    events[i] = MELO_EVENT_MASK_ALL;
+
+  /* Filter event types: "type=player,playlist" */
+  value = query ? g_hash_table_lookup (query, "type") : NULL;
+  if (!value)
+    return;
+
+  types = g_strsplit (value, ",", -1);
+  for (i = 0; i < MELO_EVENT_TYPE_COUNT; i++) {
+    const gchar *type = melo_event_type_to_string (i);
+
+    for (j = 0; types[j] != NULL; j++)
+      if (!g_strcmp0 (types[j], type))
+        break;
+    if (!types[j])
+      events[i] = MELO_EVENT_MASK_NONE;
+  }
+  g_strfreev (types);
+}
+
+static void
+melo_httpd_events_replay (MeloHttpdEventsConnection *conn, GHashTable *query)
+{
+  const gchar *value;
+  gchar *msg;
+
+  /* Replay missed events: "since=<seq>" */
+  value = query ? g_hash_table_lookup (query, "since") : NULL;
+  if (value &&
+      !melo_event_client_replay (conn->client,
+                                 g_ascii_strtoull (value, NULL, 10))) {
+    /* Some events are lost: client must fetch full state */
+    msg = g_strdup_printf ("{\"event\":\"resync\",\"seq\":%" G_GUINT64_FORMAT
+                           "}", melo_event_get_last_seq ());
+    soup_websocket_connection_send_text (conn->connection, msg);
+    g_free (msg);
+  }
+}
+
+void
+melo_httpd_events_handler (SoupServer *server,
+                           SoupWebsocketConnection *connection,
+                           const char *path, SoupClientContext *client,
+                           gpointer user_data)
+{
+  guint32 filters[MELO_EVENT_TYPE_COUNT];
+  MeloHttpdEvents *events = user_data;
+  MeloHttpdEventsConnection *conn;
+  const gchar *id_pattern = NULL;
+  GHashTable *query = NULL;
+  SoupURI *uri;
+
+  /* Create connection context */
+  conn = g_slice_new (MeloHttpdEventsConnection);
+  conn->events = events;
+  conn->connection = g_object_ref (connection);
+
+  /* Parse request query */
+  uri = soup_websocket_connection_get_uri (connection);
+  if (uri && uri->query)
+    query = soup_form_decode (uri->query);
+
+  /* Get subscription filters */
+  melo_httpd_events_parse_filters (query, filters);
+
+  /* Filter object IDs: "id=file_player" or "id=radio_*" */
+  if (query)
+    id_pattern = g_hash_table_lookup (query, "id");
+
+  /* Listen events: they are delivered in the server context, and the oldest
+   * are dropped if the connection is too slow
+   */
+  conn->client = melo_event_register_async (melo_httpd_events_callback, conn,
+                                            events->context,
+                                            MELO_HTTPD_EVENTS_QUEUE_SIZE,
+                                            MELO_EVENT_OVERFLOW_DROP_OLDEST,
+                                            filters, id_pattern);
+
+  /* Replay events from request query */
+  melo_httpd_events_replay (conn, query);
+  if (query)
+    g_hash_table_unref (query);
+
+  /* Add connection */
+  events->connections = g_list_prepend (events->connections, conn);
+  g_signal_connect (connection, "closed",
+                    G_CALLBACK (melo_httpd_events_closed), conn);
+}
@@ -0,0 +1,38 @@
+/*
+ * melo_httpd_events.h: Event stream handler for Melo HTTP server
+ *
+ * Copyright (C) 2017 Alexandre Dilly <dillya@sparod.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA  02110-1301, USA.
+ */
+
+#ifndef __MELO_HTTPD_EVENTS_H__
+#define __MELO_HTTPD_EVENTS_H__
+
+#include <glib.h>
+#include <libsoup/soup.h>
+
+typedef struct _MeloHttpdEvents MeloHttpdEvents;
+
+MeloHttpdEvents *melo_httpd_events_new (void);
+void melo_httpd_events_free (MeloHttpdEvents *events);
+
+void melo_httpd_events_handler (SoupServer *server,
+                                SoupWebsocketConnection *connection,
+                                const char *path, SoupClientContext *client,
+                                gpointer user_data);
+
+#endif /* __MELO_HTTPD_EVENTS_H__ */
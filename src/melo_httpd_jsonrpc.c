@@ -32,27 +32,57 @@
 #endif
 
 
+typedef struct {
+  SoupServer *server;
+  SoupMessage *msg;
+} MeloHttpdJSONRPCRequest;
+
+static void
+melo_httpd_jsonrpc_append_chunk (const gchar *data, gsize length,
+                                 gpointer user_data)
+{
+  MeloHttpdJSONRPCRequest *req = user_data;
+
+  /* Append chunk to response body */
+  soup_message_body_append (req->msg->response_body, SOUP_MEMORY_COPY, data,
+                            length);
+}
+
+static void
+melo_httpd_jsonrpc_done (gboolean response, gpointer user_data)
+{
+  MeloHttpdJSONRPCRequest *req = user_data;
+
+  /* Set response content type */
+  if (response)
+    soup_message_headers_set_content_type (req->msg->response_headers,
+                                           "application/json", NULL);
+
+  /* Send response */
+  soup_server_unpause_message (req->server, req->msg);
+  g_slice_free (MeloHttpdJSONRPCRequest, req);
+}
+
 void
 melo_httpd_jsonrpc_thread_handler (gpointer data, gpointer user_data)
 {
-  SoupServer *server = SOUP_SERVER (user_data);
-  SoupMessage *msg = SOUP_MESSAGE (data);
-  GError *err = NULL;
-  char *res;
+  MeloHttpdJSONRPCRequest *req;
 
-  /* Parse request */
-  res = melo_jsonrpc_parse_request (msg->request_body->data,
-                                    msg->request_body->length,
-                                    &err);
+  /* Create request context */
+  req = g_slice_new (MeloHttpdJSONRPCRequest);
+  req->server = SOUP_SERVER (user_data);
+  req->msg = SOUP_MESSAGE (data);
 
   /* Set response status */
-  soup_message_set_status (msg, SOUP_STATUS_OK);
+  soup_message_set_status (req->msg, SOUP_STATUS_OK);
 
-  /* Set response */
-  if (res)
-    soup_message_set_response (msg, "application/json", SOUP_MEMORY_TAKE,
-                               res, strlen (res));
-  soup_server_unpause_message (server, msg);
+  /* Parse request: the message is unpaused when the response is complete,
+   * which can happen later if a method deferred its result.
+   */
+  melo_jsonrpc_parse_request_async (req->msg->request_body->data,
+                                    req->msg->request_body->length,
+                                    melo_httpd_jsonrpc_append_chunk,
+                                    melo_httpd_jsonrpc_done, req);
 }
 
 void
@@ -60,7 +90,8 @@ melo_httpd_jsonrpc_handler (SoupServer *server, SoupMessage *msg,
                             const char *path, GHashTable *query,
                             SoupClientContext *client, gpointer user_data)
 {
-  GThreadPool *pool = (GThreadPool *) user_data;
+  GThreadPool **pools = (GThreadPool **) user_data;
+  MeloJSONRPCPriority priority;
 
   /* We only support POST method */
   if (msg->method != SOUP_METHOD_POST) {
@@ -74,7 +105,11 @@ melo_httpd_jsonrpc_handler (SoupServer *server, SoupMessage *msg,
     return;
   }
 
+  /* Select thread pool from request priority */
+  priority = melo_jsonrpc_get_request_priority (msg->request_body->data,
+                                                msg->request_body->length);
+
   /* Push request to thread pool */
   soup_server_pause_message (server, msg);
-  g_thread_pool_push (pool, msg, NULL);
+  g_thread_pool_push (pools[priority], msg, NULL);
 }
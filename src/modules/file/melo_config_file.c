@@ -19,6 +19,7 @@
  * Boston, MA  02110-1301, USA.
  */
 
+#include "melo_player_file.h"
 #include "melo_config_file.h"
 
 static MeloConfigItem melo_config_global[] = {
@@ -32,13 +33,29 @@ static MeloConfigItem melo_config_global[] = {
   },
 };
 
+static MeloConfigItem melo_config_playback[] = {
+  {
+    .id = "crossfade",
+    .name = "Crossfade duration (ms)",
+    .type = MELO_CONFIG_TYPE_INTEGER,
+    .element = MELO_CONFIG_ELEMENT_NUMBER,
+    .def._integer = 0,
+  },
+};
+
 static MeloConfigGroup melo_config_file[] = {
   {
     .id = "global",
     .name = "Global",
     .items = melo_config_global,
     .items_count = G_N_ELEMENTS (melo_config_global),
-  }
+  },
+  {
+    .id = "playback",
+    .name = "Playback",
+    .items = melo_config_playback,
+    .items_count = G_N_ELEMENTS (melo_config_playback),
+  },
 };
 
 MeloConfig *
@@ -47,3 +64,31 @@ melo_config_file_new (void)
   return melo_config_new ("file", melo_config_file,
                           G_N_ELEMENTS (melo_config_file));
 }
+
+gboolean
+melo_config_file_check_playback (MeloConfigContext *context,
+                                 gpointer user_data, gchar **error)
+{
+  gint64 value;
+
+  /* Check crossfade duration */
+  if (melo_config_get_updated_integer (context, "crossfade", &value, NULL) &&
+      (value < 0 || value > 30000)) {
+    *error = g_strdup ("Crossfade duration must be from 0 to 30000 ms!");
+    return FALSE;
+  }
+
+  return TRUE;
+}
+
+void
+melo_config_file_update_playback (MeloConfigContext *context,
+                                  gpointer user_data)
+{
+  MeloPlayerFile *pfile = MELO_PLAYER_FILE (user_data);
+  gint64 value;
+
+  /* Update crossfade duration */
+  if (melo_config_get_updated_integer (context, "crossfade", &value, NULL))
+    melo_player_file_set_crossfade (pfile, value);
+}
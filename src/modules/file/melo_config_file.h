@@ -26,4 +26,9 @@
 
 MeloConfig *melo_config_file_new (void);
 
+gboolean melo_config_file_check_playback (MeloConfigContext *context,
+                                          gpointer user_data, gchar **error);
+void melo_config_file_update_playback (MeloConfigContext *context,
+                                       gpointer user_data);
+
 #endif /* __MELO_CONFIG_FILE_H__ */
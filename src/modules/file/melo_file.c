@@ -97,6 +97,7 @@ static void
 melo_file_init (MeloFile *self)
 {
   MeloFilePrivate *priv = melo_file_get_instance_private (self);
+  gint64 value;
   gchar *path;
 
   self->priv = priv;
@@ -137,6 +138,17 @@ melo_file_init (MeloFile *self)
     melo_browser_file_set_local_path (MELO_BROWSER_FILE (priv->files), path);
     g_free (path);
   }
+
+  /* Load crossfade duration for player */
+  if (melo_config_get_integer (priv->config, "playback", "crossfade", &value))
+    melo_player_file_set_crossfade (MELO_PLAYER_FILE (priv->player), value);
+
+  /* Add config handler for playback */
+  melo_config_set_check_callback (priv->config, "playback",
+                                  melo_config_file_check_playback, NULL);
+  melo_config_set_update_callback (priv->config, "playback",
+                                   melo_config_file_update_playback,
+                                   priv->player);
 }
 
 static void
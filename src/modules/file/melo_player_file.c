@@ -24,8 +24,13 @@
 #include "melo_sink.h"
 #include "melo_player_file.h"
 
+/* Interval to check crossfade start and to update volumes (in ms) */
+#define MELO_PLAYER_FILE_CROSSFADE_CHECK 100
+#define MELO_PLAYER_FILE_CROSSFADE_STEP 50
+
 static gboolean bus_call (GstBus *bus, GstMessage *msg, gpointer data);
-static void pad_added_handler (GstElement *src, GstPad *pad, GstElement *sink);
+static void pad_added_handler (GstElement *src, GstPad *pad,
+                               gpointer user_data);
 
 static gboolean melo_player_file_add (MeloPlayer *player, const gchar *path,
                                       const gchar *name, MeloTags *tags);
@@ -45,6 +50,17 @@ static gboolean melo_player_file_set_mute (MeloPlayer *player, gboolean mute);
 
 static gint melo_player_file_get_pos (MeloPlayer *player);
 
+/* A deck plays a list of sources with a concat element. Without crossfade,
+ * the first deck is linked directly to the sink. Otherwise, a deck is linked
+ * to the mixer only when it is playing.
+ */
+typedef struct {
+  GstElement *concat;
+  GstPad *src_pad;
+  GstPad *mixer_pad;
+  gulong block_id;
+} MeloPlayerFileDeck;
+
 struct _MeloPlayerFilePrivate {
   GMutex mutex;
 
@@ -54,8 +70,22 @@ struct _MeloPlayerFilePrivate {
   /* Gstreamer pipeline */
   GstElement *pipeline;
   GstElement *src;
+  GstElement *mixer;
+  MeloPlayerFileDeck decks[2];
+  guint deck;
   MeloSink *sink;
   guint bus_watch_id;
+  guint src_count;
+
+  /* Prefetched media */
+  GstElement *next_src;
+  gchar *next_path;
+
+  /* Crossfade */
+  guint crossfade;
+  guint check_id;
+  guint fade_id;
+  GstElement *fade_src;
 };
 
 G_DEFINE_TYPE_WITH_PRIVATE (MeloPlayerFile, melo_player_file, MELO_TYPE_PLAYER)
@@ -68,18 +98,32 @@ melo_player_file_finalize (GObject *gobject)
   MeloPlayerFile *pfile = MELO_PLAYER_FILE (gobject);
   MeloPlayerFilePrivate *priv = melo_player_file_get_instance_private (pfile);
 
+  /* Stop crossfade timers */
+  if (priv->check_id)
+    g_source_remove (priv->check_id);
+  if (priv->fade_id)
+    g_source_remove (priv->fade_id);
+
   /* Stop pipeline */
   gst_element_set_state (priv->pipeline, GST_STATE_NULL);
 
   /* Remove message handler */
   g_source_remove (priv->bus_watch_id);
 
+  /* Release deck pads */
+  gst_object_unref (priv->decks[0].src_pad);
+  if (priv->decks[1].src_pad)
+    gst_object_unref (priv->decks[1].src_pad);
+
   /* Free gstreamer pipeline */
   g_object_unref (priv->pipeline);
 
   /* Free audio sink */
   g_object_unref (priv->sink);
 
+  /* Free prefetched media path */
+  g_free (priv->next_path);
+
   /* Free player mutex */
   g_mutex_clear (&priv->mutex);
 
@@ -123,13 +167,257 @@ melo_player_file_init (MeloPlayerFile *self)
   g_mutex_init (&priv->mutex);
 }
 
+static GstElement *
+melo_player_file_add_src (MeloPlayerFile *pfile, guint deck)
+{
+  MeloPlayerFilePrivate *priv = pfile->priv;
+  GstElement *src;
+  gchar *uri_name;
+  GstPad *pad;
+
+  /* Create a new source */
+  uri_name = g_strdup_printf ("%s_uridecodebin%u",
+                              melo_player_get_id (MELO_PLAYER (pfile)),
+                              priv->src_count++);
+  src = gst_element_factory_make ("uridecodebin", uri_name);
+  gst_bin_add (GST_BIN (priv->pipeline), src);
+  g_free (uri_name);
+
+  /* Request a new concat pad: sources are played in request order */
+  pad = gst_element_get_request_pad (priv->decks[deck].concat, "sink_%u");
+  g_object_set_data_full (G_OBJECT (src), "concat-pad", pad, gst_object_unref);
+  g_object_set_data (G_OBJECT (src), "deck", GUINT_TO_POINTER (deck));
+
+  /* Add signal handler on new pad */
+  g_signal_connect (src, "pad-added", G_CALLBACK (pad_added_handler), NULL);
+
+  return src;
+}
+
+static void
+melo_player_file_remove_src (MeloPlayerFile *pfile, GstElement *src)
+{
+  MeloPlayerFilePrivate *priv = pfile->priv;
+  guint deck;
+  GstPad *pad;
+
+  /* Stop source */
+  gst_element_set_state (src, GST_STATE_NULL);
+
+  /* Release its concat pad: if it was playing, concat switches to the next
+   * source.
+   */
+  pad = g_object_get_data (G_OBJECT (src), "concat-pad");
+  deck = GPOINTER_TO_UINT (g_object_get_data (G_OBJECT (src), "deck"));
+  gst_element_release_request_pad (priv->decks[deck].concat, pad);
+
+  /* Remove source from pipeline */
+  gst_bin_remove (GST_BIN (priv->pipeline), src);
+}
+
+static GstPadProbeReturn
+melo_player_file_deck_probe (GstPad *pad, GstPadProbeInfo *info,
+                             gpointer user_data)
+{
+  GstEvent *event = GST_PAD_PROBE_INFO_EVENT (info);
+  GstTagList *tags;
+
+  switch (GST_EVENT_TYPE (event)) {
+    case GST_EVENT_TAG:
+      /* The mixer doesn't forward tags: post them for the bus handler */
+      gst_event_parse_tag (event, &tags);
+      gst_element_post_message (GST_ELEMENT (user_data),
+                                gst_message_new_tag (GST_OBJECT (user_data),
+                                                     gst_tag_list_copy (tags)));
+      break;
+    case GST_EVENT_FLUSH_STOP:
+      /* Running time restarts from zero after a flushing seek */
+      gst_pad_set_offset (pad, 0);
+      break;
+    default:
+      break;
+  }
+
+  return GST_PAD_PROBE_OK;
+}
+
+static GstPadProbeReturn
+melo_player_file_offset_probe (GstPad *pad, GstPadProbeInfo *info,
+                               gpointer user_data)
+{
+  GstEvent *event = GST_PAD_PROBE_INFO_EVENT (info);
+  const GstSegment *segment;
+  gint64 *target = user_data;
+
+  /* Wait first segment */
+  if (GST_EVENT_TYPE (event) != GST_EVENT_SEGMENT)
+    return GST_PAD_PROBE_OK;
+
+  /* Start deck at mixer position */
+  gst_event_parse_segment (event, &segment);
+  gst_pad_set_offset (pad, *target - (gint64) segment->base);
+
+  return GST_PAD_PROBE_REMOVE;
+}
+
+static GstPadProbeReturn
+melo_player_file_block_probe (GstPad *pad, GstPadProbeInfo *info,
+                              gpointer user_data)
+{
+  /* Keep deck blocked until it is linked to the mixer */
+  return GST_PAD_PROBE_OK;
+}
+
+static void
+melo_player_file_deck_link (MeloPlayerFile *pfile, guint deck, gint64 target,
+                            gdouble volume)
+{
+  MeloPlayerFileDeck *d = &pfile->priv->decks[deck];
+  gint64 *offset;
+
+  /* Already linked */
+  if (d->mixer_pad)
+    return;
+
+  /* Link deck to a new mixer pad */
+  d->mixer_pad = gst_element_get_request_pad (pfile->priv->mixer, "sink_%u");
+  g_object_set (d->mixer_pad, "volume", volume, NULL);
+  gst_pad_link (d->src_pad, d->mixer_pad);
+
+  /* Align first segment of the deck on the mixer position */
+  if (target > 0) {
+    offset = g_new (gint64, 1);
+    *offset = target;
+    gst_pad_add_probe (d->src_pad, GST_PAD_PROBE_TYPE_EVENT_DOWNSTREAM,
+                       melo_player_file_offset_probe, offset, g_free);
+  } else
+    gst_pad_set_offset (d->src_pad, 0);
+
+  /* Unblock deck */
+  if (d->block_id) {
+    gst_pad_remove_probe (d->src_pad, d->block_id);
+    d->block_id = 0;
+  }
+}
+
+static void
+melo_player_file_deck_unlink (MeloPlayerFile *pfile, guint deck)
+{
+  MeloPlayerFileDeck *d = &pfile->priv->decks[deck];
+
+  /* Block deck: its sources can preroll without mixer */
+  if (!d->block_id)
+    d->block_id = gst_pad_add_probe (d->src_pad,
+                                     GST_PAD_PROBE_TYPE_BLOCK_DOWNSTREAM,
+                                     melo_player_file_block_probe, NULL, NULL);
+
+  /* Not linked */
+  if (!d->mixer_pad)
+    return;
+
+  /* Release mixer pad */
+  gst_pad_unlink (d->src_pad, d->mixer_pad);
+  gst_element_release_request_pad (pfile->priv->mixer, d->mixer_pad);
+  gst_object_unref (d->mixer_pad);
+  d->mixer_pad = NULL;
+
+  /* Reset concat (it may have sent EOS) for next crossfade */
+  gst_element_set_state (d->concat, GST_STATE_READY);
+  gst_element_sync_state_with_parent (d->concat);
+}
+
+static void
+melo_player_file_active_pad_changed (GstElement *concat, GParamSpec *pspec,
+                                     gpointer user_data)
+{
+  GstStructure *s;
+
+  /* Notify bus handler: a new source is played by a deck */
+  s = gst_structure_new_empty ("melo-player-file-switch");
+  gst_element_post_message (concat,
+                            gst_message_new_application (GST_OBJECT (concat),
+                                                         s));
+}
+
+static void
+melo_player_file_add_deck (MeloPlayerFile *pfile, guint deck)
+{
+  MeloPlayerFileDeck *d = &pfile->priv->decks[deck];
+
+  /* Create concat and watch its output */
+  d->concat = gst_element_factory_make ("concat", NULL);
+  gst_bin_add (GST_BIN (pfile->priv->pipeline), d->concat);
+  d->src_pad = gst_element_get_static_pad (d->concat, "src");
+  gst_pad_add_probe (d->src_pad, GST_PAD_PROBE_TYPE_EVENT_DOWNSTREAM |
+                     GST_PAD_PROBE_TYPE_EVENT_FLUSH,
+                     melo_player_file_deck_probe, d->concat, NULL);
+  g_signal_connect (d->concat, "notify::active-pad",
+                    G_CALLBACK (melo_player_file_active_pad_changed), NULL);
+}
+
+static GstPadProbeReturn
+melo_player_file_mixer_probe (GstPad *pad, GstPadProbeInfo *info,
+                              gpointer user_data)
+{
+  MeloPlayerFilePrivate *priv = user_data;
+  GstElement *sink = melo_sink_get_gst_sink (priv->sink);
+  GstPad *sink_pad;
+
+  /* Move first deck from sink to mixer while no data is flowing */
+  sink_pad = gst_element_get_static_pad (sink, "sink");
+  gst_pad_unlink (pad, sink_pad);
+  gst_object_unref (sink_pad);
+  gst_element_link (priv->mixer, sink);
+  gst_pad_link (pad, priv->decks[0].mixer_pad);
+  gst_object_unref (sink);
+
+  return GST_PAD_PROBE_REMOVE;
+}
+
+static gboolean
+melo_player_file_add_mixer (MeloPlayerFile *pfile)
+{
+  MeloPlayerFilePrivate *priv = pfile->priv;
+  GstElement *mixer;
+  gchar *name;
+
+  /* Create mixer */
+  name = g_strjoin ("_", melo_player_get_id (MELO_PLAYER (pfile)), "mixer",
+                    NULL);
+  mixer = gst_element_factory_make ("audiomixer", name);
+  g_free (name);
+  if (!mixer) {
+    g_warning ("failed to create audiomixer: crossfade is disabled");
+    return FALSE;
+  }
+
+  /* Start mixer output at running time of the first deck */
+  gst_util_set_object_arg (G_OBJECT (mixer), "start-time-selection", "first");
+  gst_bin_add (GST_BIN (priv->pipeline), mixer);
+  gst_element_sync_state_with_parent (mixer);
+  priv->mixer = mixer;
+
+  /* Create second deck: it is blocked until a crossfade */
+  melo_player_file_add_deck (pfile, 1);
+  melo_player_file_deck_unlink (pfile, 1);
+  gst_element_sync_state_with_parent (priv->decks[1].concat);
+
+  /* Relink first deck (always the current one without mixer) to the mixer */
+  priv->decks[0].mixer_pad = gst_element_get_request_pad (mixer, "sink_%u");
+  g_object_set (priv->decks[0].mixer_pad, "volume", 1.0, NULL);
+  gst_pad_add_probe (priv->decks[0].src_pad, GST_PAD_PROBE_TYPE_IDLE,
+                     melo_player_file_mixer_probe, priv, NULL);
+
+  return TRUE;
+}
+
 static void
 melo_player_file_constructed (GObject *object)
 {
   MeloPlayerFile *pfile = MELO_PLAYER_FILE (object);
   MeloPlayerFilePrivate *priv = pfile->priv;
   MeloPlayer *player = MELO_PLAYER (object);
-  gchar *pipe_name, *uri_name, *sink_name;
+  gchar *pipe_name, *sink_name;
   const gchar *id, *name;
   GstElement *sink;
   GstBus *bus;
@@ -138,24 +426,26 @@ melo_player_file_constructed (GObject *object)
   id = melo_player_get_id (player);
   name = melo_player_get_name (player);
   pipe_name = g_strjoin ("_", id, "pipeline", NULL);
-  uri_name = g_strjoin ("_", id, "uridecodebin", NULL);
   sink_name = g_strjoin ("_", id, "sink", NULL);
 
-  /* Create pipeline */
+  /* Create pipeline: the sources are played one after the other by the concat
+   * of a deck, which allows gapless playback between two medias of the
+   * playlist. The mixer and the second deck used during a crossfade are only
+   * inserted when crossfade is enabled.
+   */
   priv->pipeline = gst_pipeline_new (pipe_name);
-  priv->src = gst_element_factory_make ("uridecodebin", uri_name);
   priv->sink = melo_sink_new (player, sink_name, name);
   sink = melo_sink_get_gst_sink (priv->sink);
-  gst_bin_add_many (GST_BIN (priv->pipeline), priv->src, sink, NULL);
+  gst_bin_add (GST_BIN (priv->pipeline), sink);
 
   /* Free element names */
   g_free (pipe_name);
-  g_free (uri_name);
   g_free (sink_name);
 
-  /* Add signal handler on new pad */
-  g_signal_connect(priv->src, "pad-added",
-                   G_CALLBACK (pad_added_handler), sink);
+  /* Create first deck, link it to the sink and create first source */
+  melo_player_file_add_deck (pfile, 0);
+  gst_element_link (priv->decks[0].concat, sink);
+  priv->src = melo_player_file_add_src (pfile, 0);
 
   /* Add a message handler */
   bus = gst_pipeline_get_bus (GST_PIPELINE (priv->pipeline));
@@ -163,6 +453,356 @@ melo_player_file_constructed (GObject *object)
   gst_object_unref (bus);
 }
 
+static gchar *
+melo_player_file_get_name (const gchar *path)
+{
+  gchar *escaped, *name;
+
+  /* Extract file name from URI */
+  escaped = g_path_get_basename (path);
+  name = g_uri_unescape_string (escaped, NULL);
+  g_free (escaped);
+
+  return name;
+}
+
+static gboolean
+melo_player_file_query_pos (MeloPlayerFilePrivate *priv, gint64 *pos)
+{
+  /* Get position of current media from its deck (the mixer position is the
+   * running time of the pipeline).
+   */
+  return gst_pad_query_position (priv->decks[priv->deck].src_pad,
+                                 GST_FORMAT_TIME, pos);
+}
+
+static gboolean melo_player_file_crossfade_check (gpointer user_data);
+
+static void
+melo_player_file_prefetch (MeloPlayerFile *pfile)
+{
+  MeloPlayerFilePrivate *priv = pfile->priv;
+  MeloPlayer *player = MELO_PLAYER (pfile);
+  guint deck;
+  gchar *path;
+
+  /* Next media already prefetched */
+  if (!player->playlist || priv->next_src)
+    return;
+
+  /* Get URI of next media without moving in playlist */
+  path = melo_playlist_get_next (player->playlist, NULL, NULL, FALSE);
+  if (!path)
+    return;
+
+  /* Lock player mutex */
+  g_mutex_lock (&priv->mutex);
+
+  /* Media prefetched in the meantime */
+  if (priv->next_src) {
+    g_mutex_unlock (&priv->mutex);
+    g_free (path);
+    return;
+  }
+
+  /* Create a new source and preroll it: it will wait on its concat pad until
+   * the end of the current media, or on the other deck until the crossfade.
+   */
+  deck = g_atomic_int_get (&priv->crossfade) && priv->mixer &&
+         !priv->fade_src ? priv->deck ^ 1 : priv->deck;
+  priv->next_src = melo_player_file_add_src (pfile, deck);
+  priv->next_path = path;
+  g_object_set (priv->next_src, "uri", path, NULL);
+  gst_element_sync_state_with_parent (priv->next_src);
+
+  /* Wait for crossfade start */
+  if (deck != priv->deck && !priv->check_id)
+    priv->check_id = g_timeout_add (MELO_PLAYER_FILE_CROSSFADE_CHECK,
+                                    melo_player_file_crossfade_check, pfile);
+
+  /* Unlock player mutex */
+  g_mutex_unlock (&priv->mutex);
+}
+
+static void
+melo_player_file_drop_next (MeloPlayerFile *pfile)
+{
+  MeloPlayerFilePrivate *priv = pfile->priv;
+
+  /* No media prefetched */
+  if (!priv->next_src)
+    return;
+
+  /* Stop waiting crossfade */
+  if (priv->check_id) {
+    g_source_remove (priv->check_id);
+    priv->check_id = 0;
+  }
+
+  /* Remove prefetched source */
+  melo_player_file_remove_src (pfile, priv->next_src);
+  priv->next_src = NULL;
+  g_free (priv->next_path);
+  priv->next_path = NULL;
+}
+
+static void
+melo_player_file_fade_stop (MeloPlayerFile *pfile)
+{
+  MeloPlayerFilePrivate *priv = pfile->priv;
+
+  /* No crossfade in progress */
+  if (!priv->fade_src)
+    return;
+
+  /* Stop volume update */
+  if (priv->fade_id) {
+    g_source_remove (priv->fade_id);
+    priv->fade_id = 0;
+  }
+
+  /* Remove faded source and release its deck */
+  melo_player_file_remove_src (pfile, priv->fade_src);
+  melo_player_file_deck_unlink (pfile, priv->deck ^ 1);
+  priv->fade_src = NULL;
+
+  /* Restore volume of current deck */
+  if (priv->decks[priv->deck].mixer_pad)
+    g_object_set (priv->decks[priv->deck].mixer_pad, "volume", 1.0, NULL);
+}
+
+static gboolean
+melo_player_file_is_next_active (MeloPlayerFile *pfile)
+{
+  MeloPlayerFilePrivate *priv = pfile->priv;
+  GstPad *active, *pad;
+
+  /* No media prefetched on current deck */
+  if (!priv->next_src ||
+      GPOINTER_TO_UINT (g_object_get_data (G_OBJECT (priv->next_src),
+                                           "deck")) != priv->deck)
+    return FALSE;
+
+  /* Check if concat is now playing the prefetched source */
+  pad = g_object_get_data (G_OBJECT (priv->next_src), "concat-pad");
+  g_object_get (priv->decks[priv->deck].concat, "active-pad", &active, NULL);
+  if (active)
+    gst_object_unref (active);
+
+  return pad == active;
+}
+
+static void
+melo_player_file_update_duration (MeloPlayerFile *pfile)
+{
+  MeloPlayerFilePrivate *priv = pfile->priv;
+  MeloPlayer *player = MELO_PLAYER (pfile);
+  gint64 value;
+
+  /* Get duration */
+  if (gst_element_query_duration (priv->src, GST_FORMAT_TIME, &value))
+    melo_player_set_status_duration (player, value / 1000000);
+
+  /* Get position */
+  if (melo_player_file_query_pos (priv, &value))
+    melo_player_set_status_pos (player, value / 1000000);
+}
+
+static void
+melo_player_file_switch (MeloPlayerFile *pfile, gboolean fade)
+{
+  MeloPlayerFilePrivate *priv = pfile->priv;
+  MeloPlayer *player = MELO_PLAYER (pfile);
+  MeloTags *tags = NULL;
+  gchar *name = NULL;
+  gchar *path, *next_path;
+
+  /* Lock player mutex */
+  g_mutex_lock (&priv->mutex);
+
+  /* Replace current source by prefetched source: during a crossfade, the
+   * current source is kept until the end of the fade.
+   */
+  if (fade)
+    priv->fade_src = priv->src;
+  else
+    melo_player_file_remove_src (pfile, priv->src);
+  priv->src = priv->next_src;
+  next_path = priv->next_path;
+  priv->next_src = NULL;
+  priv->next_path = NULL;
+
+  /* Unlock player mutex */
+  g_mutex_unlock (&priv->mutex);
+
+  /* Move to next media in playlist */
+  path = melo_playlist_get_next (player->playlist, &name, &tags, TRUE);
+
+  /* Playlist has been modified since prefetch: play the real next media */
+  if (path && g_strcmp0 (path, next_path)) {
+    melo_player_file_play (player, path, name, tags, FALSE);
+    goto end;
+  }
+
+  /* Playlist has been emptied since prefetch: the prefetched media is already
+   * played, so the status is updated from its path.
+   */
+  if (!path) {
+    path = next_path;
+    next_path = NULL;
+    if (!path)
+      goto end;
+  }
+
+  /* Update status with new media */
+  if (!name)
+    name = melo_player_file_get_name (path);
+  melo_player_reset_status (player, MELO_PLAYER_STATE_PLAYING, name,
+                            melo_tags_ref (tags));
+  melo_player_file_update_duration (pfile);
+
+  /* Prepare following media (after the end of the crossfade) */
+  if (!fade)
+    melo_player_file_prefetch (pfile);
+
+end:
+  melo_tags_unref (tags);
+  g_free (next_path);
+  g_free (name);
+  g_free (path);
+}
+
+static gboolean
+melo_player_file_fade (gpointer user_data)
+{
+  MeloPlayerFile *pfile = MELO_PLAYER_FILE (user_data);
+  MeloPlayerFilePrivate *priv = pfile->priv;
+  guint crossfade = g_atomic_int_get (&priv->crossfade);
+  gdouble volume = 0.0;
+  gint64 pos;
+
+  /* Lock player mutex */
+  g_mutex_lock (&priv->mutex);
+
+  /* Crossfade has been stopped in the meantime */
+  if (!priv->fade_src) {
+    priv->fade_id = 0;
+    g_mutex_unlock (&priv->mutex);
+    return FALSE;
+  }
+
+  /* Get fade progress from position of new media */
+  if (crossfade && melo_player_file_query_pos (priv, &pos))
+    volume = (gdouble) pos / (crossfade * GST_MSECOND);
+
+  /* End of crossfade */
+  if (!crossfade || volume >= 1.0) {
+    priv->fade_id = 0;
+    melo_player_file_fade_stop (pfile);
+    g_mutex_unlock (&priv->mutex);
+
+    /* Prepare following media */
+    melo_player_file_prefetch (pfile);
+    return FALSE;
+  }
+
+  /* Update volume of both decks */
+  if (priv->decks[priv->deck].mixer_pad)
+    g_object_set (priv->decks[priv->deck].mixer_pad, "volume", volume, NULL);
+  if (priv->decks[priv->deck ^ 1].mixer_pad)
+    g_object_set (priv->decks[priv->deck ^ 1].mixer_pad, "volume",
+                  1.0 - volume, NULL);
+
+  /* Unlock player mutex */
+  g_mutex_unlock (&priv->mutex);
+
+  return TRUE;
+}
+
+static gboolean
+melo_player_file_crossfade_check (gpointer user_data)
+{
+  MeloPlayerFile *pfile = MELO_PLAYER_FILE (user_data);
+  MeloPlayerFilePrivate *priv = pfile->priv;
+  guint crossfade = g_atomic_int_get (&priv->crossfade);
+  gint64 pos, duration, target;
+
+  /* Lock player mutex */
+  g_mutex_lock (&priv->mutex);
+
+  /* Prefetched media has been dropped or moved in the meantime */
+  if (!priv->next_src ||
+      GPOINTER_TO_UINT (g_object_get_data (G_OBJECT (priv->next_src),
+                                           "deck")) == priv->deck) {
+    priv->check_id = 0;
+    g_mutex_unlock (&priv->mutex);
+    return FALSE;
+  }
+
+  /* Get position and duration of current media */
+  if (!melo_player_file_query_pos (priv, &pos) ||
+      !gst_element_query_duration (priv->src, GST_FORMAT_TIME, &duration) ||
+      duration - pos > (gint64) crossfade * GST_MSECOND) {
+    g_mutex_unlock (&priv->mutex);
+    return TRUE;
+  }
+  priv->check_id = 0;
+
+  /* Get mixer position to start new deck */
+  if (!gst_element_query_position (priv->mixer, GST_FORMAT_TIME, &target))
+    target = 0;
+
+  /* Start new deck at zero volume */
+  priv->deck ^= 1;
+  melo_player_file_deck_link (pfile, priv->deck, target, 0.0);
+
+  /* Unlock player mutex */
+  g_mutex_unlock (&priv->mutex);
+
+  /* Play prefetched media */
+  melo_player_file_switch (pfile, TRUE);
+
+  /* Ramp volumes */
+  g_mutex_lock (&priv->mutex);
+  if (priv->fade_src && !priv->fade_id)
+    priv->fade_id = g_timeout_add (MELO_PLAYER_FILE_CROSSFADE_STEP,
+                                   melo_player_file_fade, pfile);
+  g_mutex_unlock (&priv->mutex);
+
+  return FALSE;
+}
+
+/**
+ * melo_player_file_set_crossfade:
+ * @pfile: the file player
+ * @duration: the crossfade duration (in ms), 0 to disable
+ *
+ * Set the duration of the crossfade between two consecutive medias of the
+ * playlist: the next media is started on a second branch @duration ms before
+ * the end of the current media, and the volumes of both branches are ramped
+ * in the mixer. When disabled, the medias are played without any gap.
+ * The new duration is used from the next prefetched media.
+ *
+ * The mixer is inserted in the pipeline the first time the crossfade is
+ * enabled, and it is kept when the crossfade is disabled again.
+ */
+void
+melo_player_file_set_crossfade (MeloPlayerFile *pfile, guint duration)
+{
+  MeloPlayerFilePrivate *priv = pfile->priv;
+
+  /* Set new duration */
+  g_atomic_int_set (&priv->crossfade, duration);
+  if (!duration)
+    return;
+
+  /* Insert mixer and second deck */
+  g_mutex_lock (&priv->mutex);
+  if (!priv->mixer)
+    melo_player_file_add_mixer (pfile);
+  g_mutex_unlock (&priv->mutex);
+}
+
 static gboolean
 bus_call (GstBus *bus, GstMessage *msg, gpointer data)
 {
@@ -171,25 +811,36 @@ bus_call (GstBus *bus, GstMessage *msg, gpointer data)
   MeloPlayer *player = MELO_PLAYER (pfile);
   GError *error;
 
+  /* Messages from prefetched media: its tags will be sent again by its deck
+   * when it will be played, and it is dropped on error.
+   */
+  if (priv->next_src &&
+      gst_object_has_as_ancestor (GST_MESSAGE_SRC (msg),
+                                  GST_OBJECT (priv->next_src))) {
+    if (GST_MESSAGE_TYPE (msg) == GST_MESSAGE_ERROR) {
+      g_mutex_lock (&priv->mutex);
+      melo_player_file_drop_next (pfile);
+      g_mutex_unlock (&priv->mutex);
+    }
+    return TRUE;
+  }
+
   /* Process bus message */
   switch (GST_MESSAGE_TYPE (msg)) {
     case GST_MESSAGE_DURATION_CHANGED:
-    case GST_MESSAGE_ASYNC_DONE: {
-      gint64 value;
-
-      /* Get duration */
-      if (gst_element_query_duration (priv->src, GST_FORMAT_TIME, &value))
-        melo_player_set_status_duration (player, value / 1000000);
-
-      /* Get position */
-      if (gst_element_query_position (priv->pipeline, GST_FORMAT_TIME, &value))
-        melo_player_set_status_pos (player, value / 1000000);
+    case GST_MESSAGE_ASYNC_DONE:
+      /* Get duration and position */
+      melo_player_file_update_duration (pfile);
       break;
-    }
     case GST_MESSAGE_TAG: {
       MeloTags *mtags, *otags;
       GstTagList *tags;
 
+      /* Tags of faded media */
+      if (GST_MESSAGE_SRC (msg) ==
+          GST_OBJECT (priv->decks[priv->deck ^ 1].concat))
+        break;
+
       /* Get tag list from message */
       gst_message_parse_tag (msg, &tags);
 
@@ -211,11 +862,19 @@ bus_call (GstBus *bus, GstMessage *msg, gpointer data)
       gst_tag_list_unref (tags);
       break;
     }
+    case GST_MESSAGE_APPLICATION:
+      /* Prefetched media is now played */
+      if (melo_player_file_is_next_active (pfile))
+        melo_player_file_switch (pfile, FALSE);
+      break;
     case GST_MESSAGE_STREAM_START:
       /* Playback is started */
       melo_player_set_status_state (player,
                                     priv->load ? MELO_PLAYER_STATE_PAUSED :
                                                  MELO_PLAYER_STATE_PLAYING);
+
+      /* Prepare next media for gapless playback */
+      melo_player_file_prefetch (pfile);
       break;
     case GST_MESSAGE_BUFFERING: {
       gint percent;
@@ -236,12 +895,12 @@ bus_call (GstBus *bus, GstMessage *msg, gpointer data)
       break;
     }
     case GST_MESSAGE_EOS:
+      /* Sink has received EOS (no media prefetched): it must be restarted */
+      gst_element_set_state (priv->pipeline, GST_STATE_NULL);
+
       /* Play next media */
-      if (!melo_player_file_next (player)) {
-        /* Stop playing */
-        gst_element_set_state (priv->pipeline, GST_STATE_NULL);
+      if (!melo_player_file_next (player))
         melo_player_set_status_state (player, MELO_PLAYER_STATE_STOPPED);
-      }
       break;
 
     case GST_MESSAGE_ERROR:
@@ -259,32 +918,28 @@ bus_call (GstBus *bus, GstMessage *msg, gpointer data)
 }
 
 static void
-pad_added_handler (GstElement *src, GstPad *pad, GstElement *sink)
+pad_added_handler (GstElement *src, GstPad *pad, gpointer user_data)
 {
   GstStructure *str;
   GstPad *sink_pad;
   GstCaps *caps;
 
-  /* Get sink pad from sink element */
-  sink_pad = gst_element_get_static_pad (sink, "sink");
-  if (GST_PAD_IS_LINKED (sink_pad)) {
-    g_object_unref (sink_pad);
+  /* Get concat pad of the source */
+  sink_pad = g_object_get_data (G_OBJECT (src), "concat-pad");
+  if (GST_PAD_IS_LINKED (sink_pad))
     return;
-  }
 
   /* Only select audio pad */
   caps = gst_pad_query_caps (pad, NULL);
   str = gst_caps_get_structure (caps, 0);
   if (!g_strrstr (gst_structure_get_name (str), "audio")) {
     gst_caps_unref (caps);
-    gst_object_unref (sink_pad);
     return;
   }
   gst_caps_unref (caps);
 
   /* Link elements */
   gst_pad_link (pad, sink_pad);
-  g_object_unref (sink_pad);
 }
 
 static gboolean
@@ -297,12 +952,8 @@ melo_player_file_add (MeloPlayer *player, const gchar *path, const gchar *name,
     return FALSE;
 
   /* Extract file name from URI */
-  if (!name) {
-    gchar *escaped = g_path_get_basename (path);
-    _name = g_uri_unescape_string (escaped, NULL);
-    g_free (escaped);
-    name = _name;
-  }
+  if (!name)
+    name = _name = melo_player_file_get_name (path);
 
   /* Add URI to playlist */
   melo_playlist_add (player->playlist, path, name, tags, FALSE);
@@ -316,23 +967,42 @@ melo_player_file_setup (MeloPlayer *player, const gchar *path,
                         const gchar *name, MeloTags *tags, gboolean insert,
                         MeloPlayerState state)
 {
-  MeloPlayerFilePrivate *priv = (MELO_PLAYER_FILE (player))->priv;
+  MeloPlayerFile *pfile = MELO_PLAYER_FILE (player);
+  MeloPlayerFilePrivate *priv = pfile->priv;
+  gboolean warm = FALSE;
   gchar *_name = NULL;
+  GstState current;
+  GstElement *src;
 
   /* Lock player mutex */
   g_mutex_lock (&priv->mutex);
 
-  /* Stop pipeline */
-  gst_element_set_state (priv->pipeline, GST_STATE_NULL);
+  /* Drop prefetched media and stop crossfade */
+  melo_player_file_drop_next (pfile);
+  melo_player_file_fade_stop (pfile);
 
-  /* Extract file name from URI */
-  if (!name) {
-    gchar *escaped = g_path_get_basename (path);
-    _name = g_uri_unescape_string (escaped, NULL);
-    g_free (escaped);
-    name = _name;
+  /* Get current pipeline state */
+  gst_element_get_state (priv->pipeline, &current, NULL, 0);
+
+  if (current >= GST_STATE_PAUSED && state != MELO_PLAYER_STATE_STOPPED) {
+    warm = TRUE;
+
+    /* Keep the sink running (audio device stays open and negotiated) and only
+     * replace the decoding branch.
+     */
+    src = priv->src;
+    priv->src = melo_player_file_add_src (pfile, priv->deck);
+    melo_player_file_remove_src (pfile, src);
+  } else {
+    /* Stop pipeline */
+    gst_element_set_state (priv->pipeline, GST_STATE_NULL);
+    gst_pad_set_offset (priv->decks[priv->deck].src_pad, 0);
   }
 
+  /* Extract file name from URI */
+  if (!name)
+    name = _name = melo_player_file_get_name (path);
+
   /* Reset status */
   melo_player_reset_status (player, state, name, melo_tags_ref (tags));
 
@@ -346,6 +1016,9 @@ melo_player_file_setup (MeloPlayer *player, const gchar *path,
     gst_element_set_state (priv->pipeline, GST_STATE_PAUSED);
   }
 
+  /* Start new source when pipeline was already running */
+  gst_element_sync_state_with_parent (priv->src);
+
   /* Add new file to playlist */
   if (insert && player->playlist)
     melo_playlist_add (player->playlist, path, name, tags, TRUE);
@@ -354,6 +1027,14 @@ melo_player_file_setup (MeloPlayer *player, const gchar *path,
   /* Unlock player mutex */
   g_mutex_unlock (&priv->mutex);
 
+  /* With the mixer, no new stream start is sent for the new source */
+  if (warm) {
+    melo_player_set_status_state (player,
+                                  priv->load ? MELO_PLAYER_STATE_PAUSED :
+                                               MELO_PLAYER_STATE_PLAYING);
+    melo_player_file_prefetch (pfile);
+  }
+
   return TRUE;
 }
 
@@ -449,6 +1130,11 @@ melo_player_file_set_pos (MeloPlayer *player, gint pos)
   MeloPlayerFilePrivate *priv = (MELO_PLAYER_FILE (player))->priv;
   gint64 time = (gint64) pos * 1000000;
 
+  /* Finish crossfade: only the current media is seeked */
+  g_mutex_lock (&priv->mutex);
+  melo_player_file_fade_stop (MELO_PLAYER_FILE (player));
+  g_mutex_unlock (&priv->mutex);
+
   /* Seek to new position */
   if (!gst_element_seek (priv->pipeline, 1.0, GST_FORMAT_TIME,
                          GST_SEEK_FLAG_FLUSH, GST_SEEK_TYPE_SET, time,
@@ -487,7 +1173,7 @@ melo_player_file_get_pos (MeloPlayer *player)
   gint64 pos;
 
   /* Get length */
-  if (!gst_element_query_position (priv->pipeline, GST_FORMAT_TIME, &pos))
+  if (!melo_player_file_query_pos (priv, &pos))
     pos = 0;
 
   return pos / 1000000;
@@ -50,6 +50,8 @@ struct _MeloPlayerFileClass {
 
 GType melo_player_file_get_type (void);
 
+void melo_player_file_set_crossfade (MeloPlayerFile *pfile, guint duration);
+
 G_END_DECLS
 
 #endif /* __MELO_PLAYER_FILE_H__ */
@@ -234,6 +234,10 @@ bus_call (GstBus *bus, GstMessage *msg, gpointer data)
                                     priv->load ? MELO_PLAYER_STATE_PAUSED :
                                                  MELO_PLAYER_STATE_PLAYING);
       break;
+    case GST_MESSAGE_ASYNC_DONE:
+      /* Position changed (seek is done): query it at next status request */
+      melo_player_resync_pos (player);
+      break;
     case GST_MESSAGE_BUFFERING: {
       gint percent;
 
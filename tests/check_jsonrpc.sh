@@ -72,3 +72,7 @@ post '[
         {"jsonrpc": "2.0", "method": "notify_hello", "params": [7]}
     ]'
 
+
+# rpc method statistics:
+post '{"jsonrpc": "2.0", "method": "rpc.get_stats", "params": {"method": "rpc.get_stats"}, "id": 1}'
+post '{"jsonrpc": "2.0", "method": "rpc.reset_stats", "params": [], "id": 2}'
@@ -0,0 +1,453 @@
+/*
+ * melo_bench.c: File player and mixer benchmark
+ *
+ * Copyright (C) 2017 Alexandre Dilly <dillya@sparod.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA  02110-1301, USA.
+ */
+
+#include <stdio.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+
+#include <glib.h>
+#include <gst/gst.h>
+
+#include "melo_sink.h"
+#include "melo_player_file.h"
+#include "melo_playlist_simple.h"
+
+/* Default play duration of each file in real-time mode (in s) */
+#define MELO_BENCH_DURATION 10
+
+/* Polling interval of the player state (in ms) */
+#define MELO_BENCH_POLL_INTERVAL 10
+
+/* Results for one file of the corpus (summed on all streams) */
+typedef struct {
+  gint64 wall;
+  gint64 latency;
+  guint latency_count;
+  guint underruns;
+  GstClockTime decoded;
+  guint count;
+} MeloBenchResult;
+
+/* A stream is a MeloPlayerFile playing all files of the corpus, one after
+ * the other. By default, the clock synchronization is disabled, so each file
+ * is played as fast as possible until its end: the playlist only holds the
+ * current file, so the next one is not prefetched.
+ *
+ * In real-time mode, the player output is synchronized on the clock of the
+ * main mixer: the first file is started with melo_player_play() and the next
+ * ones are played from the playlist with melo_player_next(), after the play
+ * duration.
+ */
+typedef struct {
+  MeloPlayer *player;
+  MeloPlaylist *playlist;
+  MeloSink *sink;
+  guint timer_id;
+
+  /* Current file */
+  guint index;
+  gint64 start;
+  gint64 first;
+  guint underruns;
+  GstClockTime decoded;
+} MeloBenchStream;
+
+static gchar **melo_bench_files;
+static guint melo_bench_files_count;
+static MeloBenchResult *melo_bench_results;
+static guint melo_bench_running;
+static guint melo_bench_duration = MELO_BENCH_DURATION;
+static gboolean melo_bench_realtime;
+static GMainLoop *melo_bench_loop;
+
+static GstPadProbeReturn
+melo_bench_buffer_probe (GstPad *pad, GstPadProbeInfo *info,
+                         gpointer user_data)
+{
+  MeloBenchStream *stream = user_data;
+  GstBuffer *buffer = GST_PAD_PROBE_INFO_BUFFER (info);
+
+  /* Save time of first buffer */
+  if (!stream->first)
+    stream->first = g_get_monotonic_time ();
+
+  /* Count played duration */
+  if (GST_BUFFER_DURATION_IS_VALID (buffer))
+    stream->decoded += GST_BUFFER_DURATION (buffer);
+
+  return GST_PAD_PROBE_OK;
+}
+
+static void
+melo_bench_stream_reset (MeloBenchStream *stream)
+{
+  /* Reset counters for new file */
+  stream->first = 0;
+  stream->decoded = 0;
+  stream->underruns = melo_sink_get_underruns (stream->sink);
+  stream->start = g_get_monotonic_time ();
+}
+
+static void
+melo_bench_stream_done (MeloBenchStream *stream)
+{
+  MeloBenchResult *res = &melo_bench_results[stream->index];
+
+  /* Save results of current file */
+  res->wall += g_get_monotonic_time () - stream->start;
+  res->decoded += stream->decoded;
+  res->underruns += melo_sink_get_underruns (stream->sink) - stream->underruns;
+  if (stream->first) {
+    res->latency += stream->first - stream->start;
+    res->latency_count++;
+  }
+  res->count++;
+}
+
+static gboolean
+melo_bench_stream_timer (gpointer user_data)
+{
+  MeloBenchStream *stream = user_data;
+
+  /* Save results of current file */
+  melo_bench_stream_done (stream);
+
+  /* Play next file of the playlist */
+  if (++stream->index < melo_bench_files_count) {
+    melo_bench_stream_reset (stream);
+    if (melo_player_next (stream->player))
+      return G_SOURCE_CONTINUE;
+    g_printerr ("%s: failed to play next file\n",
+                melo_player_get_id (stream->player));
+  }
+
+  /* End of corpus */
+  melo_player_set_state (stream->player, MELO_PLAYER_STATE_STOPPED);
+  stream->timer_id = 0;
+  if (!--melo_bench_running)
+    g_main_loop_quit (melo_bench_loop);
+
+  return G_SOURCE_REMOVE;
+}
+
+static gboolean
+melo_bench_stream_play_file (MeloBenchStream *stream)
+{
+  gboolean ret;
+  gchar *uri;
+
+  /* Play current file alone */
+  melo_playlist_empty (stream->playlist);
+  melo_bench_stream_reset (stream);
+  uri = gst_filename_to_uri (melo_bench_files[stream->index], NULL);
+  ret = melo_player_play (stream->player, uri, NULL, NULL, TRUE);
+  g_free (uri);
+
+  return ret;
+}
+
+static gboolean
+melo_bench_stream_poll (gpointer user_data)
+{
+  MeloBenchStream *stream = user_data;
+  MeloPlayerState state;
+
+  /* Wait end of current file */
+  state = melo_player_get_state (stream->player);
+  if (state != MELO_PLAYER_STATE_STOPPED && state != MELO_PLAYER_STATE_ERROR)
+    return G_SOURCE_CONTINUE;
+
+  /* Save results of current file */
+  melo_bench_stream_done (stream);
+
+  /* Play next file */
+  if (++stream->index < melo_bench_files_count) {
+    if (melo_bench_stream_play_file (stream))
+      return G_SOURCE_CONTINUE;
+    g_printerr ("%s: failed to play next file\n",
+                melo_player_get_id (stream->player));
+  }
+
+  /* End of corpus */
+  stream->timer_id = 0;
+  if (!--melo_bench_running)
+    g_main_loop_quit (melo_bench_loop);
+
+  return G_SOURCE_REMOVE;
+}
+
+static gboolean
+melo_bench_stream_play (MeloBenchStream *stream)
+{
+  gboolean ret;
+  gchar *uri;
+  guint i;
+
+  /* Play files as fast as possible */
+  if (!melo_bench_realtime) {
+    if (!melo_bench_stream_play_file (stream))
+      return FALSE;
+    stream->timer_id = g_timeout_add (MELO_BENCH_POLL_INTERVAL,
+                                      melo_bench_stream_poll, stream);
+    return TRUE;
+  }
+
+  /* Add next files to playlist: the first file added is the last played */
+  for (i = melo_bench_files_count - 1; i > 0; i--) {
+    uri = gst_filename_to_uri (melo_bench_files[i], NULL);
+    melo_player_add (stream->player, uri, NULL, NULL);
+    g_free (uri);
+  }
+
+  /* Play first file and insert it before the next files */
+  melo_bench_stream_reset (stream);
+  uri = gst_filename_to_uri (melo_bench_files[0], NULL);
+  ret = melo_player_play (stream->player, uri, NULL, NULL, TRUE);
+  g_free (uri);
+  if (!ret)
+    return FALSE;
+
+  /* Play next file after play duration */
+  stream->timer_id = g_timeout_add_seconds (melo_bench_duration,
+                                            melo_bench_stream_timer, stream);
+
+  return TRUE;
+}
+
+static MeloBenchStream *
+melo_bench_stream_new (guint id)
+{
+  MeloBenchStream *stream;
+  GstElement *sink;
+  gchar *name;
+  GstPad *pad;
+
+  /* Create stream */
+  stream = g_slice_new0 (MeloBenchStream);
+  if (!stream)
+    return NULL;
+
+  /* Create file player and its playlist */
+  name = g_strdup_printf ("bench%u", id);
+  stream->player = melo_player_new (MELO_TYPE_PLAYER_FILE, name, name);
+  g_free (name);
+  name = g_strdup_printf ("bench%u_playlist", id);
+  stream->playlist = melo_playlist_new (MELO_TYPE_PLAYLIST_SIMPLE, name);
+  g_free (name);
+  if (!stream->player || !stream->playlist)
+    goto failed;
+  melo_player_set_playlist (stream->player, stream->playlist);
+  melo_playlist_set_player (stream->playlist, stream->player);
+
+  /* Get sink of the player */
+  name = g_strdup_printf ("bench%u_sink", id);
+  stream->sink = melo_sink_get_sink_by_id (name);
+  g_free (name);
+  if (!stream->sink)
+    goto failed;
+
+  /* Disable clock synchronization of the player output */
+  if (!melo_bench_realtime)
+    melo_sink_set_sync (stream->sink, FALSE);
+
+  /* Watch buffers played by the player */
+  sink = melo_sink_get_gst_sink (stream->sink);
+  pad = gst_element_get_static_pad (sink, "sink");
+  gst_object_unref (sink);
+  gst_pad_add_probe (pad, GST_PAD_PROBE_TYPE_BUFFER, melo_bench_buffer_probe,
+                     stream, NULL);
+  gst_object_unref (pad);
+
+  return stream;
+
+failed:
+  if (stream->playlist)
+    g_object_unref (stream->playlist);
+  if (stream->player)
+    g_object_unref (stream->player);
+  g_slice_free (MeloBenchStream, stream);
+  return NULL;
+}
+
+static void
+melo_bench_stream_free (MeloBenchStream *stream)
+{
+  /* Stop timer */
+  if (stream->timer_id)
+    g_source_remove (stream->timer_id);
+
+  /* Release sink, playlist and player */
+  g_object_unref (stream->sink);
+  g_object_unref (stream->playlist);
+  g_object_unref (stream->player);
+  g_slice_free (MeloBenchStream, stream);
+}
+
+static gint64
+melo_bench_get_cpu_time (void)
+{
+  struct rusage usage;
+
+  /* Get user and system time of process (in us) */
+  getrusage (RUSAGE_SELF, &usage);
+  return (gint64) (usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) * 1000000 +
+         usage.ru_utime.tv_usec + usage.ru_stime.tv_usec;
+}
+
+static void
+melo_bench_print_results (guint streams, gint64 wall, gint64 cpu)
+{
+  GstClockTime decoded = 0;
+  guint i;
+
+  /* Print results by file: the played ratio is the real-time factor and the
+   * latency is the time between the call to melo_player_play() /
+   * melo_player_next() and the first buffer played.
+   */
+  printf ("%-32s %8s %14s %10s\n", "file", "played", "latency (ms)",
+          "underruns");
+  for (i = 0; i < melo_bench_files_count; i++) {
+    MeloBenchResult *res = &melo_bench_results[i];
+    gchar *name;
+
+    if (!res->count || !res->wall)
+      continue;
+
+    /* Ratio of played media duration by wall time */
+    name = g_path_get_basename (melo_bench_files[i]);
+    printf ("%-32s %8.2f %14.1f %10u\n", name,
+            (gdouble) res->decoded / GST_USECOND / res->wall,
+            res->latency_count ?
+              (gdouble) res->latency / res->latency_count / 1000 : 0.0,
+            res->underruns);
+    decoded += res->decoded;
+    g_free (name);
+  }
+
+  /* Print global results: the CPU usage is the processing time needed for
+   * one second of media by one stream.
+   */
+  printf ("\n%u stream(s): %.1f s of media played in %.1f s\n", streams,
+          (gdouble) decoded / GST_SECOND, (gdouble) wall / G_USEC_PER_SEC);
+  if (decoded)
+    printf ("CPU per stream: %.2f %% of real-time\n",
+            (gdouble) cpu * 100 / (decoded / GST_USECOND));
+}
+
+int
+main (int argc, char *argv[])
+{
+  /* Command line options */
+  gint streams = 1;
+  gint duration = MELO_BENCH_DURATION;
+  gboolean realtime = FALSE;
+  GOptionEntry options[] = {
+    {"streams", 's', 0, G_OPTION_ARG_INT, &streams,
+                              "Number of parallel streams (default: 1)", NULL},
+    {"realtime", 'r', 0, G_OPTION_ARG_NONE, &realtime,
+                  "Play files in real-time to measure latency and underruns",
+                  NULL},
+    {"duration", 'd', 0, G_OPTION_ARG_INT, &duration,
+      "Play duration of each file in real-time mode in s (default: 10)", NULL},
+    {NULL}
+  };
+  GOptionContext *ctx;
+  GError *err = NULL;
+  MeloBenchStream **list;
+  gint64 wall, cpu;
+  gint i;
+
+  /* Create option context parser */
+  ctx = g_option_context_new ("FILE...");
+
+  /* Add main entries to context */
+  g_option_context_add_main_entries (ctx, options, NULL);
+
+  /* Add gstreamer group to context */
+  g_option_context_add_group (ctx, gst_init_get_option_group ());
+
+  /* Parse command line */
+  if (!g_option_context_parse (ctx, &argc, &argv, &err)) {
+    g_printerr ("Option parsion failed: %s\n", err->message);
+    g_clear_error (&err);
+    g_option_context_free (ctx);
+    return -1;
+  }
+
+  /* Free option context */
+  g_option_context_free (ctx);
+
+  /* Check corpus */
+  if (argc < 2 || streams < 1 || duration < 1) {
+    g_printerr ("Usage: %s [OPTION...] FILE...\n", argv[0]);
+    return -1;
+  }
+  melo_bench_files = argv + 1;
+  melo_bench_files_count = argc - 1;
+  melo_bench_duration = duration;
+  melo_bench_realtime = realtime;
+
+  /* Initialize main audio sink with a null sound card: in real-time mode, it
+   * is synchronized on the clock, as a real sound card.
+   */
+  melo_sink_set_main_device (realtime ? "fakesink sync=true" :
+                                        "fakesink sync=false");
+  if (!melo_sink_main_init (44100, 2)) {
+    g_printerr ("Failed to initialize main audio sink\n");
+    return -1;
+  }
+
+  /* Create streams */
+  melo_bench_results = g_new0 (MeloBenchResult, melo_bench_files_count);
+  melo_bench_loop = g_main_loop_new (NULL, FALSE);
+  list = g_new0 (MeloBenchStream *, streams);
+  for (i = 0; i < streams; i++)
+    list[i] = melo_bench_stream_new (i);
+
+  /* Start all streams */
+  wall = g_get_monotonic_time ();
+  cpu = melo_bench_get_cpu_time ();
+  for (i = 0; i < streams; i++)
+    if (list[i] && melo_bench_stream_play (list[i]))
+      melo_bench_running++;
+
+  /* Run until end of corpus */
+  if (melo_bench_running)
+    g_main_loop_run (melo_bench_loop);
+  cpu = melo_bench_get_cpu_time () - cpu;
+  wall = g_get_monotonic_time () - wall;
+
+  /* Print results */
+  melo_bench_print_results (streams, wall, cpu);
+
+  /* Free streams */
+  for (i = 0; i < streams; i++)
+    if (list[i])
+      melo_bench_stream_free (list[i]);
+  g_free (list);
+  g_main_loop_unref (melo_bench_loop);
+  g_free (melo_bench_results);
+
+  /* Release main audio sink */
+  melo_sink_main_release ();
+
+  return 0;
+}